@@ -0,0 +1,349 @@
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "device_manager.h"
+#include "harness.h"
+
+using namespace sycl;
+
+// Achievable memory bandwidth, for deciding where data lives in multi-tile
+// and multi-GPU jobs.
+//
+// 1. STREAM kernels on every selected device, with the three arrays in
+//    device, shared and host USM:
+//      copy   c = a          2 arrays moved per element
+//      scale  b = s * c      2
+//      add    c = a + b      3
+//      triad  a = b + s * c  3
+//    Timed by event profiling, so only the kernel counts; "best" is the
+//    fastest repetition, as STREAM reports it. The arrays are then checked
+//    against the values the kernels must have left, as STREAM does.
+// 2. queue::memcpy between every pair of endpoints: pinned (malloc_host)
+//    and pageable host memory, and every selected device or tile. Timed on
+//    the host from submit to completion, since pageable copies are staged
+//    by the runtime outside the command itself. Devices in different
+//    contexts (different platforms) cannot copy directly and show as "-".
+//
+// Devices are the leaf devices of the cached topology (tiles of
+// partitionable GPUs); $SYCL_SAMPLES_DEVICES narrows the selection.
+
+constexpr size_t DEFAULT_ELEMENTS = size_t(1) << 25;
+constexpr size_t DEFAULT_COPY_MB = 256;
+
+template <typename T, int Op>
+class StreamKernel;
+
+double GBps(double bytes, double ms) {
+  return ms > 0.0 ? bytes / ms / 1e6 : 0.0;
+}
+
+double DeviceMs(const event& e) {
+  auto start = e.get_profiling_info<info::event_profiling::command_start>();
+  auto end = e.get_profiling_info<info::event_profiling::command_end>();
+  return (end - start) / 1e6;
+}
+
+void* Allocate(usm::alloc kind, size_t bytes, const queue& q) {
+  switch (kind) {
+    case usm::alloc::device:
+      return malloc_device(bytes, q);
+    case usm::alloc::shared:
+      return malloc_shared(bytes, q);
+    default:
+      return malloc_host(bytes, q);
+  }
+}
+
+std::string DeviceLabel(const DeviceInfo& info) {
+  std::string label = "dev" + std::to_string(info.root);
+  if (info.tile >= 0) label += "." + std::to_string(info.tile);
+  return label;
+}
+
+// STREAM's solution check: the average absolute error of each array
+// against expected, relative to it, within epsilon.
+template <typename T>
+bool CheckArray(queue& q, const T* p, size_t n, T expected, double epsilon,
+                const char* array, std::string* error) {
+  std::vector<T> host(n);
+  q.memcpy(host.data(), p, n * sizeof(T)).wait();
+  double sum = 0.0;
+  for (T v : host) sum += std::fabs(double(v) - double(expected));
+  double average = sum / n;
+  if (average / std::fabs(double(expected)) <= epsilon) return true;
+  *error += std::string(" ") + array + " average error " +
+            std::to_string(average) + " (expected " +
+            std::to_string(double(expected)) + ")";
+  return false;
+}
+
+// Returns false when the arrays do not validate.
+template <typename T>
+bool RunStream(Harness& bench, queue& q, const std::string& label,
+               const char* usm_name, usm::alloc kind, size_t n) {
+  T* a = static_cast<T*>(Allocate(kind, n * sizeof(T), q));
+  T* b = static_cast<T*>(Allocate(kind, n * sizeof(T), q));
+  T* c = static_cast<T*>(Allocate(kind, n * sizeof(T), q));
+  if (!a || !b || !c) {
+    std::cout << "stream," << label << "," << usm_name
+              << ": allocation failed, skipped\n";
+    for (T* p : {a, b, c}) {
+      if (p) free(p, q);
+    }
+    return true;
+  }
+
+  // Initialised on the device, so shared pages start out resident there
+  q.fill(a, T(1), n);
+  q.fill(b, T(2), n);
+  q.fill(c, T(0), n);
+  q.wait();
+
+  const T scalar = T(3);
+  struct Op {
+    const char* name;
+    int arrays;
+    std::function<event()> launch;
+  };
+  const std::vector<Op> ops = {
+      {"copy", 2,
+       [&]() {
+         return q.parallel_for<StreamKernel<T, 0>>(
+             range<1>(n), [=](id<1> i) { c[i] = a[i]; });
+       }},
+      {"scale", 2,
+       [&]() {
+         return q.parallel_for<StreamKernel<T, 1>>(
+             range<1>(n), [=](id<1> i) { b[i] = scalar * c[i]; });
+       }},
+      {"add", 3,
+       [&]() {
+         return q.parallel_for<StreamKernel<T, 2>>(
+             range<1>(n), [=](id<1> i) { c[i] = a[i] + b[i]; });
+       }},
+      {"triad", 3,
+       [&]() {
+         return q.parallel_for<StreamKernel<T, 3>>(
+             range<1>(n), [=](id<1> i) { a[i] = b[i] + scalar * c[i]; });
+       }}};
+
+  bench.set_param("usm", usm_name);
+  for (const auto& op : ops) {
+    Stats s = bench.run_measured(op.name, [&]() {
+      event e = op.launch();
+      e.wait();
+      return DeviceMs(e);
+    });
+    double bytes = static_cast<double>(op.arrays) * n * sizeof(T);
+    std::cout << "stream," << label << "," << usm_name << "," << op.name << ","
+              << GBps(bytes, s.median) << "," << GBps(bytes, s.min) << "\n";
+  }
+
+  // Every kernel reads only arrays it does not write, so however often
+  // each ran, from a = 1, b = 2, c = 0 the four in turn leave c = 1,
+  // b = 3 * 1, c = 1 + 3 and a = 3 + 3 * 4
+  const double epsilon = sizeof(T) == sizeof(double) ? 1e-13 : 1e-6;
+  std::string error;
+  bool valid = CheckArray(q, a, n, T(15), epsilon, "a", &error);
+  valid = CheckArray(q, b, n, T(3), epsilon, "b", &error) && valid;
+  valid = CheckArray(q, c, n, T(4), epsilon, "c", &error) && valid;
+  if (!valid) {
+    std::cout << "stream," << label << "," << usm_name
+              << ": failed validation:" << error << "\n";
+  }
+
+  free(a, q);
+  free(b, q);
+  free(c, q);
+  return valid;
+}
+
+int main(int argc, char* argv[]) {
+  int status = 0;
+  try {
+    HarnessOptions defaults;
+    defaults.repetitions = 10;
+    Args args(argc, argv, defaults);
+    size_t elements = args.get_int("elements", DEFAULT_ELEMENTS);
+    size_t copy_bytes = args.get_int("copy-mb", DEFAULT_COPY_MB) << 20;
+    std::string type = args.get("type", "gpu");
+    bool skip_stream = args.flag("skip-stream");
+    bool skip_copy = args.flag("skip-copy");
+    args.finish();
+
+    DeviceManagerOptions options;
+    options.scope = ContextScope::kPerPlatform;
+    options.type = type == "cpu"   ? info::device_type::cpu
+                   : type == "all" ? info::device_type::all
+                                   : info::device_type::gpu;
+    DeviceManager manager(options);
+    if (manager.size() == 0) {
+      std::cout << "No " << type << " devices found.\n";
+      return -1;
+    }
+
+    std::vector<queue> queues;
+    std::vector<std::string> labels;
+    for (size_t i = 0; i < manager.size(); ++i) {
+      queues.push_back(manager.make_queue(
+          i, harness_exception_handler,
+          property_list{property::queue::in_order{},
+                        property::queue::enable_profiling{}}));
+      labels.push_back(DeviceLabel(manager.info(i)));
+      std::cout << labels.back() << ": " << manager.info(i).name << "\n";
+    }
+
+    Harness bench("stream_bandwidth", args.harness());
+
+    if (!skip_stream) {
+      std::cout << "\nStream: " << elements << " elements per array\n";
+      std::cout << "suite,device,usm,kernel,median_GBps,best_GBps\n";
+      bool valid = true;
+      bench.set_param("elements", elements);
+      const std::vector<std::pair<const char*, usm::alloc>> kinds = {
+          {"device", usm::alloc::device},
+          {"shared", usm::alloc::shared},
+          {"host", usm::alloc::host}};
+      for (size_t i = 0; i < queues.size(); ++i) {
+        bench.set_param("device", manager.info(i).name);
+        bench.set_param("target", labels[i]);
+        bool fp64 = manager.devices()[i].has(aspect::fp64);
+        bench.set_param("type", fp64 ? "double" : "float");
+        for (const auto& [usm_name, kind] : kinds) {
+          if (fp64) {
+            valid = RunStream<double>(bench, queues[i], labels[i], usm_name,
+                                      kind, elements) &&
+                    valid;
+          } else {
+            valid = RunStream<float>(bench, queues[i], labels[i], usm_name,
+                                     kind, elements) &&
+                    valid;
+          }
+        }
+      }
+      if (!valid) {
+        std::cout << "Stream results failed validation.\n";
+        status = -1;
+      } else {
+        std::cout << "Stream results validate.\n";
+      }
+    }
+
+    if (!skip_copy) {
+      bench.clear_params();
+      bench.set_param("bytes", copy_bytes);
+
+      // Endpoints: -2 pinned host, -1 pageable host, >= 0 device index
+      std::vector<int> endpoints = {-2, -1};
+      for (size_t i = 0; i < queues.size(); ++i) endpoints.push_back(i);
+      auto name = [&](int e) -> std::string {
+        return e == -2 ? "pinned" : e == -1 ? "pageable" : labels[e];
+      };
+
+      // One pinned buffer per context, two device buffers per device so a
+      // device can also copy to itself
+      std::vector<std::pair<context, char*>> pinned;
+      auto pinned_for = [&](size_t i) {
+        context ctx = manager.context_for(i);
+        for (const auto& p : pinned) {
+          if (p.first == ctx) return p.second;
+        }
+        char* p = malloc_host<char>(copy_bytes, queues[i]);
+        if (!p) throw std::runtime_error("Pinned host allocation failed");
+        std::memset(p, 1, copy_bytes);
+        pinned.emplace_back(ctx, p);
+        return p;
+      };
+      std::unique_ptr<char[]> pageable(new char[copy_bytes]);
+      std::memset(pageable.get(), 1, copy_bytes);
+      std::vector<char*> src_buf, dst_buf;
+      for (auto& q : queues) {
+        src_buf.push_back(malloc_device<char>(copy_bytes, q));
+        dst_buf.push_back(malloc_device<char>(copy_bytes, q));
+        if (!src_buf.back() || !dst_buf.back()) {
+          throw std::runtime_error("Device allocation failed");
+        }
+        q.memset(src_buf.back(), 1, copy_bytes);
+      }
+      for (auto& q : queues) q.wait();
+
+      auto host_ptr = [&](int e, size_t device) {
+        return e == -2 ? pinned_for(device) : pageable.get();
+      };
+
+      // Median GB/s per (src, dst); negative when the pair cannot copy
+      std::vector<std::vector<double>> matrix(
+          endpoints.size(), std::vector<double>(endpoints.size(), -1.0));
+      for (size_t s = 0; s < endpoints.size(); ++s) {
+        for (size_t d = 0; d < endpoints.size(); ++d) {
+          int src = endpoints[s], dst = endpoints[d];
+          if (src < 0 && dst < 0) continue;  // host to host is not a link
+
+          int runner;  // device whose queue does the copy
+          void* to;
+          const void* from;
+          if (src < 0) {
+            runner = dst;
+            from = host_ptr(src, dst);
+            to = dst_buf[dst];
+          } else if (dst < 0) {
+            runner = src;
+            from = src_buf[src];
+            to = host_ptr(dst, src);
+          } else {
+            if (manager.context_for(src) != manager.context_for(dst)) continue;
+            runner = src;
+            from = src_buf[src];
+            to = dst_buf[dst];
+          }
+          queue* q = &queues[runner];
+
+          bench.set_param("device", manager.info(runner).name);
+          bench.set_param("src", name(src));
+          bench.set_param("dst", name(dst));
+          Stats st = bench.run("memcpy",
+                               [&]() { q->memcpy(to, from, copy_bytes).wait(); });
+          matrix[s][d] = GBps(static_cast<double>(copy_bytes), st.median);
+        }
+      }
+
+      std::cout << "\nqueue::memcpy of " << (copy_bytes >> 20)
+                << " MiB, median GB/s (rows: source, columns: destination)\n";
+      std::cout << std::setw(10) << "";
+      for (int e : endpoints) std::cout << std::setw(10) << name(e);
+      std::cout << "\n" << std::fixed << std::setprecision(1);
+      for (size_t s = 0; s < endpoints.size(); ++s) {
+        std::cout << std::setw(10) << name(endpoints[s]);
+        for (size_t d = 0; d < endpoints.size(); ++d) {
+          if (matrix[s][d] < 0.0) {
+            std::cout << std::setw(10) << "-";
+          } else {
+            std::cout << std::setw(10) << matrix[s][d];
+          }
+        }
+        std::cout << "\n";
+      }
+      std::cout << std::defaultfloat << std::setprecision(6) << "\n";
+
+      for (size_t i = 0; i < queues.size(); ++i) {
+        free(src_buf[i], queues[i]);
+        free(dst_buf[i], queues[i]);
+      }
+      for (const auto& p : pinned) free(p.second, p.first);
+    }
+
+    bench.report();
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+
+  return status;
+}
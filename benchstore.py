@@ -0,0 +1,277 @@
+#!/usr/bin/env python3
+"""Append-only store of benchmark harness results, and a regression check.
+
+Each sample program can write its harness summary as JSON
+(--format json --report run.json, or SYCL_SAMPLES_BENCH=format=json,...).
+`ingest` appends those results to a JSON-lines store, one line per result,
+tagged with a run id, the git commit, the device and the build/run flags.
+`compare` matches the results of two runs by program, benchmark and
+parameters, runs Welch's t-test on each pair and flags the ones that got
+slower by more than a threshold with statistical significance; it exits
+with status 1 when there is a regression, so it can gate a script or CI job.
+
+  ./benchstore.py ingest run.json --flags "AOT=gpu"
+  ./benchstore.py list
+  ./benchstore.py compare previous latest --threshold 5
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import subprocess
+import sys
+from typing import Any, Dict, List, Optional, Tuple
+
+DEFAULT_STORE = os.environ.get("SYCL_SAMPLES_RESULTS", "bench_results.jsonl")
+
+# ---------------------------------------------------------------------------
+# Statistics: Welch's t-test without scipy
+
+
+def _betacf(a: float, b: float, x: float) -> float:
+    """Continued fraction for the incomplete beta function (modified Lentz)."""
+    tiny = 1e-300
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c, d = 1.0, 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 3e-14:
+            break
+    return h
+
+
+def betainc(a: float, b: float, x: float) -> float:
+    """Regularized incomplete beta function I_x(a, b)."""
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    ln_front = (math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b)
+                + a * math.log(x) + b * math.log(1.0 - x))
+    front = math.exp(ln_front)
+    if x < (a + 1.0) / (a + b + 2.0):
+        return front * _betacf(a, b, x) / a
+    return 1.0 - front * _betacf(b, a, 1.0 - x) / b
+
+
+def welch_t_test(mean1: float, sd1: float, n1: int,
+                 mean2: float, sd2: float, n2: int) -> Tuple[float, float, float]:
+    """Two-sided Welch's t-test from summary statistics: (t, df, p)."""
+    if n1 < 2 or n2 < 2:
+        return 0.0, 0.0, 1.0
+    v1, v2 = sd1 * sd1 / n1, sd2 * sd2 / n2
+    if v1 + v2 == 0.0:
+        # Noise-free samples: any difference is significant
+        return 0.0, 0.0, (1.0 if mean1 == mean2 else 0.0)
+    t = (mean2 - mean1) / math.sqrt(v1 + v2)
+    df = (v1 + v2) ** 2 / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1))
+    p = betainc(df / 2.0, 0.5, df / (df + t * t))
+    return t, df, p
+
+# ---------------------------------------------------------------------------
+# Store
+
+
+def git_commit() -> Tuple[str, bool]:
+    """Current commit, and whether the working tree has local changes."""
+    try:
+        commit = subprocess.run(["git", "rev-parse", "HEAD"], capture_output=True,
+                                text=True, check=True).stdout.strip()
+        status = subprocess.run(["git", "status", "--porcelain", "--untracked-files=no"],
+                                capture_output=True, text=True, check=True).stdout
+        return commit, bool(status.strip())
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown", False
+
+
+def load_store(path: str) -> List[Dict[str, Any]]:
+    records = []
+    if not os.path.exists(path):
+        return records
+    with open(path) as fp:
+        for lineno, line in enumerate(fp, 1):
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                records.append(json.loads(line))
+            except json.JSONDecodeError:
+                print(f"{path}:{lineno}: skipping malformed record", file=sys.stderr)
+    return records
+
+
+def result_key(record: Dict[str, Any]) -> Tuple:
+    """What must match for two results to be comparable."""
+    params = tuple(sorted(record.get("params", {}).items()))
+    return (record["program"], record["benchmark"], params)
+
+
+def ingest(args: argparse.Namespace) -> int:
+    commit, dirty = git_commit()
+    if args.commit:
+        commit, dirty = args.commit, False
+    now = datetime.datetime.now(datetime.timezone.utc)
+    run_id = args.run or f"{now.strftime('%Y%m%dT%H%M%SZ')}-{commit[:10]}"
+
+    lines = []
+    for path in args.results:
+        with open(path) as fp:
+            data = json.load(fp)
+        for result in data.get("results", []):
+            params = dict(result.get("params", {}))
+            device = params.pop("device", None) or args.device
+            record = {
+                "run": run_id,
+                "time": now.isoformat(timespec="seconds"),
+                "commit": commit,
+                "dirty": dirty,
+                "device": device,
+                "flags": args.flags,
+                "program": data.get("program", os.path.basename(path)),
+                "benchmark": result["benchmark"],
+                "params": params,
+            }
+            for field in ("samples", "rejected", "mean_ms", "stddev_ms", "median_ms",
+                          "p95_ms", "min_ms", "max_ms", "ci95_ms"):
+                record[field] = result.get(field)
+            lines.append(json.dumps(record, sort_keys=True))
+
+    # Append only: earlier runs are never rewritten
+    with open(args.store, "a") as fp:
+        for line in lines:
+            fp.write(line + "\n")
+    print(f"run {run_id}: {len(lines)} result(s) appended to {args.store}")
+    return 0
+
+
+def runs_in_order(records: List[Dict[str, Any]]) -> List[str]:
+    order = []
+    for record in records:
+        if record["run"] not in order:
+            order.append(record["run"])
+    return order
+
+
+def resolve_run(records: List[Dict[str, Any]], spec: str) -> Optional[str]:
+    """Run id from "latest", "previous", a run id, or a commit prefix (its latest run)."""
+    order = runs_in_order(records)
+    if not order:
+        return None
+    if spec == "latest":
+        return order[-1]
+    if spec == "previous":
+        return order[-2] if len(order) > 1 else None
+    if spec in order:
+        return spec
+    matches = [r["run"] for r in records if r["commit"].startswith(spec)]
+    return matches[-1] if matches else None
+
+
+def list_runs(args: argparse.Namespace) -> int:
+    records = load_store(args.store)
+    for run in runs_in_order(records):
+        rs = [r for r in records if r["run"] == run]
+        first = rs[0]
+        devices = sorted({str(r["device"]) for r in rs})
+        print(f"{run}  {first['time']}  {first['commit'][:10]}{'+' if first['dirty'] else ''}"
+              f"  device={','.join(devices)}  flags={first['flags'] or '-'}  results={len(rs)}")
+    return 0
+
+
+def compare(args: argparse.Namespace) -> int:
+    records = load_store(args.store)
+    base_run = resolve_run(records, args.base)
+    new_run = resolve_run(records, args.new)
+    if base_run is None or new_run is None:
+        print(f"Cannot find runs {args.base!r} and {args.new!r} in {args.store}", file=sys.stderr)
+        return 2
+
+    base = {}
+    for r in records:
+        if r["run"] == base_run:
+            base[(r["device"],) + result_key(r)] = r
+
+    print(f"base {base_run}  vs  new {new_run}  "
+          f"(threshold {args.threshold}%, alpha {args.alpha})")
+    regressions = compared = 0
+    for r in records:
+        if r["run"] != new_run:
+            continue
+        key = (r["device"],) + result_key(r)
+        if key not in base:
+            continue
+        b = base[key]
+        compared += 1
+        t, df, p = welch_t_test(b["mean_ms"], b["stddev_ms"] or 0.0, b["samples"],
+                                r["mean_ms"], r["stddev_ms"] or 0.0, r["samples"])
+        change = (r["mean_ms"] - b["mean_ms"]) / b["mean_ms"] * 100.0 if b["mean_ms"] else 0.0
+        significant = p < args.alpha
+        if significant and change > args.threshold:
+            verdict = "REGRESSION"
+            regressions += 1
+        elif significant and change < -args.threshold:
+            verdict = "improved"
+        elif significant:
+            verdict = "changed (within threshold)"
+        else:
+            verdict = "no significant change"
+        params = ",".join(f"{k}={v}" for k, v in sorted(r["params"].items()))
+        print(f"  {r['program']}/{r['benchmark']} [{params}] on {r['device']}: "
+              f"{b['mean_ms']:.4g} -> {r['mean_ms']:.4g} ms ({change:+.2f}%), "
+              f"t={t:.2f}, df={df:.1f}, p={p:.3g}: {verdict}")
+
+    if compared == 0:
+        print("  no comparable results (same program, benchmark, parameters and device)")
+    print(f"{compared} compared, {regressions} regression(s)")
+    return 1 if regressions else 0
+
+
+def parse_args() -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Benchmark result store and regression check")
+    parser.add_argument("--store", default=DEFAULT_STORE,
+                        help="JSON-lines result store (default: $SYCL_SAMPLES_RESULTS or %(default)s)")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("ingest", help="append harness JSON results as one run")
+    p.add_argument("results", nargs="+", help="harness JSON files of this run")
+    p.add_argument("--device", help="device name, when the results do not carry one")
+    p.add_argument("--flags", default="", help="build and run flags, e.g. \"AOT=gpu -Q 1\"")
+    p.add_argument("--commit", help="commit to record instead of the current git HEAD")
+    p.add_argument("--run", help="run id (default: UTC time and commit)")
+    p.set_defaults(func=ingest)
+
+    p = sub.add_parser("list", help="list the stored runs")
+    p.set_defaults(func=list_runs)
+
+    p = sub.add_parser("compare", help="compare two runs; exit 1 on a regression")
+    p.add_argument("base", help="run id, commit prefix, \"previous\" or \"latest\"")
+    p.add_argument("new", help="run id, commit prefix, \"previous\" or \"latest\"")
+    p.add_argument("--threshold", type=float, default=5.0,
+                   help="slowdown in percent that counts as a regression (default: %(default)s)")
+    p.add_argument("--alpha", type=float, default=0.05,
+                   help="significance level of the t-test (default: %(default)s)")
+    p.set_defaults(func=compare)
+
+    return parser.parse_args()
+
+
+if __name__ == "__main__":
+    args = parse_args()
+    sys.exit(args.func(args))
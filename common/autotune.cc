@@ -0,0 +1,220 @@
+#include "autotune.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+constexpr const char* kDbMagic = "sycl-samples-tuning 1";
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) parts.push_back(part);
+  return parts;
+}
+
+// Entries in file order; a missing or foreign file reads as empty.
+std::vector<std::pair<std::string, LaunchConfig>> read_db(
+    const std::string& path) {
+  std::vector<std::pair<std::string, LaunchConfig>> entries;
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != kDbMagic) return entries;
+  while (std::getline(in, line)) {
+    auto fields = split(line, '\t');
+    if (fields.size() != 5) continue;
+    try {
+      LaunchConfig config;
+      config.local_size = std::stoul(fields[1]);
+      config.sub_group_size = std::stoul(fields[2]);
+      config.items_per_work_item = std::stoul(fields[3]);
+      config.ms = std::stod(fields[4]);
+      entries.emplace_back(fields[0], config);
+    } catch (std::exception const&) {
+      // corrupt entry: tuned again when it is next needed
+    }
+  }
+  return entries;
+}
+
+// Exclusive flock on a sidecar file for as long as it lives. The database
+// itself is replaced by rename, so it cannot carry the lock. Without a lock
+// file (say, a read-only directory) it does nothing, and the rename below
+// fails the same way.
+class FileLock {
+ public:
+  explicit FileLock(const std::string& path)
+      : fd_(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+    if (fd_ >= 0) flock(fd_, LOCK_EX);
+  }
+  ~FileLock() {
+    if (fd_ >= 0) close(fd_);  // releases the lock
+  }
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+ private:
+  int fd_;
+};
+
+double median(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  return n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+}
+
+}  // namespace
+
+std::string to_string(const LaunchConfig& config) {
+  if (config.local_size == 0) return "range (runtime's choice)";
+  std::ostringstream os;
+  os << "local " << config.local_size << ", sub-group "
+     << (config.sub_group_size ? std::to_string(config.sub_group_size)
+                               : std::string("auto"))
+     << ", " << config.items_per_work_item << " item"
+     << (config.items_per_work_item == 1 ? "" : "s") << "/work-item";
+  return os.str();
+}
+
+std::string TuningDb::default_path() {
+  if (const char* path = std::getenv("SYCL_SAMPLES_TUNING_DB")) {
+    return path;
+  }
+  const char* home = std::getenv("HOME");
+  std::string dir = home ? std::string(home) + "/.cache" : "/tmp";
+  return dir + "/sycl-samples-tuning.txt";
+}
+
+std::string TuningDb::key(const std::string& kernel, const sycl::device& dev,
+                          const std::string& problem) {
+  // Tabs separate the fields of a line, so they cannot appear in a key
+  std::string key = kernel + "|" +
+                    dev.get_info<sycl::info::device::name>() + "|" +
+                    dev.get_info<sycl::info::device::driver_version>() + "|" +
+                    problem;
+  std::replace(key.begin(), key.end(), '\t', ' ');
+  return key;
+}
+
+TuningDb::TuningDb(std::string path) : path_(std::move(path)) {}
+
+bool TuningDb::lookup(const std::string& key, LaunchConfig* config) const {
+  for (const auto& entry : read_db(path_)) {
+    if (entry.first == key) {
+      *config = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TuningDb::store(const std::string& key,
+                     const LaunchConfig& config) const {
+  // Held from the read to the rename, so two processes storing at once
+  // cannot both start from the old file and drop each other's entry
+  FileLock lock(path_ + ".lock");
+  auto entries = read_db(path_);
+  bool replaced = false;
+  for (auto& entry : entries) {
+    if (entry.first == key) {
+      entry.second = config;
+      replaced = true;
+    }
+  }
+  if (!replaced) entries.emplace_back(key, config);
+
+  // Private file renamed into place, as for the topology cache
+  std::string tmp = path_ + "." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp);
+    if (!out) return;
+    out << kDbMagic << "\n";
+    for (const auto& entry : entries) {
+      const LaunchConfig& c = entry.second;
+      out << entry.first << '\t' << c.local_size << '\t' << c.sub_group_size
+          << '\t' << c.items_per_work_item << '\t' << c.ms << "\n";
+    }
+  }
+  if (std::rename(tmp.c_str(), path_.c_str()) != 0) std::remove(tmp.c_str());
+}
+
+Autotuner::Autotuner(sycl::queue q, TuningDb db)
+    : queue_(std::move(q)), db_(std::move(db)) {}
+
+LaunchConfig Autotuner::tune(
+    const std::string& kernel, const std::string& problem,
+    const std::function<double(const LaunchConfig&)>& run,
+    const TuneSpace& space) {
+  sycl::device dev = queue_.get_device();
+  std::string key = TuningDb::key(kernel, dev, problem);
+  last_candidates_ = 0;
+
+  LaunchConfig best;
+  last_from_db_ = !retune_ && db_.lookup(key, &best);
+  if (last_from_db_) return best;
+
+  size_t max_local = dev.get_info<sycl::info::device::max_work_group_size>();
+  std::vector<size_t> local_sizes = space.local_sizes;
+  if (local_sizes.empty()) {
+    for (size_t l = 8; l <= max_local; l *= 2) local_sizes.push_back(l);
+  }
+  std::vector<size_t> sub_group_sizes = space.sub_group_sizes;
+  if (sub_group_sizes.empty()) {
+    sub_group_sizes.push_back(0);
+    for (size_t s : dev.get_info<sycl::info::device::sub_group_sizes>()) {
+      if (s == 8 || s == 16 || s == 32) sub_group_sizes.push_back(s);
+    }
+  }
+
+  best.ms = -1.0;
+  for (size_t local : local_sizes) {
+    if (local > max_local) continue;
+    for (size_t sub_group : sub_group_sizes) {
+      if (sub_group > local) continue;
+      for (size_t items : space.items_per_work_item) {
+        LaunchConfig config;
+        config.local_size = local;
+        config.sub_group_size = sub_group;
+        config.items_per_work_item = items;
+        try {
+          run(config);  // warm-up, and JIT compilation of the variant
+          std::vector<double> samples;
+          for (int r = 0; r < repetitions_; ++r) {
+            samples.push_back(run(config));
+          }
+          config.ms = median(samples);
+        } catch (std::invalid_argument const&) {
+          continue;
+        } catch (sycl::exception const& e) {
+          if (log_) {
+            *log_ << "  " << to_string(config) << ": " << e.what() << "\n";
+          }
+          continue;
+        }
+        ++last_candidates_;
+        if (log_) {
+          *log_ << "  " << to_string(config) << ": " << config.ms << " ms\n";
+        }
+        if (best.ms < 0.0 || config.ms < best.ms) best = config;
+      }
+    }
+  }
+
+  if (best.ms < 0.0) {
+    throw std::runtime_error("No launch configuration of " + kernel +
+                             " ran for " + problem);
+  }
+  db_.store(key, best);
+  return best;
+}
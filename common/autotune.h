@@ -0,0 +1,109 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <sycl/sycl.hpp>
+#include <functional>
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Launch shape of an nd_range kernel. local_size 0 means "no nd_range":
+// the kernel keeps its plain range and the runtime picks the shape.
+struct LaunchConfig {
+  size_t local_size = 0;           // work-items per work-group
+  size_t sub_group_size = 0;       // 0: left to the compiler
+  size_t items_per_work_item = 1;  // elements each work-item processes
+  double ms = 0.0;                 // median time measured when tuned
+};
+
+std::string to_string(const LaunchConfig& config);
+
+// Candidates swept by the Autotuner. Empty local or sub-group size lists
+// are filled in from the device: powers of two up to
+// max_work_group_size, and the device's sub_group_sizes that kernels are
+// compiled for (see with_sub_group_size).
+struct TuneSpace {
+  std::vector<size_t> local_sizes;
+  std::vector<size_t> sub_group_sizes;
+  std::vector<size_t> items_per_work_item = {1, 2, 4, 8};
+};
+
+// A required sub-group size has to be a compile-time constant, so kernels
+// are instantiated once per supported size: f is called with
+// std::integral_constant<size_t, S>, S being 8, 16 or 32, or 0 for the
+// compiler's choice.
+template <typename F>
+decltype(auto) with_sub_group_size(size_t sub_group_size, F&& f) {
+  switch (sub_group_size) {
+    case 0:
+      return f(std::integral_constant<size_t, 0>{});
+    case 8:
+      return f(std::integral_constant<size_t, 8>{});
+    case 16:
+      return f(std::integral_constant<size_t, 16>{});
+    case 32:
+      return f(std::integral_constant<size_t, 32>{});
+  }
+  throw std::invalid_argument("Unsupported sub-group size " +
+                              std::to_string(sub_group_size));
+}
+
+// Best launch shapes found so far, in a small text file keyed by kernel,
+// device, driver version and problem size, so a driver update starts the
+// tuning over while everything else is reused.
+class TuningDb {
+ public:
+  // $SYCL_SAMPLES_TUNING_DB if set, otherwise
+  // $HOME/.cache/sycl-samples-tuning.txt.
+  static std::string default_path();
+
+  static std::string key(const std::string& kernel, const sycl::device& dev,
+                         const std::string& problem);
+
+  explicit TuningDb(std::string path = default_path());
+
+  bool lookup(const std::string& key, LaunchConfig* config) const;
+  // Re-reads the file and rewrites it with this entry replaced, under an
+  // flock on path() + ".lock", so concurrent processes tuning other kernels
+  // do not lose their entries.
+  void store(const std::string& key, const LaunchConfig& config) const;
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+// Sweeps a TuneSpace for one kernel on one queue, or returns the stored
+// result without running anything. run(config) launches the kernel once
+// with that shape, waits, and returns its time in ms; it throws
+// std::invalid_argument for shapes that do not fit the problem, and a
+// sycl::exception from an unsupported shape also just skips it.
+class Autotuner {
+ public:
+  explicit Autotuner(sycl::queue q, TuningDb db = TuningDb());
+
+  LaunchConfig tune(const std::string& kernel, const std::string& problem,
+                    const std::function<double(const LaunchConfig&)>& run,
+                    const TuneSpace& space = {});
+
+  void set_repetitions(int reps) { repetitions_ = reps; }
+  void set_retune(bool retune) { retune_ = retune; }  // ignore stored results
+  void set_log(std::ostream* log) { log_ = log; }     // one line per candidate
+
+  bool last_from_db() const { return last_from_db_; }
+  size_t last_candidates() const { return last_candidates_; }
+
+ private:
+  sycl::queue queue_;
+  TuningDb db_;
+  int repetitions_ = 3;
+  bool retune_ = false;
+  std::ostream* log_ = nullptr;
+  bool last_from_db_ = false;
+  size_t last_candidates_ = 0;
+};
+
+#endif  // AUTOTUNE_H
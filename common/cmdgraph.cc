@@ -0,0 +1,111 @@
+#include "cmdgraph.h"
+
+#include <optional>
+#include <stdexcept>
+
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+namespace sycl_exp = sycl::ext::oneapi::experimental;
+
+struct CommandGraph::Native {
+  explicit Native(const sycl::queue& q)
+      : graph(q.get_context(), q.get_device(),
+              {sycl_exp::property::graph::assume_buffer_outlives_graph{}}) {}
+
+  sycl_exp::command_graph<sycl_exp::graph_state::modifiable> graph;
+  std::optional<sycl_exp::command_graph<sycl_exp::graph_state::executable>>
+      exec;
+};
+#else
+struct CommandGraph::Native {
+  explicit Native(const sycl::queue&) {}
+};
+#endif
+
+const char* to_string(Submission submission) {
+  switch (submission) {
+    case Submission::kEager:
+      return "eager";
+    case Submission::kGraph:
+      return "graph";
+    case Submission::kEmulated:
+      return "emulated";
+  }
+  return "unknown";
+}
+
+Submission parse_submission(const std::string& name) {
+  if (name == "eager") return Submission::kEager;
+  if (name == "graph") return Submission::kGraph;
+  if (name == "emulated") return Submission::kEmulated;
+  throw std::invalid_argument("Unknown submission mode: " + name);
+}
+
+bool native_graphs_supported(const sycl::device& device) {
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+  return device.has(sycl::aspect::ext_oneapi_limited_graph) ||
+         device.has(sycl::aspect::ext_oneapi_graph);
+#else
+  (void)device;
+  return false;
+#endif
+}
+
+CommandGraph::CommandGraph(sycl::queue q, bool emulate) : queue_(q) {
+  if (!emulate && native_graphs_supported(q.get_device())) {
+    native_ = std::make_unique<Native>(q);
+  }
+}
+
+CommandGraph::~CommandGraph() = default;
+
+void CommandGraph::add(CommandGroup cg) {
+  if (finalized_) {
+    throw std::logic_error("CommandGraph::add after finalize");
+  }
+  commands_.push_back(std::move(cg));
+}
+
+void CommandGraph::finalize() {
+  if (finalized_) return;
+  finalized_ = true;
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+  if (native_) {
+    std::optional<sycl_exp::node> prev;
+    for (const auto& cg : commands_) {
+      if (prev) {
+        prev = native_->graph.add(
+            cg, {sycl_exp::property::node::depends_on(*prev)});
+      } else {
+        prev = native_->graph.add(cg);
+      }
+    }
+    native_->exec = native_->graph.finalize();
+  }
+#endif
+}
+
+sycl::event CommandGraph::replay(const std::vector<sycl::event>& deps) {
+  finalize();
+#ifdef SYCL_EXT_ONEAPI_GRAPH
+  if (native_) {
+    return queue_.submit([&](sycl::handler& h) {
+      h.depends_on(deps);
+      h.ext_oneapi_graph(*native_->exec);
+    });
+  }
+#endif
+  // Emulated: the same command groups, resubmitted in order. This saves
+  // rebuilding them but none of the runtime's per-submission work.
+  sycl::event last;
+  for (size_t i = 0; i < commands_.size(); ++i) {
+    last = queue_.submit([&](sycl::handler& h) {
+      if (i == 0) {
+        h.depends_on(deps);
+      } else {
+        h.depends_on(last);
+      }
+      commands_[i](h);
+    });
+  }
+  return last;
+}
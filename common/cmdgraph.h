@@ -0,0 +1,63 @@
+#ifndef CMDGRAPH_H
+#define CMDGRAPH_H
+
+#include <sycl/sycl.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How a fixed loop body reaches the device.
+//   eager:     every iteration submits its commands again (the default)
+//   graph:     the body is recorded once into a CommandGraph and replayed;
+//              a native sycl_ext_oneapi_graph where the build and the device
+//              support it, an emulated replay list otherwise
+//   emulated:  always the replay list, to separate what the graph saves
+//              from what merely reusing the command groups saves
+enum class Submission { kEager, kGraph, kEmulated };
+
+const char* to_string(Submission submission);
+Submission parse_submission(const std::string& name);
+
+// True when this build has sycl_ext_oneapi_graph and device can run graphs.
+bool native_graphs_supported(const sycl::device& device);
+
+// A fixed sequence of command groups for one queue, recorded once and
+// replayed many times. Each command runs after the one added before it,
+// and the first after the events passed to replay(). Buffers used by the
+// commands must outlive the CommandGraph.
+class CommandGraph {
+ public:
+  using CommandGroup = std::function<void(sycl::handler&)>;
+
+  // Native unless emulate is set or native graphs are not supported.
+  explicit CommandGraph(sycl::queue q, bool emulate = false);
+  ~CommandGraph();
+
+  CommandGraph(const CommandGraph&) = delete;
+  CommandGraph& operator=(const CommandGraph&) = delete;
+
+  // Only before finalize().
+  void add(CommandGroup cg);
+
+  // Builds the executable graph; called by the first replay() otherwise.
+  void finalize();
+
+  // Submits the whole sequence once; the event completes with its last
+  // command.
+  sycl::event replay(const std::vector<sycl::event>& deps = {});
+
+  bool native() const { return native_ != nullptr; }
+  const char* mode_name() const { return native() ? "graph" : "emulated"; }
+  size_t size() const { return commands_.size(); }
+
+ private:
+  struct Native;
+
+  sycl::queue queue_;
+  std::vector<CommandGroup> commands_;
+  std::unique_ptr<Native> native_;
+  bool finalized_ = false;
+};
+
+#endif  // CMDGRAPH_H
@@ -0,0 +1,86 @@
+#include "device_manager.h"
+
+#include <map>
+#include <stdexcept>
+
+const char* to_string(ContextScope scope) {
+  switch (scope) {
+    case ContextScope::kPerQueue:
+      return "per-queue";
+    case ContextScope::kPerRootDevice:
+      return "per-root";
+    case ContextScope::kPerPlatform:
+      return "per-platform";
+  }
+  return "unknown";
+}
+
+ContextScope parse_context_scope(const std::string& name) {
+  if (name == "per-queue" || name == "queue") return ContextScope::kPerQueue;
+  if (name == "per-root" || name == "root") return ContextScope::kPerRootDevice;
+  if (name == "per-platform" || name == "platform")
+    return ContextScope::kPerPlatform;
+  throw std::invalid_argument("Unknown context scope: " + name);
+}
+
+DeviceManager::DeviceManager(const DeviceManagerOptions& options)
+    : options_(options), topology_(Topology::load()) {
+  TopologyFilter filter;
+  if (options_.level_zero_only) filter.backend = "level_zero";
+  if (options_.type != sycl::info::device_type::all) {
+    filter.type = device_type_name(options_.type);
+  }
+  filter.tiles = options_.partition;
+  filter.indices = options_.indices;
+  filter = topology_filter_from_env(filter);
+
+  infos_ = topology_.select(filter);
+  devices_ = topology_.resolve(infos_);
+
+  if (options_.scope == ContextScope::kPerQueue) return;
+
+  // Group the selected devices by root device or by platform, and give
+  // each group one context.
+  std::map<int, std::vector<size_t>> groups;
+  for (size_t i = 0; i < infos_.size(); ++i) {
+    int root = infos_[i].root;
+    int key = options_.scope == ContextScope::kPerRootDevice
+                  ? root
+                  : topology_.roots()[root].platform;
+    groups[key].push_back(i);
+  }
+
+  context_index_.resize(devices_.size());
+  for (const auto& group : groups) {
+    std::vector<sycl::device> members;
+    for (size_t i : group.second) {
+      members.push_back(devices_[i]);
+      context_index_[i] = contexts_.size();
+    }
+    contexts_.emplace_back(members);
+  }
+}
+
+sycl::context DeviceManager::context_for(size_t index) const {
+  if (options_.scope == ContextScope::kPerQueue) {
+    return sycl::context(devices_.at(index));
+  }
+  return contexts_[context_index_.at(index)];
+}
+
+sycl::queue DeviceManager::make_queue(size_t index,
+                                      const sycl::property_list& props) const {
+  if (options_.scope == ContextScope::kPerQueue) {
+    return sycl::queue(devices_.at(index), props);
+  }
+  return sycl::queue(context_for(index), devices_.at(index), props);
+}
+
+sycl::queue DeviceManager::make_queue(size_t index,
+                                      const sycl::async_handler& handler,
+                                      const sycl::property_list& props) const {
+  if (options_.scope == ContextScope::kPerQueue) {
+    return sycl::queue(devices_.at(index), handler, props);
+  }
+  return sycl::queue(context_for(index), devices_.at(index), handler, props);
+}
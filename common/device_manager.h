@@ -0,0 +1,66 @@
+#ifndef DEVICE_MANAGER_H
+#define DEVICE_MANAGER_H
+
+#include <sycl/sycl.hpp>
+#include <string>
+#include <vector>
+
+#include "topology.h"
+
+// How the queues handed out by DeviceManager share SYCL contexts.
+//   per-queue:  every queue is built from a device alone and gets its own
+//               implicit context (the historical createQueue behaviour).
+//   per-root:   one context per root device, covering all of its tiles.
+//   per-platform: one context per platform, covering every device in it.
+// USM allocations and events are only usable across queues that share a
+// context, so per-root is the minimum for cross-tile USM sharing.
+enum class ContextScope { kPerQueue, kPerRootDevice, kPerPlatform };
+
+const char* to_string(ContextScope scope);
+ContextScope parse_context_scope(const std::string& name);
+
+struct DeviceManagerOptions {
+  ContextScope scope = ContextScope::kPerPlatform;
+  sycl::info::device_type type = sycl::info::device_type::gpu;
+  bool partition = true;         // split root devices into tiles
+  bool level_zero_only = false;  // skip platforms of other backends
+  std::vector<int> indices;      // subset of the matching devices, in order
+};
+
+// Picks devices from the (cached) Topology and creates the contexts they
+// share, so that queues can be created cheaply and interoperate through USM
+// and events.
+class DeviceManager {
+ public:
+  explicit DeviceManager(const DeviceManagerOptions& options = {});
+
+  // Leaf devices: tiles of partitionable root devices, otherwise the roots.
+  // Empty when no device matches; callers decide whether that is fatal.
+  const std::vector<sycl::device>& devices() const { return devices_; }
+  size_t size() const { return devices_.size(); }
+  ContextScope scope() const { return options_.scope; }
+
+  // Context shared by the queues of devices()[index]; for per-queue scope
+  // this is a fresh context that nothing else uses.
+  sycl::context context_for(size_t index) const;
+
+  sycl::queue make_queue(size_t index,
+                         const sycl::property_list& props = {}) const;
+  sycl::queue make_queue(size_t index, const sycl::async_handler& handler,
+                         const sycl::property_list& props = {}) const;
+
+  // Ordinal of the root device that devices()[index] was partitioned from.
+  size_t root_of(size_t index) const { return infos_[index].root; }
+  const DeviceInfo& info(size_t index) const { return infos_.at(index); }
+  const Topology& topology() const { return topology_; }
+
+ private:
+  DeviceManagerOptions options_;
+  Topology topology_;
+  std::vector<DeviceInfo> infos_;
+  std::vector<sycl::device> devices_;
+  std::vector<size_t> context_index_;  // per leaf device, into contexts_
+  std::vector<sycl::context> contexts_;
+};
+
+#endif  // DEVICE_MANAGER_H
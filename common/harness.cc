@@ -0,0 +1,373 @@
+#include "harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) parts.push_back(part);
+  return parts;
+}
+
+// Two-sided 95% quantile of Student's t distribution with df degrees of
+// freedom; past the table the usual 1/df expansion around 1.96 is within
+// 0.001.
+double t_quantile_95(size_t df) {
+  static const double kTable[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  if (df == 0) return 0.0;
+  if (df <= 30) return kTable[df - 1];
+  return 1.96 + 2.372 / static_cast<double>(df);
+}
+
+// Linear interpolation between closest ranks; sorted must not be empty.
+double percentile(const std::vector<double>& sorted, double p) {
+  double pos = p * static_cast<double>(sorted.size() - 1);
+  size_t lo = static_cast<size_t>(pos);
+  size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+std::string json_escape(const std::string& s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+// CSV fields are quoted only when they need it.
+std::string csv_field(const std::string& s) {
+  if (s.find_first_of(",\"\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + "\"";
+}
+
+double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
+
+}  // namespace
+
+void harness_exception_handler(sycl::exception_list e_list) {
+  for (std::exception_ptr const& e : e_list) {
+    try {
+      std::rethrow_exception(e);
+    } catch (std::exception const& e) {
+      std::cerr << "Asynchronous SYCL exception: " << e.what() << std::endl;
+      std::terminate();
+    }
+  }
+}
+
+HarnessOptions parse_harness_options(const std::string& spec,
+                                     HarnessOptions base) {
+  HarnessOptions options = base;
+  for (const auto& item : split(spec, ',')) {
+    if (item.empty()) continue;
+    auto eq = item.find('=');
+    if (eq == std::string::npos) {
+      throw std::invalid_argument("Bad benchmark option: " + item);
+    }
+    std::string key = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+    if (key == "warmup") {
+      options.warmup = std::stoi(value);
+    } else if (key == "reps" || key == "repetitions") {
+      options.repetitions = std::stoi(value);
+    } else if (key == "outlier") {
+      options.outlier = std::stod(value);
+    } else if (key == "format") {
+      options.format = value;
+    } else if (key == "report") {
+      options.report = value;
+    } else {
+      throw std::invalid_argument("Unknown benchmark option: " + key);
+    }
+  }
+  if (options.format != "text" && options.format != "csv" &&
+      options.format != "json") {
+    throw std::invalid_argument("Unknown result format: " + options.format);
+  }
+  if (options.repetitions < 1 || options.warmup < 0) {
+    throw std::invalid_argument("Need at least one repetition");
+  }
+  return options;
+}
+
+HarnessOptions harness_options_from_env(const HarnessOptions& defaults) {
+  const char* spec = std::getenv("SYCL_SAMPLES_BENCH");
+  if (spec == nullptr) return defaults;
+  return parse_harness_options(spec, defaults);
+}
+
+Stats summarize(const std::vector<double>& samples, double outlier) {
+  Stats stats;
+  if (samples.empty()) return stats;
+
+  std::vector<double> sorted = samples;
+  std::sort(sorted.begin(), sorted.end());
+
+  if (outlier > 0.0 && sorted.size() > 2) {
+    double median = percentile(sorted, 0.5);
+    std::vector<double> deviations;
+    for (double s : sorted) deviations.push_back(std::fabs(s - median));
+    std::sort(deviations.begin(), deviations.end());
+    // 1.4826 * MAD estimates the standard deviation of normal data.
+    double scale = 1.4826 * percentile(deviations, 0.5);
+    if (scale > 0.0) {
+      std::vector<double> kept;
+      for (double s : sorted) {
+        if (std::fabs(s - median) <= outlier * scale) kept.push_back(s);
+      }
+      stats.rejected = sorted.size() - kept.size();
+      sorted = std::move(kept);
+    }
+  }
+
+  size_t n = sorted.size();
+  stats.samples = n;
+  stats.min = sorted.front();
+  stats.max = sorted.back();
+  stats.median = percentile(sorted, 0.5);
+  stats.p95 = percentile(sorted, 0.95);
+
+  double sum = 0.0;
+  for (double s : sorted) sum += s;
+  stats.mean = sum / n;
+  if (n > 1) {
+    double sq = 0.0;
+    for (double s : sorted) sq += (s - stats.mean) * (s - stats.mean);
+    stats.stddev = std::sqrt(sq / (n - 1));
+    stats.ci95 = t_quantile_95(n - 1) * stats.stddev / std::sqrt(double(n));
+  }
+  return stats;
+}
+
+Args::Args(int argc, char* argv[], const HarnessOptions& defaults)
+    : harness_(harness_options_from_env(defaults)) {
+  for (int i = 1; i < argc; ++i) tokens_.push_back(argv[i]);
+  used_.assign(tokens_.size(), false);
+
+  std::string spec, value;
+  if (take("warmup", &value)) spec += ",warmup=" + value;
+  if (take("reps", &value)) spec += ",reps=" + value;
+  if (take("outlier", &value)) spec += ",outlier=" + value;
+  if (take("format", &value)) spec += ",format=" + value;
+  // Not --output: samples use that for the data files they write
+  if (take("report", &value)) spec += ",report=" + value;
+  harness_ = parse_harness_options(spec, harness_);
+}
+
+bool Args::take(const std::string& name, std::string* value) {
+  std::string option = "--" + name;
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    if (used_[i]) continue;
+    const std::string& token = tokens_[i];
+    if (value == nullptr) {
+      if (token != option) continue;
+      used_[i] = true;
+      return true;
+    }
+    if (token.compare(0, option.size() + 1, option + "=") == 0) {
+      used_[i] = true;
+      *value = token.substr(option.size() + 1);
+      return true;
+    }
+    if (token == option) {
+      if (i + 1 >= tokens_.size()) {
+        throw std::invalid_argument("Missing value for " + option);
+      }
+      used_[i] = used_[i + 1] = true;
+      *value = tokens_[i + 1];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Args::flag(const std::string& name) { return take(name, nullptr); }
+
+std::string Args::get(const std::string& name, const std::string& fallback) {
+  std::string value;
+  return take(name, &value) ? value : fallback;
+}
+
+long long Args::get_int(const std::string& name, long long fallback) {
+  std::string value;
+  return take(name, &value) ? std::stoll(value) : fallback;
+}
+
+double Args::get_double(const std::string& name, double fallback) {
+  std::string value;
+  return take(name, &value) ? std::stod(value) : fallback;
+}
+
+std::vector<std::string> Args::positional() const {
+  std::vector<std::string> args;
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    if (!used_[i] && tokens_[i].compare(0, 2, "--") != 0) {
+      args.push_back(tokens_[i]);
+    }
+  }
+  return args;
+}
+
+long long Args::positional_int(size_t index, long long fallback) const {
+  auto args = positional();
+  return index < args.size() ? std::stoll(args[index]) : fallback;
+}
+
+void Args::finish() const {
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    if (!used_[i] && tokens_[i].compare(0, 2, "--") == 0) {
+      throw std::invalid_argument("Unknown option: " + tokens_[i]);
+    }
+  }
+}
+
+Harness::Harness(std::string program, HarnessOptions options)
+    : program_(std::move(program)), options_(std::move(options)) {}
+
+void Harness::set_param(const std::string& key, const std::string& value) {
+  for (auto& param : params_) {
+    if (param.first == key) {
+      param.second = value;
+      return;
+    }
+  }
+  params_.emplace_back(key, value);
+}
+
+void Harness::annotate(const std::string& key, const std::string& value) {
+  if (results_.empty()) {
+    throw std::logic_error("Harness::annotate before any result");
+  }
+  results_.back().params.emplace_back(key, value);
+}
+
+Stats Harness::run(const std::string& name, const std::function<void()>& fn) {
+  return run_measured(name, [&]() {
+    auto start = std::chrono::high_resolution_clock::now();
+    fn();
+    return elapsed_ms(start);
+  });
+}
+
+Stats Harness::run_measured(const std::string& name,
+                            const std::function<double()>& fn) {
+  for (int i = 0; i < options_.warmup; ++i) fn();
+
+  std::vector<double> samples;
+  for (int i = 0; i < options_.repetitions; ++i) samples.push_back(fn());
+  return record(name, samples);
+}
+
+Stats Harness::record(const std::string& name,
+                      const std::vector<double>& samples) {
+  Result result;
+  result.name = name;
+  result.params = params_;
+  result.stats = summarize(samples, options_.outlier);
+  results_.push_back(result);
+  return result.stats;
+}
+
+void Harness::report() const {
+  std::ofstream file;
+  if (!options_.report.empty()) {
+    file.open(options_.report);
+    if (!file) {
+      throw std::runtime_error("Cannot write results to " + options_.report);
+    }
+  }
+  std::ostream& os = options_.report.empty() ? std::cout : file;
+
+  if (options_.format == "csv") {
+    write_csv(os);
+  } else if (options_.format == "json") {
+    write_json(os);
+  } else {
+    write_text(os);
+  }
+}
+
+void Harness::write_text(std::ostream& os) const {
+  for (const auto& r : results_) {
+    const Stats& s = r.stats;
+    os << program_ << "/" << r.name;
+    for (const auto& param : r.params) {
+      os << " " << param.first << "=" << param.second;
+    }
+    os << ": " << s.mean << " ms +/- " << s.ci95 << " (95% CI), median "
+       << s.median << ", p95 " << s.p95 << ", min " << s.min << ", max "
+       << s.max << ", stddev " << s.stddev << "; " << s.samples
+       << " samples";
+    if (s.rejected > 0) os << ", " << s.rejected << " outliers dropped";
+    os << "\n";
+  }
+}
+
+void Harness::write_csv(std::ostream& os) const {
+  os << "program,benchmark,params,samples,rejected,mean_ms,stddev_ms,"
+        "median_ms,p95_ms,min_ms,max_ms,ci95_ms\n";
+  os << std::setprecision(9);
+  for (const auto& r : results_) {
+    const Stats& s = r.stats;
+    std::string params;
+    for (const auto& param : r.params) {
+      if (!params.empty()) params += ";";
+      params += param.first + "=" + param.second;
+    }
+    os << csv_field(program_) << "," << csv_field(r.name) << ","
+       << csv_field(params) << "," << s.samples << "," << s.rejected << ","
+       << s.mean << "," << s.stddev << "," << s.median << "," << s.p95 << ","
+       << s.min << "," << s.max << "," << s.ci95 << "\n";
+  }
+}
+
+void Harness::write_json(std::ostream& os) const {
+  os << std::setprecision(9);
+  os << "{\"program\": \"" << json_escape(program_) << "\", \"results\": [";
+  for (size_t i = 0; i < results_.size(); ++i) {
+    const Result& r = results_[i];
+    const Stats& s = r.stats;
+    os << (i == 0 ? "\n" : ",\n") << "  {\"benchmark\": \""
+       << json_escape(r.name) << "\", \"params\": {";
+    for (size_t p = 0; p < r.params.size(); ++p) {
+      os << (p == 0 ? "" : ", ") << "\"" << json_escape(r.params[p].first)
+         << "\": \"" << json_escape(r.params[p].second) << "\"";
+    }
+    os << "}, \"samples\": " << s.samples << ", \"rejected\": " << s.rejected
+       << ", \"mean_ms\": " << s.mean << ", \"stddev_ms\": " << s.stddev
+       << ", \"median_ms\": " << s.median << ", \"p95_ms\": " << s.p95
+       << ", \"min_ms\": " << s.min << ", \"max_ms\": " << s.max
+       << ", \"ci95_ms\": " << s.ci95 << "}";
+  }
+  os << "\n]}\n";
+}
@@ -0,0 +1,143 @@
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include <sycl/sycl.hpp>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Asynchronous SYCL error handler shared by the samples: prints the error
+// and terminates.
+void harness_exception_handler(sycl::exception_list e_list);
+
+// How a benchmark is repeated and where its results go.
+struct HarnessOptions {
+  int warmup = 1;        // untimed runs before the first sample
+  int repetitions = 5;   // timed runs
+  double outlier = 3.5;  // drop samples further than this many scaled MADs
+                         // from the median; <= 0 keeps every sample
+  std::string format = "text";  // "text", "csv" or "json"
+  std::string report;           // results file; empty for stdout
+};
+
+// Parse "warmup=2,reps=10,outlier=3,format=csv,report=run.csv" (any
+// subset) on top of base.
+HarnessOptions parse_harness_options(const std::string& spec,
+                                     HarnessOptions base = {});
+
+// Programs pass their defaults; $SYCL_SAMPLES_BENCH overrides them.
+HarnessOptions harness_options_from_env(const HarnessOptions& defaults);
+
+// Summary of one benchmark's samples, all in milliseconds.
+struct Stats {
+  size_t samples = 0;   // kept after outlier rejection
+  size_t rejected = 0;  // dropped as outliers
+  double mean = 0.0;
+  double stddev = 0.0;  // sample standard deviation
+  double median = 0.0;
+  double p95 = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double ci95 = 0.0;  // half-width of the 95% confidence interval of the mean
+};
+
+// Outliers are judged by the median absolute deviation, which a single
+// slow run (page faults, JIT, a context switch) cannot drag along the way
+// it drags the standard deviation.
+Stats summarize(const std::vector<double>& samples, double outlier = 3.5);
+
+// Command-line arguments shared by the samples: "--name value",
+// "--name=value", bare "--flag"s and positional arguments. The harness
+// options --warmup, --reps, --outlier, --format and --report are taken
+// out first, on top of the defaults and $SYCL_SAMPLES_BENCH. Lookups
+// consume what they match, so positional() must come after the named
+// lookups; finish() rejects anything left that starts with "--".
+class Args {
+ public:
+  Args(int argc, char* argv[], const HarnessOptions& defaults = {});
+
+  bool flag(const std::string& name);
+  std::string get(const std::string& name, const std::string& fallback);
+  long long get_int(const std::string& name, long long fallback);
+  double get_double(const std::string& name, double fallback);
+
+  std::vector<std::string> positional() const;
+  long long positional_int(size_t index, long long fallback) const;
+
+  const HarnessOptions& harness() const { return harness_; }
+
+  // Throws std::invalid_argument naming the first unknown option.
+  void finish() const;
+
+ private:
+  bool take(const std::string& name, std::string* value);
+
+  std::vector<std::string> tokens_;
+  std::vector<bool> used_;
+  HarnessOptions harness_;
+};
+
+// Runs, times and reports the benchmarks of one program. Every result
+// carries the program name and the parameters set so far, so runs of
+// different programs land in one comparable table.
+class Harness {
+ public:
+  Harness(std::string program, HarnessOptions options);
+
+  // Recorded with every following result, e.g. the problem size.
+  void set_param(const std::string& key, const std::string& value);
+  template <typename T>
+  void set_param(const std::string& key, const T& value) {
+    std::ostringstream os;
+    os << value;
+    set_param(key, os.str());
+  }
+  // Starts over, for a program that runs unrelated groups of benchmarks.
+  void clear_params() { params_.clear(); }
+
+  // Added to the parameters of the most recent result only, for figures
+  // derived from its timing such as throughput.
+  void annotate(const std::string& key, const std::string& value);
+  template <typename T>
+  void annotate(const std::string& key, const T& value) {
+    std::ostringstream os;
+    os << value;
+    annotate(key, os.str());
+  }
+
+  // Host wall-clock time of fn, over the warm-up and timed repetitions.
+  Stats run(const std::string& name, const std::function<void()>& fn);
+
+  // fn times itself and returns its sample in ms, e.g. device time from
+  // event profiling.
+  Stats run_measured(const std::string& name,
+                     const std::function<double()>& fn);
+
+  // Samples measured elsewhere, in ms; no warm-up is applied.
+  Stats record(const std::string& name, const std::vector<double>& samples);
+
+  const HarnessOptions& options() const { return options_; }
+
+  // Writes every result so far in the configured format.
+  void report() const;
+
+ private:
+  struct Result {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> params;
+    Stats stats;
+  };
+
+  void write_text(std::ostream& os) const;
+  void write_csv(std::ostream& os) const;
+  void write_json(std::ostream& os) const;
+
+  std::string program_;
+  HarnessOptions options_;
+  std::vector<std::pair<std::string, std::string>> params_;
+  std::vector<Result> results_;
+};
+
+#endif  // HARNESS_H
@@ -0,0 +1,292 @@
+#include "matio.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+size_t round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> out;
+  size_t start = 0;
+  while (true) {
+    size_t end = s.find(sep, start);
+    out.push_back(s.substr(start, end - start));
+    if (end == std::string::npos) break;
+    start = end + 1;
+  }
+  return out;
+}
+
+// Sets end to the byte past a payload at offset of rows x cols elements,
+// row_stride (at least cols) apart; false when that does not fit in a
+// size_t, checked before anything is multiplied.
+bool payload_end(size_t offset, size_t rows, size_t cols, size_t row_stride,
+                 size_t element, size_t& end) {
+  end = offset;
+  if (rows == 0 || cols == 0) return true;
+  size_t max_elements = (SIZE_MAX - offset) / element;
+  if (cols > max_elements || rows - 1 > (max_elements - cols) / row_stride) {
+    return false;
+  }
+  end += ((rows - 1) * row_stride + cols) * element;
+  return true;
+}
+
+std::runtime_error file_error(const std::string& path,
+                              const std::string& what) {
+  return std::runtime_error(path + ": " + what);
+}
+
+}  // namespace
+
+const char* to_string(DType dtype) {
+  switch (dtype) {
+    case DType::kFloat32:
+      return "float32";
+    case DType::kFloat64:
+      return "float64";
+    case DType::kInt32:
+      return "int32";
+  }
+  return "unknown";
+}
+
+size_t dtype_size(DType dtype) {
+  switch (dtype) {
+    case DType::kFloat32:
+      return 4;
+    case DType::kFloat64:
+      return 8;
+    case DType::kInt32:
+      return 4;
+  }
+  return 0;
+}
+
+MatrixFile::MatrixFile(std::string path, void* mapping, size_t mapping_bytes,
+                       bool writable)
+    : path_(std::move(path)),
+      mapping_(mapping),
+      mapping_bytes_(mapping_bytes),
+      writable_(writable),
+      header_(static_cast<MatrixHeader*>(mapping)) {}
+
+MatrixFile::MatrixFile(MatrixFile&& other) noexcept {
+  *this = std::move(other);
+}
+
+MatrixFile& MatrixFile::operator=(MatrixFile&& other) noexcept {
+  if (this != &other) {
+    release();
+    path_ = std::move(other.path_);
+    mapping_ = std::exchange(other.mapping_, nullptr);
+    mapping_bytes_ = std::exchange(other.mapping_bytes_, 0);
+    writable_ = other.writable_;
+    header_ = std::exchange(other.header_, nullptr);
+    registered_ = std::exchange(other.registered_, std::nullopt);
+  }
+  return *this;
+}
+
+MatrixFile::~MatrixFile() { release(); }
+
+void MatrixFile::release() {
+  if (!mapping_) return;
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+  if (registered_) {
+    sycl::ext::oneapi::experimental::release_from_device_copy(mapping_,
+                                                              *registered_);
+  }
+#endif
+  registered_.reset();
+  munmap(mapping_, mapping_bytes_);
+  mapping_ = nullptr;
+  header_ = nullptr;
+}
+
+MatrixFile MatrixFile::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw file_error(path, "cannot open");
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MatrixHeader)) {
+    close(fd);
+    throw file_error(path, "too short for a matrix header");
+  }
+  size_t size = st.st_size;
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) throw file_error(path, "cannot map");
+  // One pass from front to back: let the kernel read ahead
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  MatrixFile file(path, mapping, size, false);
+
+  const MatrixHeader& h = file.header();
+  if (std::memcmp(h.magic, kMatrixMagic, sizeof(kMatrixMagic)) != 0) {
+    throw file_error(path, "not a matrix file");
+  }
+  if (h.version != kMatrixVersion) {
+    throw file_error(path, "unsupported version " + std::to_string(h.version));
+  }
+  size_t element = dtype_size(h.dtype);
+  if (element == 0) throw file_error(path, "unknown dtype");
+  if (h.rank != 1 && h.rank != 2) throw file_error(path, "bad rank");
+  if (h.row_stride < h.cols || h.data_offset % kMatrixAlignment != 0 ||
+      h.data_offset < sizeof(MatrixHeader)) {
+    throw file_error(path, "bad layout");
+  }
+  size_t end;
+  if (!payload_end(h.data_offset, h.rows, h.cols, h.row_stride, element,
+                   end) ||
+      end > size) {
+    throw file_error(path, "truncated payload");
+  }
+  return file;
+}
+
+MatrixFile MatrixFile::create(const std::string& path, DType dtype,
+                              size_t rows, size_t cols, uint32_t rank) {
+  size_t offset = round_up(sizeof(MatrixHeader), kMatrixAlignment);
+  size_t element = dtype_size(dtype);
+  if (element == 0) throw file_error(path, "unknown dtype");
+  size_t size;
+  if (!payload_end(offset, rows, cols, cols, element, size)) {
+    throw file_error(path, std::to_string(rows) + " x " +
+                               std::to_string(cols) + " is too large");
+  }
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw file_error(path, "cannot create");
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    throw file_error(path, "cannot size");
+  }
+  void* mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) throw file_error(path, "cannot map");
+  MatrixFile file(path, mapping, size, true);
+
+  MatrixHeader& h = *file.header_;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, kMatrixMagic, sizeof(kMatrixMagic));
+  h.version = kMatrixVersion;
+  h.dtype = dtype;
+  h.rank = rank;
+  h.rows = rows;
+  h.cols = cols;
+  h.row_stride = cols;
+  h.data_offset = offset;
+  return file;
+}
+
+void MatrixFile::expect(DType dtype, size_t rows, size_t cols) const {
+  const MatrixHeader& h = header();
+  if (h.dtype != dtype) {
+    throw file_error(path_, std::string("holds ") + to_string(h.dtype) +
+                                ", expected " + to_string(dtype));
+  }
+  if ((rows && h.rows != rows) || (cols && h.cols != cols)) {
+    throw file_error(path_, "is " + std::to_string(h.rows) + "x" +
+                                std::to_string(h.cols) + ", expected " +
+                                std::to_string(rows) + "x" +
+                                std::to_string(cols));
+  }
+}
+
+const char* MatrixFile::payload() const {
+  return static_cast<const char*>(mapping_) + header_->data_offset;
+}
+
+bool MatrixFile::device_side(sycl::queue& q, const void* p) const {
+  return sycl::get_pointer_type(p, q.get_context()) ==
+         sycl::usm::alloc::device;
+}
+
+void MatrixFile::register_for_copies(sycl::queue& q) {
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+  // Pins the mapping so copies to and from the device run as DMA from
+  // it rather than through the runtime's staging buffers
+  if (registered_ && *registered_ == q.get_context()) return;
+  if (registered_) {
+    sycl::ext::oneapi::experimental::release_from_device_copy(mapping_,
+                                                              *registered_);
+  }
+  sycl::ext::oneapi::experimental::prepare_for_device_copy(
+      mapping_, mapping_bytes_, q.get_context());
+  registered_ = q.get_context();
+#else
+  (void)q;
+#endif
+}
+
+void MatrixFile::read_into(sycl::queue& q, void* dst) {
+  const MatrixHeader& h = header();
+  size_t element = dtype_size(h.dtype);
+  size_t row_bytes = h.cols * element;
+  size_t pitch = h.row_stride * element;
+  char* out = static_cast<char*>(dst);
+
+  if (device_side(q, dst)) {
+    register_for_copies(q);
+    if (pitch == row_bytes) {
+      q.memcpy(out, payload(), bytes()).wait();
+      return;
+    }
+#ifdef SYCL_EXT_ONEAPI_MEMCPY2D
+    q.ext_oneapi_memcpy2d(out, row_bytes, payload(), pitch, row_bytes, h.rows)
+        .wait();
+#else
+    std::vector<sycl::event> rows;
+    for (size_t r = 0; r < h.rows; ++r) {
+      rows.push_back(
+          q.memcpy(out + r * row_bytes, payload() + r * pitch, row_bytes));
+    }
+    for (auto& e : rows) e.wait();
+#endif
+    return;
+  }
+
+  if (pitch == row_bytes) {
+    std::memcpy(out, payload(), bytes());
+  } else {
+    for (size_t r = 0; r < h.rows; ++r) {
+      std::memcpy(out + r * row_bytes, payload() + r * pitch, row_bytes);
+    }
+  }
+}
+
+void MatrixFile::write_from(sycl::queue& q, const void* src) {
+  if (!writable_) throw file_error(path_, "opened read-only");
+  char* out = static_cast<char*>(mapping_) + header_->data_offset;
+  if (device_side(q, src)) {
+    register_for_copies(q);
+    q.memcpy(out, src, bytes()).wait();
+  } else {
+    std::memcpy(out, src, bytes());
+  }
+  if (msync(mapping_, mapping_bytes_, MS_SYNC) != 0) {
+    throw file_error(path_, "cannot flush");
+  }
+}
+
+std::vector<std::string> parse_matrix_paths(const std::string& spec,
+                                            size_t count) {
+  std::vector<std::string> paths = split(spec, ',');
+  bool empty = false;
+  for (const auto& path : paths) empty = empty || path.empty();
+  if (paths.size() != count || empty) {
+    throw std::invalid_argument("Expected " + std::to_string(count) +
+                                " comma-separated files: " + spec);
+  }
+  return paths;
+}
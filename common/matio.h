@@ -0,0 +1,143 @@
+#ifndef MATIO_H
+#define MATIO_H
+
+#include <sycl/sycl.hpp>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Binary files of dense matrices and vectors, read by mapping them.
+//
+// A file is a 64-byte MatrixHeader followed, at data_offset (a multiple
+// of 64), by rows x cols elements of dtype in row-major order with
+// row_stride elements from one row to the next. A vector is a matrix of
+// one row. Everything is little endian, i.e. native on the hosts the
+// samples run on.
+enum class DType : uint16_t { kFloat32 = 1, kFloat64 = 2, kInt32 = 3 };
+
+const char* to_string(DType dtype);
+size_t dtype_size(DType dtype);
+
+template <typename T>
+constexpr DType dtype_of();
+template <>
+constexpr DType dtype_of<float>() { return DType::kFloat32; }
+template <>
+constexpr DType dtype_of<double>() { return DType::kFloat64; }
+template <>
+constexpr DType dtype_of<int>() { return DType::kInt32; }
+
+constexpr char kMatrixMagic[8] = {'S', 'Y', 'C', 'L', 'M', 'A', 'T', '\0'};
+constexpr uint16_t kMatrixVersion = 1;
+constexpr size_t kMatrixAlignment = 64;
+
+struct MatrixHeader {
+  char magic[8];
+  uint16_t version;
+  DType dtype;
+  uint32_t rank;  // 1 for vectors, 2 for matrices
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t row_stride;   // in elements, at least cols
+  uint64_t data_offset;  // in bytes from the start of the file
+  uint64_t reserved[2];
+};
+static_assert(sizeof(MatrixHeader) == 64, "MatrixHeader is 64 bytes");
+
+// A matrix file mapped into memory. Reading one touches only the pages
+// that are copied out of it, straight from the page cache: there is no
+// parsing and no staging buffer.
+//
+// Opened read-only by open(); create() makes a new file of the given
+// shape, mapped writable, for results. Move-only; the mapping is
+// released with the object.
+class MatrixFile {
+ public:
+  static MatrixFile open(const std::string& path);
+  static MatrixFile create(const std::string& path, DType dtype, size_t rows,
+                           size_t cols, uint32_t rank = 2);
+
+  MatrixFile(MatrixFile&& other) noexcept;
+  MatrixFile& operator=(MatrixFile&& other) noexcept;
+  MatrixFile(const MatrixFile&) = delete;
+  MatrixFile& operator=(const MatrixFile&) = delete;
+  ~MatrixFile();
+
+  const std::string& path() const { return path_; }
+  const MatrixHeader& header() const { return *header_; }
+  size_t rows() const { return header_->rows; }
+  size_t cols() const { return header_->cols; }
+  size_t elements() const { return rows() * cols(); }
+  // Payload size of the packed rows x cols elements, without stride gaps
+  size_t bytes() const { return elements() * dtype_size(header_->dtype); }
+
+  // Throws std::runtime_error naming the file unless it holds T and, for
+  // non-zero arguments, has that many rows and columns.
+  template <typename T>
+  void expect(size_t rows = 0, size_t cols = 0) const {
+    expect(dtype_of<T>(), rows, cols);
+  }
+  void expect(DType dtype, size_t rows, size_t cols) const;
+
+  // Copies the elements, packed, into dst: an allocation of q's context,
+  // or plain host memory. Device memory is filled by a copy on q from the
+  // mapping, which is registered with the runtime for the DMA engines
+  // where sycl_ext_oneapi_copy_optimize is available; host and shared
+  // memory by the host directly. Waits for the copy.
+  void read_into(sycl::queue& q, void* dst);
+
+  // Copies rows x cols packed elements from src, as for read_into, into
+  // the payload of a file from create(), and flushes it to disk.
+  void write_from(sycl::queue& q, const void* src);
+
+ private:
+  MatrixFile(std::string path, void* mapping, size_t mapping_bytes,
+             bool writable);
+  void release();
+  const char* payload() const;
+  bool device_side(sycl::queue& q, const void* p) const;
+  void register_for_copies(sycl::queue& q);
+
+  std::string path_;
+  void* mapping_ = nullptr;
+  size_t mapping_bytes_ = 0;
+  bool writable_ = false;
+  MatrixHeader* header_ = nullptr;
+  // Context the mapping is registered with, when it is
+  std::optional<sycl::context> registered_;
+};
+
+// Shorthands for whole files of one allocation: check dtype and shape,
+// then copy in or out. rows and cols of zero accept any shape. The save
+// functions open the file again once it is written and check it the way
+// load_matrix would, so a result that cannot be read back is an error
+// here rather than in whatever reads it next.
+template <typename T>
+void load_matrix(const std::string& path, sycl::queue& q, T* dst,
+                 size_t rows = 0, size_t cols = 0) {
+  MatrixFile file = MatrixFile::open(path);
+  file.expect<T>(rows, cols);
+  file.read_into(q, dst);
+}
+
+template <typename T>
+void save_matrix(const std::string& path, sycl::queue& q, const T* src,
+                 size_t rows, size_t cols) {
+  MatrixFile::create(path, dtype_of<T>(), rows, cols).write_from(q, src);
+  MatrixFile::open(path).expect<T>(rows, cols);
+}
+
+template <typename T>
+void save_vector(const std::string& path, sycl::queue& q, const T* src,
+                 size_t size) {
+  MatrixFile::create(path, dtype_of<T>(), 1, size, 1).write_from(q, src);
+  MatrixFile::open(path).expect<T>(1, size);
+}
+
+// The files of an --input or --output option: count paths separated by
+// commas, e.g. "a.mat,b.mat". Throws std::invalid_argument otherwise.
+std::vector<std::string> parse_matrix_paths(const std::string& spec,
+                                            size_t count);
+
+#endif  // MATIO_H
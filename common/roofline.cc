@@ -0,0 +1,202 @@
+#include "roofline.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+#include "harness.h"
+
+template <typename T>
+class PeakFmaKernel;
+class PeakCopyKernel;
+
+namespace {
+
+constexpr int kChains = 8;    // independent FMA chains per work-item
+constexpr int kFmaIters = 1024;
+constexpr int kPeakReps = 3;  // best of
+
+double device_ms(const sycl::event& e) {
+  namespace event_profiling = sycl::info::event_profiling;
+  auto start = e.get_profiling_info<event_profiling::command_start>();
+  auto end = e.get_profiling_info<event_profiling::command_end>();
+  return (end - start) / 1e6;
+}
+
+// Enough work-groups to fill every compute unit several times over, each
+// work-item running kChains dependent FMA sequences side by side so the
+// pipeline never waits on a result.
+template <typename T>
+double fma_gflops(sycl::queue& q) {
+  sycl::device dev = q.get_device();
+  size_t local = std::min<size_t>(
+      256, dev.get_info<sycl::info::device::max_work_group_size>());
+  size_t items =
+      dev.get_info<sycl::info::device::max_compute_units>() * local * 8;
+  T* out = sycl::malloc_device<T>(items, q);
+  if (!out) return 0.0;
+
+  // From the host, so the compiler cannot fold the chains
+  T scale = T(0.999);
+  T offset = T(0.001);
+  double best = 0.0;
+  for (int r = 0; r < kPeakReps; ++r) {
+    sycl::event e = q.parallel_for<PeakFmaKernel<T>>(
+        sycl::nd_range<1>(items, local), [=](sycl::nd_item<1> item) {
+          size_t i = item.get_global_id(0);
+          T x[kChains];
+          for (int c = 0; c < kChains; ++c) x[c] = T(i % 7 + c);
+          for (int k = 0; k < kFmaIters; ++k) {
+            for (int c = 0; c < kChains; ++c) {
+              x[c] = sycl::fma(x[c], scale, offset);
+            }
+          }
+          T sum = 0;
+          for (int c = 0; c < kChains; ++c) sum += x[c];
+          out[i] = sum;
+        });
+    e.wait();
+    double flops = 2.0 * kChains * kFmaIters * items;
+    best = std::max(best, flops / device_ms(e) / 1e6);
+  }
+  sycl::free(out, q);
+  return best;
+}
+
+// A copy over arrays of up to 256 MB each, a good deal larger than the
+// last-level cache of current GPUs, and at most 1/8 of device memory.
+double copy_gbps(sycl::queue& q) {
+  sycl::device dev = q.get_device();
+  size_t n = std::min<size_t>(
+      size_t(1) << 26,
+      dev.get_info<sycl::info::device::global_mem_size>() / 8 / sizeof(float));
+  float* a = sycl::malloc_device<float>(n, q);
+  float* b = sycl::malloc_device<float>(n, q);
+  if (!a || !b) {
+    if (a) sycl::free(a, q);
+    if (b) sycl::free(b, q);
+    return 0.0;
+  }
+  q.fill(a, 1.0f, n).wait();
+
+  double best = 0.0;
+  for (int r = 0; r < kPeakReps; ++r) {
+    sycl::event e = q.parallel_for<PeakCopyKernel>(
+        sycl::range<1>(n), [=](sycl::id<1> i) { b[i] = a[i]; });
+    e.wait();
+    best = std::max(best, 2.0 * n * sizeof(float) / device_ms(e) / 1e6);
+  }
+  sycl::free(a, q);
+  sycl::free(b, q);
+  return best;
+}
+
+std::string fmt(double value) {
+  std::ostringstream os;
+  os << std::setprecision(3) << value;
+  return os.str();
+}
+
+}  // namespace
+
+KernelCost operator*(const KernelCost& cost, double n) {
+  KernelCost total;
+  total.flops = cost.flops * n;
+  total.bytes = cost.bytes * n;
+  return total;
+}
+
+const char* to_string(Precision precision) {
+  switch (precision) {
+    case Precision::kFloat:
+      return "fp32";
+    case Precision::kDouble:
+      return "fp64";
+    case Precision::kInt:
+      return "int32";
+  }
+  return "unknown";
+}
+
+double DevicePeaks::gflops(Precision precision) const {
+  return precision == Precision::kDouble ? fp64_gflops : fp32_gflops;
+}
+
+DevicePeaks operator+(const DevicePeaks& a, const DevicePeaks& b) {
+  DevicePeaks sum;
+  sum.fp32_gflops = a.fp32_gflops + b.fp32_gflops;
+  sum.fp64_gflops = a.fp64_gflops + b.fp64_gflops;
+  sum.gbps = a.gbps + b.gbps;
+  return sum;
+}
+
+DevicePeaks measure_peaks(const sycl::queue& q) {
+  // Held while measuring, so threads sharing a device wait for one
+  // measurement instead of disturbing each other's
+  static std::mutex mutex;
+  static std::vector<std::pair<sycl::device, DevicePeaks>> measured;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  sycl::device dev = q.get_device();
+  for (const auto& entry : measured) {
+    if (entry.first == dev) return entry.second;
+  }
+
+  sycl::queue pq(q.get_context(), dev, harness_exception_handler,
+                 sycl::property::queue::enable_profiling{});
+  DevicePeaks peaks;
+  peaks.fp32_gflops = fma_gflops<float>(pq);
+  if (dev.has(sycl::aspect::fp64)) peaks.fp64_gflops = fma_gflops<double>(pq);
+  peaks.gbps = copy_gbps(pq);
+  measured.emplace_back(dev, peaks);
+  return peaks;
+}
+
+void print_peaks(std::ostream& os, const std::string& label,
+                 const DevicePeaks& peaks) {
+  os << "Device peaks " << label << ": " << fmt(peaks.fp32_gflops)
+     << " GFLOP/s fp32, "
+     << (peaks.fp64_gflops > 0.0 ? fmt(peaks.fp64_gflops) : std::string("no"))
+     << " fp64, " << fmt(peaks.gbps) << " GB/s\n";
+}
+
+RooflinePoint roofline(const KernelCost& cost, double ms,
+                       const DevicePeaks& peaks, Precision precision) {
+  RooflinePoint point;
+  point.intensity = cost.intensity();
+  if (ms > 0.0) {
+    point.gflops = cost.flops / ms / 1e6;
+    point.gbps = cost.bytes / ms / 1e6;
+  }
+  double compute = peaks.gflops(precision);
+  double memory = point.intensity * peaks.gbps;
+  point.memory_bound = memory < compute;
+  point.attainable = std::min(compute, memory);
+  if (point.attainable > 0.0) {
+    point.percent = 100.0 * point.gflops / point.attainable;
+  }
+  return point;
+}
+
+std::string format_roofline(const RooflinePoint& point) {
+  return fmt(point.intensity) + " FLOP/byte, " + fmt(point.gflops) +
+         " GFLOP/s, " + fmt(point.gbps) + " GB/s; " + fmt(point.attainable) +
+         " GFLOP/s attainable (" +
+         (point.memory_bound ? "memory" : "compute") + "-bound), " +
+         fmt(point.percent) + "% of roofline";
+}
+
+void print_roofline(std::ostream& os, const std::string& kernel,
+                    const RooflinePoint& point) {
+  os << "Roofline " << kernel << ": " << format_roofline(point) << "\n";
+}
+
+void annotate_roofline(Harness& bench, const RooflinePoint& point) {
+  bench.annotate("flop_per_byte", fmt(point.intensity));
+  bench.annotate("gflops", fmt(point.gflops));
+  bench.annotate("gbps", fmt(point.gbps));
+  bench.annotate("roofline_pct", fmt(point.percent));
+}
@@ -0,0 +1,78 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+#include <sycl/sycl.hpp>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+class Harness;
+
+// Work done by one launch of a kernel, declared next to the kernel as a
+// function of the problem size. bytes is the compulsory global-memory
+// traffic: every input read once and every output written once, as if
+// caches were perfect, so the intensity is an upper bound.
+struct KernelCost {
+  double flops = 0.0;
+  double bytes = 0.0;
+
+  double intensity() const { return bytes > 0.0 ? flops / bytes : 0.0; }
+};
+
+// n launches of the same kernel.
+KernelCost operator*(const KernelCost& cost, double n);
+
+// Arithmetic the flops are counted in. Integer adds issue at the fp32 rate
+// on the vector ALUs, so kInt is measured against the fp32 peak.
+enum class Precision { kFloat, kDouble, kInt };
+
+const char* to_string(Precision precision);
+
+// Measured ceilings of one device, or of several devices working on
+// independent problems at once (the sum of theirs).
+struct DevicePeaks {
+  double fp32_gflops = 0.0;
+  double fp64_gflops = 0.0;  // 0 without fp64 support
+  double gbps = 0.0;
+
+  double gflops(Precision precision) const;
+};
+
+DevicePeaks operator+(const DevicePeaks& a, const DevicePeaks& b);
+
+// Peaks of q's device from two microbenchmarks: independent FMA chains
+// across every work-item the device can hold, and a copy kernel over
+// arrays too large for its caches. Both are timed by event profiling, best
+// of three. Measured once per device and process; later calls, from any
+// thread, return the first result.
+DevicePeaks measure_peaks(const sycl::queue& q);
+
+// Prints one line: "Device peaks <label>: ... GFLOP/s fp32, ... fp64,
+// ... GB/s".
+void print_peaks(std::ostream& os, const std::string& label,
+                 const DevicePeaks& peaks);
+
+// Where a run of a kernel sits under the roofline of peaks.
+struct RooflinePoint {
+  double intensity = 0.0;   // FLOP/byte
+  double gflops = 0.0;      // achieved
+  double gbps = 0.0;        // achieved, compulsory bytes only
+  double attainable = 0.0;  // min(peak compute, intensity * peak bandwidth)
+  double percent = 0.0;     // achieved / attainable
+  bool memory_bound = false;
+};
+
+RooflinePoint roofline(const KernelCost& cost, double ms,
+                       const DevicePeaks& peaks, Precision precision);
+
+// "Roofline <kernel>: 0.25 FLOP/byte, 12.3 GFLOP/s, 49.1 GB/s; 301
+// GFLOP/s attainable (memory-bound), 4.1% of roofline"
+void print_roofline(std::ostream& os, const std::string& kernel,
+                    const RooflinePoint& point);
+std::string format_roofline(const RooflinePoint& point);
+
+// Attaches intensity, achieved throughput and percent of roofline to the
+// result bench recorded last.
+void annotate_roofline(Harness& bench, const RooflinePoint& point);
+
+#endif  // ROOFLINE_H
@@ -0,0 +1,30 @@
+# Ahead-of-time (AOT) compilation variants shared by the sample Makefiles.
+#
+#   make                          JIT: SPIR-V only, compiled by the driver at
+#                                 the first launch of each kernel
+#   make AOT=cpu                  native code for the CPU device (spir64_x86_64)
+#   make AOT=gpu GPU_DEVICE=pvc   native code for one GPU family (spir64_gen)
+#   make AOT=cpu,gpu              both
+#
+# AOT builds keep a spir64 image as a JIT fallback for any other device.
+# Switching AOT on an existing build tree needs a "make clean" first.
+
+AOT ?=
+GPU_DEVICE ?= pvc
+
+comma := ,
+empty :=
+space := $(empty) $(empty)
+
+SYCL_AOT_TARGETS :=
+SYCL_AOT_FLAGS :=
+ifneq (,$(findstring cpu,$(AOT)))
+SYCL_AOT_TARGETS += spir64_x86_64
+endif
+ifneq (,$(findstring gpu,$(AOT)))
+SYCL_AOT_TARGETS += spir64_gen
+SYCL_AOT_FLAGS += -Xsycl-target-backend=spir64_gen "-device $(GPU_DEVICE)"
+endif
+ifneq (,$(strip $(SYCL_AOT_TARGETS)))
+SYCL_AOT_FLAGS += -fsycl-targets=$(subst $(space),$(comma),$(strip $(SYCL_AOT_TARGETS) spir64))
+endif
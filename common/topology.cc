@@ -0,0 +1,352 @@
+#include "topology.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* kCacheMagic = "sycl-samples-topology 1";
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep)) parts.push_back(part);
+  return parts;
+}
+
+DeviceInfo describe(const sycl::device& dev, int root, int tile) {
+  DeviceInfo info;
+  info.root = root;
+  info.tile = tile;
+  info.name = dev.get_info<sycl::info::device::name>();
+  info.backend = backend_name(dev.get_platform().get_backend());
+  info.type = device_type_name(dev.get_info<sycl::info::device::device_type>());
+  info.driver_version = dev.get_info<sycl::info::device::driver_version>();
+  info.compute_units = dev.get_info<sycl::info::device::max_compute_units>();
+  info.max_work_group_size =
+      dev.get_info<sycl::info::device::max_work_group_size>();
+  info.global_mem_size = dev.get_info<sycl::info::device::global_mem_size>();
+  info.local_mem_size = dev.get_info<sycl::info::device::local_mem_size>();
+  return info;
+}
+
+std::vector<sycl::device> partition(const sycl::device& root) {
+  // Only GPUs are split into tiles; CPU NUMA partitioning is not wanted here.
+  if (!root.is_gpu()) return {};
+  try {
+    return root.create_sub_devices<
+        sycl::info::partition_property::partition_by_affinity_domain>(
+        sycl::info::partition_affinity_domain::next_partitionable);
+  } catch (sycl::exception const&) {
+    return {};
+  }
+}
+
+void write_device(std::ostream& os, const DeviceInfo& d) {
+  os << d.root << '\t' << d.tile << '\t' << d.compute_units << '\t'
+     << d.max_work_group_size << '\t' << d.global_mem_size << '\t'
+     << d.local_mem_size << '\t' << d.backend << '\t' << d.type << '\t'
+     << d.driver_version << '\t' << d.name;
+}
+
+bool read_device(const std::vector<std::string>& f, size_t at,
+                 DeviceInfo& d) {
+  if (f.size() != at + 10) return false;
+  d.root = std::stoi(f[at]);
+  d.tile = std::stoi(f[at + 1]);
+  d.compute_units = std::stoul(f[at + 2]);
+  d.max_work_group_size = std::stoull(f[at + 3]);
+  d.global_mem_size = std::stoull(f[at + 4]);
+  d.local_mem_size = std::stoull(f[at + 5]);
+  d.backend = f[at + 6];
+  d.type = f[at + 7];
+  d.driver_version = f[at + 8];
+  d.name = f[at + 9];
+  return true;
+}
+
+}  // namespace
+
+const char* backend_name(sycl::backend backend) {
+  switch (backend) {
+    case sycl::backend::ext_oneapi_level_zero:
+      return "level_zero";
+    case sycl::backend::opencl:
+      return "opencl";
+    case sycl::backend::ext_oneapi_cuda:
+      return "cuda";
+    case sycl::backend::ext_oneapi_hip:
+      return "hip";
+    default:
+      return "other";
+  }
+}
+
+const char* device_type_name(sycl::info::device_type type) {
+  switch (type) {
+    case sycl::info::device_type::gpu:
+      return "gpu";
+    case sycl::info::device_type::cpu:
+      return "cpu";
+    case sycl::info::device_type::accelerator:
+      return "accelerator";
+    case sycl::info::device_type::all:
+      return "all";
+    default:
+      return "other";
+  }
+}
+
+TopologyFilter parse_topology_filter(const std::string& spec,
+                                     TopologyFilter base) {
+  TopologyFilter filter = base;
+  for (const auto& item : split(spec, ',')) {
+    if (item.empty()) continue;
+    auto eq = item.find('=');
+    if (eq == std::string::npos) {
+      throw std::invalid_argument("Bad device filter entry: " + item);
+    }
+    std::string key = item.substr(0, eq);
+    std::string value = item.substr(eq + 1);
+    if (key == "backend") {
+      filter.backend = value;
+    } else if (key == "type") {
+      filter.type = value;
+    } else if (key == "root") {
+      filter.root = std::stoi(value);
+    } else if (key == "tiles") {
+      filter.tiles = value != "0" && value != "false";
+    } else if (key == "index") {
+      filter.indices.clear();
+      for (const auto& index : split(value, ':')) {
+        filter.indices.push_back(std::stoi(index));
+      }
+    } else {
+      throw std::invalid_argument("Unknown device filter key: " + key);
+    }
+  }
+  return filter;
+}
+
+TopologyFilter topology_filter_from_env(const TopologyFilter& defaults) {
+  const char* spec = std::getenv("SYCL_SAMPLES_DEVICES");
+  if (spec == nullptr) return defaults;
+  return parse_topology_filter(spec, defaults);
+}
+
+std::string Topology::cache_path() {
+  if (const char* path = std::getenv("SYCL_SAMPLES_TOPOLOGY_CACHE")) {
+    return path;
+  }
+  const char* home = std::getenv("HOME");
+  std::string dir = home ? std::string(home) + "/.cache" : "/tmp";
+  return dir + "/sycl-samples-topology.txt";
+}
+
+Topology Topology::load(bool use_cache) {
+  auto start = std::chrono::high_resolution_clock::now();
+  Topology topo;
+
+  // Root devices are needed either way, and their driver versions make up
+  // the cache key; this part is cheap compared to partitioning.
+  std::string key;
+  auto platforms = sycl::platform::get_platforms();
+  for (size_t p = 0; p < platforms.size(); ++p) {
+    key += std::string(backend_name(platforms[p].get_backend())) + "|" +
+           platforms[p].get_info<sycl::info::platform::name>() + "|" +
+           platforms[p].get_info<sycl::info::platform::version>();
+    auto devices = platforms[p].get_devices();
+    for (size_t d = 0; d < devices.size(); ++d) {
+      key += "|" + devices[d].get_info<sycl::info::device::driver_version>();
+      topo.root_devices_.push_back(devices[d]);
+      RootInfo root;
+      root.platform = static_cast<int>(p);
+      root.device = static_cast<int>(d);
+      topo.roots_.push_back(root);
+    }
+    key += ";";
+  }
+  topo.tile_devices_.resize(topo.roots_.size());
+
+  std::string path = cache_path();
+  if (use_cache && topo.read_cache(path, key)) {
+    topo.from_cache_ = true;
+  } else {
+    topo.devices_.clear();
+    for (size_t r = 0; r < topo.roots_.size(); ++r) {
+      const sycl::device& dev = topo.root_devices_[r];
+      RootInfo& root = topo.roots_[r];
+      root.info = describe(dev, static_cast<int>(r), -1);
+
+      topo.tile_devices_[r] = partition(dev);
+      root.tiles = static_cast<int>(topo.tile_devices_[r].size());
+      if (root.tiles == 0) {
+        topo.devices_.push_back(root.info);
+      }
+      for (int t = 0; t < root.tiles; ++t) {
+        topo.devices_.push_back(
+            describe(topo.tile_devices_[r][t], static_cast<int>(r), t));
+      }
+    }
+    if (use_cache) topo.write_cache(path, key);
+  }
+
+  auto end = std::chrono::high_resolution_clock::now();
+  topo.load_us_ =
+      std::chrono::duration<double, std::micro>(end - start).count();
+  return topo;
+}
+
+bool Topology::read_cache(const std::string& path, const std::string& key) {
+  std::ifstream in(path);
+  std::string line;
+  if (!in || !std::getline(in, line) || line != kCacheMagic) return false;
+  if (!std::getline(in, line) || line != "key\t" + key) return false;
+
+  std::vector<DeviceInfo> devices;
+  size_t roots_seen = 0;
+  try {
+    while (std::getline(in, line)) {
+      auto fields = split(line, '\t');
+      if (fields.empty()) continue;
+      if (fields[0] == "root" && fields.size() > 4) {
+        if (roots_seen >= roots_.size()) return false;
+        RootInfo& root = roots_[roots_seen++];
+        root.tiles = std::stoi(fields[3]);
+        if (!read_device(fields, 4, root.info)) return false;
+      } else if (fields[0] == "device") {
+        DeviceInfo info;
+        if (!read_device(fields, 1, info)) return false;
+        devices.push_back(info);
+      } else {
+        return false;
+      }
+    }
+  } catch (std::exception const&) {
+    return false;  // corrupt numbers: rediscover
+  }
+  if (roots_seen != roots_.size()) return false;
+
+  devices_ = std::move(devices);
+  return true;
+}
+
+void Topology::write_cache(const std::string& path,
+                           const std::string& key) const {
+  // $HOME/.cache does not exist on a fresh account
+  std::filesystem::path parent = std::filesystem::path(path).parent_path();
+  std::error_code error;
+  if (!parent.empty()) std::filesystem::create_directories(parent, error);
+  if (error) {
+    std::cerr << "Topology: cannot create " << parent.string() << ": "
+              << error.message() << "; device cache not written\n";
+    return;
+  }
+
+  // Write to a private file and rename it into place, so concurrent ranks
+  // never read a half-written cache.
+  std::string tmp = path + "." + std::to_string(getpid());
+  {
+    std::ofstream out(tmp);
+    if (!out) {
+      std::cerr << "Topology: cannot write " << tmp
+                << "; device cache not written\n";
+      return;
+    }
+    out << kCacheMagic << "\n" << "key\t" << key << "\n";
+    for (const auto& root : roots_) {
+      out << "root\t" << root.platform << '\t' << root.device << '\t'
+          << root.tiles << '\t';
+      write_device(out, root.info);
+      out << "\n";
+    }
+    for (const auto& dev : devices_) {
+      out << "device\t";
+      write_device(out, dev);
+      out << "\n";
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::cerr << "Topology: cannot rename " << tmp << " to " << path
+              << "; device cache not written\n";
+    std::remove(tmp.c_str());
+  }
+}
+
+std::vector<DeviceInfo> Topology::select(const TopologyFilter& filter) const {
+  std::vector<DeviceInfo> matches;
+  auto consider = [&](const DeviceInfo& info) {
+    if (!filter.backend.empty() && info.backend != filter.backend) return;
+    if (!filter.type.empty() && info.type != filter.type) return;
+    if (filter.root >= 0 && info.root != filter.root) return;
+    matches.push_back(info);
+  };
+
+  if (filter.tiles) {
+    for (const auto& info : devices_) consider(info);
+  } else {
+    for (const auto& root : roots_) consider(root.info);
+  }
+
+  if (filter.indices.empty()) return matches;
+
+  std::vector<DeviceInfo> picked;
+  for (int index : filter.indices) {
+    if (index < 0 || index >= static_cast<int>(matches.size())) {
+      throw std::out_of_range("Device index " + std::to_string(index) +
+                              " out of range (" +
+                              std::to_string(matches.size()) + " matches)");
+    }
+    picked.push_back(matches[index]);
+  }
+  return picked;
+}
+
+sycl::device Topology::resolve(const DeviceInfo& info) const {
+  const sycl::device& root = root_devices_.at(info.root);
+  if (info.tile < 0) return root;
+
+  auto& tiles = tile_devices_[info.root];
+  if (tiles.empty()) tiles = partition(root);
+  return tiles.at(info.tile);
+}
+
+std::vector<sycl::device> Topology::resolve(
+    const std::vector<DeviceInfo>& infos) const {
+  std::vector<sycl::device> devices;
+  for (const auto& info : infos) devices.push_back(resolve(info));
+  return devices;
+}
+
+void Topology::print(std::ostream& os) const {
+  os << "Topology: " << roots_.size() << " root device(s), "
+     << devices_.size() << " schedulable device(s), "
+     << (from_cache_ ? "loaded from cache" : "discovered") << " in "
+     << load_us_ / 1000.0 << " ms\n";
+  for (const auto& root : roots_) {
+    os << "  Root " << root.info.root << ": " << root.info.name << " ["
+       << root.info.backend << " " << root.info.type << ", driver "
+       << root.info.driver_version << "], ";
+    if (root.tiles > 0) {
+      os << root.tiles << " tile(s)\n";
+    } else {
+      os << "not partitionable\n";
+    }
+  }
+  for (const auto& dev : devices_) {
+    os << "    " << (dev.tile < 0 ? "Device" : "Tile") << " " << dev.root;
+    if (dev.tile >= 0) os << "." << dev.tile;
+    os << ": " << dev.compute_units << " CUs, max WG "
+       << dev.max_work_group_size << ", "
+       << dev.global_mem_size / (1024 * 1024) << " MiB global, "
+       << dev.local_mem_size / 1024 << " KiB local\n";
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <sycl/sycl.hpp>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Description of one device: a root device, or one tile of a partitionable
+// root device. Plain data, so it can be cached between runs.
+struct DeviceInfo {
+  int root = 0;   // ordinal in Topology::roots()
+  int tile = -1;  // tile within the root, -1 for the root device itself
+  std::string name;
+  std::string backend;  // "level_zero", "opencl", "cuda", "hip" or "other"
+  std::string type;     // "gpu", "cpu", "accelerator" or "other"
+  std::string driver_version;
+  unsigned compute_units = 0;
+  size_t max_work_group_size = 0;
+  uint64_t global_mem_size = 0;
+  uint64_t local_mem_size = 0;
+};
+
+struct RootInfo {
+  int platform = 0;  // index in sycl::platform::get_platforms()
+  int device = 0;    // index in platform.get_devices()
+  int tiles = 0;     // 0 when the root device cannot be partitioned
+  DeviceInfo info;
+};
+
+// Which devices a program wants. Empty strings and negative values match
+// everything; indices pick positions out of the filtered list.
+struct TopologyFilter {
+  std::string backend;
+  std::string type;
+  int root = -1;
+  bool tiles = true;  // expand partitionable roots into their tiles
+  std::vector<int> indices;
+};
+
+// Parse "backend=level_zero,type=gpu,root=0,tiles=1,index=0:2" (any subset)
+// on top of base; index=0:2 picks entries 0 and 2.
+TopologyFilter parse_topology_filter(const std::string& spec,
+                                     TopologyFilter base = {});
+
+// Samples pass their default filter; $SYCL_SAMPLES_DEVICES overrides it.
+TopologyFilter topology_filter_from_env(const TopologyFilter& defaults);
+
+const char* backend_name(sycl::backend backend);
+const char* device_type_name(sycl::info::device_type type);
+
+// Root devices, their tiles and the properties samples print at startup.
+// Walking every platform and partitioning every root device is slow on
+// multi-GPU nodes, so the result is cached in a small text file keyed by
+// the platform and driver versions; a hit skips the sub-device walk and
+// the per-tile queries entirely. Tiles are only created for the roots a
+// program actually resolves.
+class Topology {
+ public:
+  static Topology load(bool use_cache = true);
+
+  // File used by load(): $SYCL_SAMPLES_TOPOLOGY_CACHE if set, otherwise
+  // $HOME/.cache/sycl-samples-topology.txt.
+  static std::string cache_path();
+
+  const std::vector<RootInfo>& roots() const { return roots_; }
+  // Every tile of a partitionable root, every other root as itself.
+  const std::vector<DeviceInfo>& devices() const { return devices_; }
+
+  std::vector<DeviceInfo> select(const TopologyFilter& filter) const;
+
+  // Map descriptors back to SYCL devices. Not thread-safe: tiles are
+  // created on first use and remembered.
+  sycl::device resolve(const DeviceInfo& info) const;
+  std::vector<sycl::device> resolve(const std::vector<DeviceInfo>& infos) const;
+
+  bool from_cache() const { return from_cache_; }
+  double load_us() const { return load_us_; }
+
+  void print(std::ostream& os) const;
+
+ private:
+  bool read_cache(const std::string& path, const std::string& key);
+  void write_cache(const std::string& path, const std::string& key) const;
+
+  std::vector<RootInfo> roots_;
+  std::vector<DeviceInfo> devices_;
+  std::vector<sycl::device> root_devices_;
+  mutable std::vector<std::vector<sycl::device>> tile_devices_;
+  bool from_cache_ = false;
+  double load_us_ = 0.0;
+};
+
+#endif  // TOPOLOGY_H
@@ -0,0 +1,61 @@
+#include "usm_policy.h"
+
+#include <stdexcept>
+#include <unistd.h>
+
+const char* to_string(UsmPolicy policy) {
+  switch (policy) {
+    case UsmPolicy::kNone:
+      return "none";
+    case UsmPolicy::kPrefetch:
+      return "prefetch";
+    case UsmPolicy::kReadMostly:
+      return "read-mostly";
+    case UsmPolicy::kPreferredLocation:
+      return "preferred";
+  }
+  return "unknown";
+}
+
+UsmPolicy parse_usm_policy(const std::string& name) {
+  if (name == "none") return UsmPolicy::kNone;
+  if (name == "prefetch") return UsmPolicy::kPrefetch;
+  if (name == "read-mostly") return UsmPolicy::kReadMostly;
+  if (name == "preferred") return UsmPolicy::kPreferredLocation;
+  throw std::invalid_argument("Unknown USM policy: " + name);
+}
+
+std::vector<sycl::event> apply_usm_policy(sycl::queue& q, UsmPolicy policy,
+                                          const std::vector<UsmRange>& ranges) {
+  std::vector<sycl::event> events;
+  for (const auto& range : ranges) {
+    switch (policy) {
+      case UsmPolicy::kNone:
+        break;
+      case UsmPolicy::kPrefetch:
+        events.push_back(q.prefetch(range.ptr, range.bytes));
+        break;
+      case UsmPolicy::kReadMostly:
+        if (range.read_only) {
+          events.push_back(
+              q.mem_advise(range.ptr, range.bytes, kAdviseSetReadMostly));
+        }
+        break;
+      case UsmPolicy::kPreferredLocation:
+        events.push_back(q.mem_advise(range.ptr, range.bytes,
+                                      kAdviseSetPreferredLocation));
+        break;
+    }
+  }
+  return events;
+}
+
+void prefetch_to_host(const std::vector<UsmRange>& ranges) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  for (const auto& range : ranges) {
+    const volatile char* bytes = static_cast<const volatile char*>(range.ptr);
+    for (size_t offset = 0; offset < range.bytes; offset += page) {
+      (void)bytes[offset];
+    }
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef USM_POLICY_H
+#define USM_POLICY_H
+
+#include <sycl/sycl.hpp>
+#include <string>
+#include <vector>
+
+// What a program tells the runtime about its shared USM before the
+// kernels that use it:
+//   none         nothing; pages migrate on demand when a kernel faults
+//   prefetch     queue::prefetch of every range to the kernel's device
+//   read-mostly  mem_advise read-mostly on the ranges kernels only read,
+//                so they may be duplicated instead of moved
+//   preferred    mem_advise preferred location: every range on the device
+//                of the queue it is applied with, e.g. each tile its half
+enum class UsmPolicy { kNone, kPrefetch, kReadMostly, kPreferredLocation };
+
+const char* to_string(UsmPolicy policy);
+UsmPolicy parse_usm_policy(const std::string& name);
+
+// mem_advise takes a backend-defined int. DPC++ hands it to the Unified
+// Runtime as a ur_usm_advice_flag_t, which the Level Zero and CUDA
+// adapters translate to their own advice.
+constexpr int kAdviseSetReadMostly = 1 << 0;
+constexpr int kAdviseSetPreferredLocation = 1 << 2;
+
+// One range of a shared allocation used by kernels on one queue.
+struct UsmRange {
+  const void* ptr;
+  size_t bytes;
+  bool read_only;  // only read by the kernels
+};
+
+// Submits the hints of policy for ranges to q and returns their events;
+// none for kNone, and for kReadMostly when nothing is read-only.
+std::vector<sycl::event> apply_usm_policy(sycl::queue& q, UsmPolicy policy,
+                                          const std::vector<UsmRange>& ranges);
+
+// Brings ranges written on a device back to host memory before the host
+// reads them, e.g. to verify. SYCL 2020 has no prefetch towards the host,
+// so this reads one byte per page: the faults migrate the pages in bulk
+// here instead of one by one inside the verification loop.
+void prefetch_to_host(const std::vector<UsmRange>& ranges);
+
+#endif  // USM_POLICY_H
@@ -0,0 +1,229 @@
+#include "usm_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kMinClass = 256;
+
+bool complete(const sycl::event& e) {
+  return e.get_info<sycl::info::event::command_execution_status>() ==
+         sycl::info::event_command_status::complete;
+}
+
+// -1 until the first query reads $SYCL_SAMPLES_USM_POOL
+std::atomic<int> pool_enabled{-1};
+
+}  // namespace
+
+size_t UsmPool::size_class(size_t bytes) {
+  if (bytes <= kMinClass) return kMinClass;
+  // Largest power of two below bytes, then up in quarters of it
+  size_t base = 1;
+  while (base * 2 < bytes) base *= 2;
+  size_t step = base / 4;
+  return base + (bytes - base + step - 1) / step * step;
+}
+
+UsmPool::~UsmPool() {
+  for (auto& pending : pending_) pending.done.wait();
+  for (auto& pending : pending_) cache(pending.p, pending.block);
+  pending_.clear();
+  release_cached();
+}
+
+size_t UsmPool::queue_index(const sycl::queue& q) {
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    if (queues_[i] == q) return i;
+  }
+  queues_.push_back(q);
+  free_.emplace_back();
+  return queues_.size() - 1;
+}
+
+void UsmPool::cache(void* p, const Block& block) {
+  free_[block.queue][{int(block.kind), block.reserved}].push_back(p);
+}
+
+void UsmPool::collect() {
+  size_t kept = 0;
+  for (auto& pending : pending_) {
+    if (complete(pending.done)) {
+      cache(pending.p, pending.block);
+    } else {
+      pending_[kept++] = std::move(pending);
+    }
+  }
+  pending_.resize(kept);
+}
+
+void UsmPool::release_cached() {
+  for (size_t q = 0; q < free_.size(); ++q) {
+    bool cached = false;
+    for (const auto& bin : free_[q]) cached = cached || !bin.second.empty();
+    if (!cached) continue;
+    // Blocks freed without an event can still be in use by work queued
+    // after them on their in-order queue: safe to hand out again there,
+    // not to give back to the driver before that work is done
+    queues_[q].wait();
+    for (auto& bin : free_[q]) {
+      for (void* p : bin.second) {
+        sycl::free(p, queues_[q]);
+        ++stats_.driver_frees;
+        stats_.cached_reserved -= bin.first.second;
+      }
+    }
+    free_[q].clear();
+  }
+}
+
+void* UsmPool::allocate(size_t bytes, sycl::usm::alloc kind,
+                        const sycl::queue& q) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  collect();
+
+  Block block;
+  block.queue = queue_index(q);
+  block.kind = kind;
+  block.reserved = size_class(bytes);
+  block.requested = bytes;
+  ++stats_.allocations;
+
+  void* p = nullptr;
+  auto bin = free_[block.queue].find({int(kind), block.reserved});
+  if (bin != free_[block.queue].end() && !bin->second.empty()) {
+    p = bin->second.back();
+    bin->second.pop_back();
+    stats_.cached_reserved -= block.reserved;
+    ++stats_.hits;
+  } else {
+    p = sycl::malloc(block.reserved, q, kind);
+    if (!p) {
+      // Out of memory with blocks of other sizes cached: give them back
+      release_cached();
+      p = sycl::malloc(block.reserved, q, kind);
+    }
+    if (!p) return nullptr;
+    ++stats_.driver_allocs;
+  }
+
+  live_[p] = block;
+  stats_.in_use += bytes;
+  stats_.in_use_reserved += block.reserved;
+  stats_.peak_in_use = std::max(stats_.peak_in_use, stats_.in_use);
+  stats_.peak_reserved = std::max(
+      stats_.peak_reserved, stats_.in_use_reserved + stats_.cached_reserved);
+  return p;
+}
+
+void UsmPool::deallocate(void* p) {
+  if (!p) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = live_.find(p);
+  if (it == live_.end()) {
+    throw std::invalid_argument("UsmPool::deallocate of a foreign pointer");
+  }
+  Block block = it->second;
+  sycl::queue q = queues_[block.queue];
+  if (block.kind != sycl::usm::alloc::device || !q.is_in_order()) {
+    // Queue order only protects device memory from device work: the host
+    // touches host and shared memory as soon as it is handed out again,
+    // and an out-of-order queue may run later work first. Wait for
+    // everything submitted so far instead.
+    lock.unlock();
+    deallocate(p, q.ext_oneapi_submit_barrier());
+    return;
+  }
+  live_.erase(it);
+  stats_.in_use -= block.requested;
+  stats_.in_use_reserved -= block.reserved;
+  stats_.cached_reserved += block.reserved;
+  ++stats_.frees;
+  cache(p, block);
+}
+
+void UsmPool::deallocate(void* p, const sycl::event& done) {
+  if (!p) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = live_.find(p);
+  if (it == live_.end()) {
+    throw std::invalid_argument("UsmPool::deallocate of a foreign pointer");
+  }
+  Block block = it->second;
+  live_.erase(it);
+  stats_.in_use -= block.requested;
+  stats_.in_use_reserved -= block.reserved;
+  stats_.cached_reserved += block.reserved;
+  ++stats_.frees;
+  ++stats_.deferred;
+  pending_.push_back({p, block, done});
+}
+
+void UsmPool::trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  collect();
+  release_cached();
+}
+
+UsmPoolStats UsmPool::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void UsmPool::print_stats(std::ostream& os, const std::string& label) const {
+  UsmPoolStats s = stats();
+  std::ios::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision(1);
+  os << "USM pool " << label << ": " << s.allocations << " allocations, "
+     << 100.0 * s.hit_rate() << "% from the cache, " << s.driver_allocs
+     << " from the driver; " << s.frees << " frees (" << s.deferred
+     << " deferred); peak " << s.peak_in_use / 1048576.0 << " MiB in use, "
+     << s.peak_reserved / 1048576.0 << " MiB reserved; "
+     << 100.0 * s.fragmentation() << "% of live memory lost to rounding, "
+     << s.cached_reserved / 1048576.0 << " MiB cached\n";
+  os.flags(flags);
+}
+
+bool usm_pool_enabled() {
+  int enabled = pool_enabled.load();
+  if (enabled < 0) {
+    const char* env = std::getenv("SYCL_SAMPLES_USM_POOL");
+    enabled = env && *env && std::string(env) != "0";
+    pool_enabled.store(enabled);
+  }
+  return enabled != 0;
+}
+
+void set_usm_pool_enabled(bool enabled) { pool_enabled.store(enabled); }
+
+UsmPool& usm_pool() {
+  static UsmPool* pool = new UsmPool;
+  return *pool;
+}
+
+void usm_free(void* p, const sycl::queue& q) {
+  if (usm_pool_enabled()) {
+    usm_pool().deallocate(p);
+  } else if (p) {
+    sycl::free(p, q);
+  }
+}
+
+void usm_free(void* p, const sycl::queue& q, const sycl::event& done) {
+  if (usm_pool_enabled()) {
+    usm_pool().deallocate(p, done);
+  } else if (p) {
+    sycl::event e = done;
+    e.wait();
+    sycl::free(p, q);
+  }
+}
+
+void print_usm_pool_stats(std::ostream& os) {
+  if (usm_pool_enabled()) usm_pool().print_stats(os, "(process)");
+}
@@ -0,0 +1,132 @@
+#ifndef USM_POOL_H
+#define USM_POOL_H
+
+#include <sycl/sycl.hpp>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Counters of a UsmPool; bytes are the sizes callers asked for unless
+// named "reserved", which is what the pool holds from the driver.
+struct UsmPoolStats {
+  size_t allocations = 0;  // allocate() calls
+  size_t hits = 0;         // served from a free list
+  size_t frees = 0;        // deallocate() calls
+  size_t deferred = 0;     // of which waited for an event
+  size_t driver_allocs = 0;
+  size_t driver_frees = 0;
+  size_t in_use = 0;           // live, as requested
+  size_t in_use_reserved = 0;  // live, rounded up to their size classes
+  size_t cached_reserved = 0;  // free or pending, held for reuse
+  size_t peak_in_use = 0;
+  size_t peak_reserved = 0;    // live plus cached
+
+  double hit_rate() const {
+    return allocations ? double(hits) / allocations : 0.0;
+  }
+  // Share of the memory held for live blocks lost to size-class rounding
+  double fragmentation() const {
+    return in_use_reserved ? 1.0 - double(in_use) / in_use_reserved : 0.0;
+  }
+};
+
+// Caching allocator over sycl::malloc_device/shared/host.
+//
+// Requests are rounded up to a size class (four per power of two, so at
+// most 25% is lost to rounding) and freed blocks go to a free list of
+// their queue, kind and class instead of back to the driver. A block is
+// only reused on the queue it was freed on: the work that used it was
+// submitted there, so on an in-order queue anything submitted later runs
+// after it. A block freed with an event waits in a pending list until
+// the event completes before it joins that free list; that is the safe
+// way to free memory used by other queues.
+//
+// Thread-safe. Cached blocks are released by trim() and the destructor.
+class UsmPool {
+ public:
+  UsmPool() = default;
+  ~UsmPool();
+
+  UsmPool(const UsmPool&) = delete;
+  UsmPool& operator=(const UsmPool&) = delete;
+
+  // nullptr when the driver cannot provide the memory even after the
+  // cache has been released, like sycl::malloc.
+  void* allocate(size_t bytes, sycl::usm::alloc kind, const sycl::queue& q);
+  template <typename T>
+  T* allocate(size_t count, sycl::usm::alloc kind, const sycl::queue& q) {
+    return static_cast<T*>(allocate(count * sizeof(T), kind, q));
+  }
+
+  // All work using p is complete or was submitted to its queue. Device
+  // memory of an in-order queue goes back to the free list at once; host
+  // and shared memory, which the host may touch as soon as it is reused,
+  // and memory of an out-of-order queue are freed against a barrier on
+  // the queue instead.
+  void deallocate(void* p);
+  // Reusable once done has completed.
+  void deallocate(void* p, const sycl::event& done);
+
+  // Releases every cached block to the driver, after waiting for the
+  // queues they were freed on; pending ones stay.
+  void trim();
+
+  UsmPoolStats stats() const;
+  void print_stats(std::ostream& os, const std::string& label) const;
+
+  // Size class a request of bytes is rounded up to.
+  static size_t size_class(size_t bytes);
+
+ private:
+  struct Block {
+    size_t queue;  // index into queues_
+    sycl::usm::alloc kind;
+    size_t reserved;
+    size_t requested;
+  };
+  using FreeKey = std::pair<int, size_t>;  // kind, size class
+  struct Pending {
+    void* p;
+    Block block;
+    sycl::event done;
+  };
+
+  size_t queue_index(const sycl::queue& q);
+  void collect();  // moves completed pending blocks to their free lists
+  void cache(void* p, const Block& block);
+  void release_cached();
+
+  mutable std::mutex mutex_;
+  std::vector<sycl::queue> queues_;
+  std::vector<std::map<FreeKey, std::vector<void*>>> free_;  // per queue
+  std::unordered_map<void*, Block> live_;
+  std::vector<Pending> pending_;
+  UsmPoolStats stats_;
+};
+
+// Switch for the samples: when on, usm_malloc and usm_free go through one
+// process-wide UsmPool, otherwise straight to sycl::malloc and sycl::free.
+// Off unless $SYCL_SAMPLES_USM_POOL is set to something other than 0, or
+// a program turns it on (e.g. with its --pool option) before its first
+// allocation. The pool is never destroyed, so it cannot outlive the SYCL
+// runtime at exit; the driver reclaims what it holds.
+bool usm_pool_enabled();
+void set_usm_pool_enabled(bool enabled);
+UsmPool& usm_pool();
+
+template <typename T>
+T* usm_malloc(size_t count, sycl::usm::alloc kind, const sycl::queue& q) {
+  if (usm_pool_enabled()) return usm_pool().allocate<T>(count, kind, q);
+  return sycl::malloc<T>(count, q, kind);
+}
+void usm_free(void* p, const sycl::queue& q);
+void usm_free(void* p, const sycl::queue& q, const sycl::event& done);
+
+// Prints the pool's statistics when pooling is on.
+void print_usm_pool_stats(std::ostream& os);
+
+#endif  // USM_POOL_H
@@ -1,61 +1,63 @@
 #include <sycl/sycl.hpp>
 #include <iostream>
+#include <string>
 #include <vector>
 
+#include "topology.h"
+
 using namespace sycl;
 
-int main() {
+int main(int argc, char *argv[]) {
   try {
-    // 1. Device discovery
-    auto platforms = platform::get_platforms();
-    auto gpu_platform =
-        std::find_if(platforms.begin(), platforms.end(), [](const platform &p) {
-          return p.get_info<info::platform::name>().find("Level-Zero") !=
-                 std::string::npos;
-        });
-
-    if (gpu_platform == platforms.end()) {
-      std::cout << "No Level-Zero GPU platform found.\n";
+    // 1. Device discovery, served from the topology cache when the drivers
+    //    have not changed since the last run. Pass --rescan to bypass it.
+    bool use_cache = !(argc > 1 && std::string(argv[1]) == "--rescan");
+    Topology topology = Topology::load(use_cache);
+
+    TopologyFilter filter;
+    filter.backend = "level_zero";
+    filter.type = "gpu";
+    filter.tiles = false;
+    auto roots = topology.select(topology_filter_from_env(filter));
+
+    if (roots.empty()) {
+      std::cout << "No Level-Zero GPU devices found.\n";
       return 1;
     }
 
-    auto devices = gpu_platform->get_devices();
-    if (devices.empty()) {
-      std::cout << "No GPU devices found.\n";
-      return 1;
-    }
+    std::cout << "Number of root devices: " << roots.size() << std::endl;
 
-    std::cout << "Number of root devices: " << devices.size() << std::endl;
-
-    // 2. Create sub-devices (if supported)
-    std::vector<device> all_sub_devices;
-    for (auto &dev : devices) {
-      std::cout << "Device: " << dev.get_info<info::device::name>()
-                << std::endl;
-      try {
-        auto sub_devices = dev.create_sub_devices<
-            info::partition_property::partition_by_affinity_domain>(
-            info::partition_affinity_domain::next_partitionable);
-        all_sub_devices.insert(all_sub_devices.end(), sub_devices.begin(),
-                               sub_devices.end());
-        std::cout << "  Number of sub-devices: " << sub_devices.size()
-                  << std::endl;
-      } catch (exception &e) {
-        std::cout << "  Failed to create sub-devices. Error: " << e.what()
+    // 2. Sub-devices (tiles) of each root device
+    size_t total_sub_devices = 0;
+    for (const auto &root : roots) {
+      const RootInfo &root_info = topology.roots()[root.root];
+      std::cout << "Device: " << root.name << std::endl;
+      if (root_info.tiles > 0) {
+        std::cout << "  Number of sub-devices: " << root_info.tiles
                   << std::endl;
-        std::cout << "  This device will be treated as a single sub-device."
+        total_sub_devices += root_info.tiles;
+      } else {
+        std::cout << "  This device is not partitionable and will be treated "
+                     "as a single sub-device."
                   << std::endl;
-        all_sub_devices.push_back(dev);
+        total_sub_devices += 1;
       }
     }
 
     std::cout
         << "Total number of sub-devices (including non-partitionable devices): "
-        << all_sub_devices.size() << std::endl;
+        << total_sub_devices << std::endl;
+
+    std::cout << "\n";
+    topology.print(std::cout);
+    std::cout << "Topology cache: " << Topology::cache_path() << std::endl;
   } catch (exception &e) {
     std::cout << "An error occurred: " << e.what() << std::endl;
     return 1;
+  } catch (std::exception &e) {
+    std::cout << "An error occurred: " << e.what() << std::endl;
+    return 1;
   }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "device_manager.h"
+#include "harness.h"
+
+using namespace sycl;
+
+// Jacobi relaxation of a 2D grid split by rows across tiles and GPUs, with
+// a one-row halo exchanged between neighbouring partitions every step:
+//
+//   global rows:  0 | 1 .. rows | rows+1 .. 2*rows | ... | P*rows+1
+//                 ^ fixed        partition 0         ...   fixed ^
+//
+// Each partition keeps rows+2 rows: its own rows plus a halo row above and
+// below. After every step partition d sends its first row to d-1 and its
+// last row to d+1. A link between two partitions is
+//   direct  one queue::memcpy from device to device; needs both in one
+//           context, and goes peer-to-peer where the backend supports it
+//   staged  device -> pinned host -> device, for devices that do not share
+//           a context (or when forced with --mode staged)
+// Compute and exchange are timed separately per step, so the cost of the
+// exchange can be read against the work it feeds.
+
+constexpr size_t DEFAULT_ROWS = 2048;  // per partition
+constexpr size_t DEFAULT_COLS = 4096;
+constexpr int DEFAULT_STEPS = 100;
+
+class JacobiKernel;
+class InitKernel;
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+float Initial(size_t row, size_t col) {
+  return static_cast<float>((row * 7 + col * 3) % 17);
+}
+
+double ElapsedMs(bench_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start)
+      .count();
+}
+
+struct Partition {
+  queue q;
+  float* cur = nullptr;  // (rows + 2) x cols, halo rows first and last
+  float* next = nullptr;
+  size_t first_row = 0;  // global row of local row 0 (the upper halo)
+};
+
+// One direction of one neighbour pair.
+struct Link {
+  int src, dst;
+  size_t src_row, dst_row;  // local rows
+  bool direct;
+  float* stage = nullptr;   // pinned, in the source context; staged only
+};
+
+int main(int argc, char* argv[]) {
+  size_t rows = DEFAULT_ROWS;
+  size_t cols = DEFAULT_COLS;
+  int steps = DEFAULT_STEPS;
+  int num_devices = 0;
+  std::string mode = "auto";
+  bool verify = false;
+  ContextScope context_scope = ContextScope::kPerPlatform;
+  HarnessOptions harness_options;
+
+  try {
+    Args args(argc, argv, harness_options);
+    rows = args.get_int("rows", rows);
+    cols = args.get_int("cols", cols);
+    steps = static_cast<int>(args.get_int("steps", steps));
+    num_devices = static_cast<int>(args.get_int("devices", num_devices));
+    mode = args.get("mode", mode);
+    verify = args.flag("verify");
+    context_scope =
+        parse_context_scope(args.get("context", to_string(context_scope)));
+    harness_options = args.harness();
+    args.finish();
+    if (mode != "auto" && mode != "direct" && mode != "staged") {
+      throw std::invalid_argument("Unknown exchange mode: " + mode);
+    }
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
+  }
+
+  try {
+    // Tiles of every GPU; a grid spread over tiles of one card and over
+    // cards exchanges over both kinds of link
+    DeviceManagerOptions options;
+    options.scope = context_scope;
+    DeviceManager manager(options);
+    size_t parts = num_devices > 0
+                       ? std::min<size_t>(num_devices, manager.size())
+                       : manager.size();
+    if (parts < 2) {
+      std::cout << "Not enough devices available. At least 2 devices or "
+                   "tiles are required.\n";
+      return -1;
+    }
+
+    std::cout << "Context scope: " << to_string(context_scope) << "\n";
+    std::cout << "Grid: " << parts * rows + 2 << " x " << cols << " in "
+              << parts << " partitions of " << rows << " rows\n";
+
+    std::vector<Partition> part(parts);
+    for (size_t d = 0; d < parts; ++d) {
+      part[d].q = manager.make_queue(d, harness_exception_handler,
+                                     property::queue::in_order{});
+      part[d].cur = malloc_device<float>((rows + 2) * cols, part[d].q);
+      part[d].next = malloc_device<float>((rows + 2) * cols, part[d].q);
+      if (!part[d].cur || !part[d].next) {
+        throw std::runtime_error("USM allocation failed for device " +
+                                 std::to_string(d));
+      }
+      part[d].first_row = d * rows;
+      std::cout << "Partition " << d << ": " << manager.info(d).name
+                << " (root " << manager.info(d).root << ", tile "
+                << manager.info(d).tile << ")\n";
+
+      // Both buffers start out identical, so the fixed boundary (edge
+      // columns, and the outer halo rows of the first and last partition)
+      // holds whichever buffer is current
+      for (float* buf : {part[d].cur, part[d].next}) {
+        size_t first_row = part[d].first_row;
+        part[d].q.parallel_for<InitKernel>(
+            range<2>(rows + 2, cols), [=](id<2> idx) {
+              buf[idx[0] * cols + idx[1]] =
+                  Initial(first_row + idx[0], idx[1]);
+            });
+      }
+    }
+    for (auto& p : part) p.q.wait();
+
+    // Links in both directions between each neighbour pair
+    std::vector<Link> links;
+    for (size_t d = 0; d + 1 < parts; ++d) {
+      bool same_context =
+          manager.context_for(d) == manager.context_for(d + 1);
+      bool direct = mode == "direct" || (mode == "auto" && same_context);
+      if (direct && !same_context) {
+        throw std::runtime_error(
+            "Direct exchange needs a shared context; use --context "
+            "per-platform or --mode staged");
+      }
+      links.push_back({int(d), int(d + 1), rows, 0, direct});
+      links.push_back({int(d + 1), int(d), 1, rows + 1, direct});
+
+      device a = manager.devices()[d];
+      device b = manager.devices()[d + 1];
+      bool peer = same_context &&
+                  a.ext_oneapi_can_access_peer(
+                      b, ext::oneapi::peer_access::access_supported) &&
+                  b.ext_oneapi_can_access_peer(
+                      a, ext::oneapi::peer_access::access_supported);
+      if (peer && direct && a != b) {
+        a.ext_oneapi_enable_peer_access(b);
+        b.ext_oneapi_enable_peer_access(a);
+      }
+      std::cout << "Link " << d << " <-> " << d + 1 << ": "
+                << (direct ? "direct" : "staged")
+                << (direct ? (peer ? ", peer access" : ", no peer access")
+                           : "")
+                << "\n";
+    }
+    for (auto& link : links) {
+      if (link.direct) continue;
+      link.stage = malloc_host<float>(cols, part[link.src].q);
+      if (!link.stage) throw std::runtime_error("Pinned allocation failed");
+    }
+
+    Harness bench("halo_exchange", harness_options);
+    bench.set_param("device", manager.info(0).name);
+    bench.set_param("partitions", parts);
+    bench.set_param("rows", rows);
+    bench.set_param("cols", cols);
+    bench.set_param("mode", mode);
+    bench.set_param("context", to_string(context_scope));
+
+    auto compute = [&]() {
+      for (auto& p : part) {
+        const float* in = p.cur;
+        float* out = p.next;
+        p.q.parallel_for<JacobiKernel>(
+            range<2>(rows, cols - 2), [=](id<2> idx) {
+              size_t r = idx[0] + 1;
+              size_t c = idx[1] + 1;
+              out[r * cols + c] =
+                  0.25f * (in[(r - 1) * cols + c] + in[(r + 1) * cols + c] +
+                           in[r * cols + c - 1] + in[r * cols + c + 1]);
+            });
+      }
+      for (auto& p : part) {
+        p.q.wait();
+        std::swap(p.cur, p.next);
+      }
+    };
+
+    size_t row_bytes = cols * sizeof(float);
+    auto exchange = [&]() {
+      // Direct copies all go out at once; staged ones land on the host
+      // first and are forwarded once that leg has finished
+      std::vector<event> to_host(links.size());
+      for (size_t i = 0; i < links.size(); ++i) {
+        const Link& l = links[i];
+        const float* from = part[l.src].cur + l.src_row * cols;
+        float* to = part[l.dst].cur + l.dst_row * cols;
+        to_host[i] = part[l.src].q.memcpy(l.direct ? to : l.stage, from,
+                                          row_bytes);
+      }
+      for (size_t i = 0; i < links.size(); ++i) {
+        const Link& l = links[i];
+        if (l.direct) continue;
+        to_host[i].wait();
+        part[l.dst].q.memcpy(part[l.dst].cur + l.dst_row * cols, l.stage,
+                             row_bytes);
+      }
+      for (auto& p : part) p.q.wait();
+    };
+
+    std::vector<double> compute_ms, exchange_ms, step_ms;
+    int warmup = harness_options.warmup;
+    for (int s = 0; s < warmup + steps; ++s) {
+      auto start = bench_clock::now();
+      compute();
+      double c = ElapsedMs(start);
+      auto exchange_start = bench_clock::now();
+      exchange();
+      double e = ElapsedMs(exchange_start);
+      if (s < warmup) continue;
+      compute_ms.push_back(c);
+      exchange_ms.push_back(e);
+      step_ms.push_back(c + e);
+    }
+
+    Stats c = bench.record("compute", compute_ms);
+    Stats e = bench.record("exchange", exchange_ms);
+    bench.record("step", step_ms);
+
+    double bytes_per_step = 2.0 * (parts - 1) * row_bytes;
+    std::cout << "Steps: " << steps << " (+" << warmup << " warm-up)\n";
+    std::cout << "Median compute " << c.median << " ms, exchange " << e.median
+              << " ms per step; exchange is "
+              << 100.0 * e.median / (c.median + e.median)
+              << "% of the step, " << bytes_per_step / e.median / 1e6
+              << " GB/s over " << links.size() << " halo transfers\n";
+
+    int result = 0;
+    if (verify) {
+      // Serial reference of the whole grid for warm-up + steps steps
+      size_t global_rows = parts * rows + 2;
+      std::vector<float> ref(global_rows * cols), tmp;
+      for (size_t r = 0; r < global_rows; ++r) {
+        for (size_t col = 0; col < cols; ++col) {
+          ref[r * cols + col] = Initial(r, col);
+        }
+      }
+      tmp = ref;
+      for (int s = 0; s < warmup + steps; ++s) {
+        for (size_t r = 1; r + 1 < global_rows; ++r) {
+          for (size_t col = 1; col + 1 < cols; ++col) {
+            tmp[r * cols + col] =
+                0.25f * (ref[(r - 1) * cols + col] + ref[(r + 1) * cols + col] +
+                         ref[r * cols + col - 1] + ref[r * cols + col + 1]);
+          }
+        }
+        std::swap(ref, tmp);
+      }
+
+      float max_err = 0.0f;
+      std::vector<float> local(rows * cols);
+      for (size_t d = 0; d < parts; ++d) {
+        part[d].q.memcpy(local.data(), part[d].cur + cols, rows * row_bytes)
+            .wait();
+        for (size_t i = 0; i < rows * cols; ++i) {
+          float expected = ref[(d * rows + 1) * cols + i];
+          max_err = std::max(max_err, std::fabs(local[i] - expected));
+        }
+      }
+      result = max_err < 1e-3f ? 0 : 1;
+      std::cout << "Verification " << (result == 0 ? "passed" : "FAILED")
+                << ", max error " << max_err << "\n";
+    }
+
+    for (auto& link : links) {
+      if (link.stage) free(link.stage, part[link.src].q);
+    }
+    for (auto& p : part) {
+      free(p.cur, p.q);
+      free(p.next, p.q);
+    }
+
+    bench.report();
+    return result;
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+}
@@ -1,22 +1,31 @@
 #ifdef USE_MPI
 #include <mpi.h>
 #endif
+#include <omp.h>
 
 // Global variables, defined here
 bool run_tracker = false;
 bool run_mpitracker = false;
 pid_t	thispid;
 int	mpi_rank = -1;
+int	queuemode = 0;
+int	allocmode = 0;
+int	graphmode = 0;
+long	hostwork_us = 50000;	/* host work overlapped with each twork, in us */
+
+static double hostwork_ipus = 0.;	/* calibrated host work loop iterations per us */
 
 hrtime_t starttime;
 
 /*==================================================================*/
 /* Routine to set up the run*/
-/*	process arguments to extract values for nn and niter */
+/*	process arguments to extract values for nn, niter, omp_num_t, queuemode, */
+/*	allocmode, graphmode, hostwork_us and the USM pool switch */
 /*	check for environment variable "RUN_TRACKER" */
 /*	If USE_MPI is defined, call MPI_Init */
 
 static void Print_Usage(void);
+static void calibratehostwork(void);
 
 static char hostname[1024];
 
@@ -94,6 +103,30 @@ setup_run(int argcc, char **argvv)
   	case 'I':
   	    niter = num;
   	    break;
+
+  	case 'T':
+  	    omp_num_t = num;
+  	    break;
+
+  	case 'Q':
+  	    queuemode = num;
+  	    break;
+
+  	case 'H':
+  	    hostwork_us = num;
+  	    break;
+
+  	case 'A':
+  	    allocmode = num;
+  	    break;
+
+  	case 'G':
+  	    graphmode = num;
+  	    break;
+
+  	case 'P':
+  	    set_usm_pool_enabled(num != 0);
+  	    break;
   
   	default:
   	    Print_Usage();
@@ -171,8 +204,10 @@ setup_run(int argcc, char **argvv)
   hrtime_t accttime = gethrtime();
   hrtime_t endtime = gethrtime();
   double  tempus =  (double) (endtime - accttime)  ;
-  fprintf(stderr, "       [%d] overhead of real-time delta measurement: %10.3f ns.\n\n",
+  fprintf(stderr, "       [%d] overhead of real-time delta measurement: %10.3f ns.\n",
     thispid, tempus);
+
+  calibratehostwork();
 }
 
 // Synchronize  multiple MPI processes  -- call MPI_BARRIER
@@ -190,10 +225,106 @@ mpisync()
 #endif
 }
 
+/* Determine the rank within this node, and the number of ranks on it */
+/*	Returns 0 (of 1) when MPI is not used */
+int
+mpilocalrank(int *localsize)
+{
+  int localrank = 0;
+  *localsize = 1;
+#ifdef USE_MPI
+  MPI_Comm nodecomm;
+  int res = MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, mpi_rank,
+    MPI_INFO_NULL, &nodecomm);
+  if (res != MPI_SUCCESS) {
+    fprintf (stderr, "    [%d] ERROR: MPI_Comm_split_type failed for MPI Rank %d, returning %d\n", thispid, mpi_rank, res);
+    exit (0);
+  }
+  MPI_Comm_rank(nodecomm, &localrank);
+  MPI_Comm_size(nodecomm, localsize);
+  MPI_Comm_free(&nodecomm);
+#endif
+  return localrank;
+}
+
+/* Gather one timing (in s) from every rank to rank 0, and report it */
+/*	per rank, with min / max / mean and the imbalance (max / mean - 1) */
+void
+mpireport(const char *label, double value)
+{
+#ifdef USE_MPI
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  double *all = NULL;
+  if (mpi_rank == 0) {
+    all = (double *) calloc(nranks, sizeof(double) );
+  }
+  int res = MPI_Gather(&value, 1, MPI_DOUBLE, all, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if (res != MPI_SUCCESS) {
+    fprintf (stderr, "    [%d] ERROR: MPI_Gather failed for MPI Rank %d, returning %d\n", thispid, mpi_rank, res);
+    exit (0);
+  }
+
+  if (mpi_rank == 0) {
+    double vmin = all[0], vmax = all[0], sum = 0.;
+    for (int r = 0; r < nranks; r++) {
+      fprintf(stderr, "    [%d] %s -- rank %d: %13.9f s\n", thispid, label, r, all[r]);
+      if (all[r] < vmin) vmin = all[r];
+      if (all[r] > vmax) vmax = all[r];
+      sum += all[r];
+    }
+    double mean = sum / nranks;
+    fprintf(stderr, "    [%d] %s -- %d ranks: min %13.9f s, max %13.9f s, mean %13.9f s, imbalance %6.2f%%\n",
+      thispid, label, nranks, vmin, vmax, mean, (mean > 0. ? (vmax / mean - 1.) * 100. : 0.) );
+    free(all);
+  }
+#else
+  fprintf(stderr, "    [%d] %s: %13.9f s\n", thispid, label, value);
+#endif
+}
+
+/* Set up the shared benchmark harness for a front-end, with the run's */
+/*	parameters; $SYCL_SAMPLES_BENCH selects the format and output file */
+Harness
+benchharness(const char *program)
+{
+  Harness bench(program, harness_options_from_env(HarnessOptions()) );
+  bench.set_param("N", nn);
+  bench.set_param("threads", omp_num_t);
+  bench.set_param("queuemode", queuemode);
+  bench.set_param("allocmode", allocmode);
+  bench.set_param("graphmode", graphmode);
+  bench.set_param("usmpool", usm_pool_enabled() ? 1 : 0);
+  bench.set_param("hostwork_us", hostwork_us);
+  if (mpi_rank >= 0) {
+    bench.set_param("rank", mpi_rank);
+  }
+  return bench;
+}
+
+/* Drop the harness's warm-up count of leading iterations, which include */
+/*	JIT compilation, as long as some samples remain; samples holds */
+/*	periter of them per iteration, e.g. one per thread */
+std::vector<double>
+afterwarmup(const Harness &bench, const std::vector<double> &samples, size_t periter)
+{
+  size_t skip = bench.options().warmup * periter;
+  if (samples.size() <= skip) {
+    return samples;
+  }
+  return std::vector<double>(samples.begin() + skip, samples.end() );
+}
+
 static void
 Print_Usage(void)
 {
-  fprintf( stderr, "Usage: <test_name> [-N array_size] [-I iteration_count]\n");
+  fprintf( stderr, "Usage: <test_name> [-N array_size] [-I iteration_count] [-T thread_count] [-Q queue_mode] [-A alloc_mode] [-G graph_mode] [-P pool] [-H host_work_us]\n");
+  fprintf( stderr, "       queue_mode: 0 = one shared queue, 1 = a queue per thread, 2 = a queue per thread on its own sub-device\n");
+  fprintf( stderr, "       alloc_mode: 0 = malloc, 1 = pinned (malloc_host), 2 = malloc registered for device copies\n");
+  fprintf( stderr, "       graph_mode: 0 = submit every kernel, 1 = record the kernel once as a command graph and replay it, 2 = emulated replay\n");
+  fprintf( stderr, "       pool: 0 = twork2/twork3 allocate and free their device arrays every call, 1 = through the caching USM pool\n");
+  fprintf( stderr, "       host_work_us: host compute run while each twork's kernels are in flight (default 50000)\n");
 
   exit(-1);
 
@@ -206,6 +337,14 @@ Print_Usage(void)
 void
 teardown_run(void)
 {
+  if (usm_pool_enabled()) {
+    UsmPoolStats s = usm_pool().stats();
+    fprintf(stderr, "    [%d] USM pool: %zu allocations, %5.1f%% from the cache, %zu from the driver; "
+      "peak %10.1f MiB reserved\n",
+      thispid, s.allocations, 100. * s.hit_rate(), s.driver_allocs,
+      s.peak_reserved / 1048576. );
+  }
+
 #ifdef USE_MPI
   mpitracker();
   MPI_Finalize();
@@ -235,34 +374,25 @@ allocinitdata(int numthreads)
   rptr = (double **) calloc(numthreads, sizeof(double *) );
   lptr = (double **) calloc(numthreads, sizeof(double *) );
   pptr = (double **) calloc(numthreads, sizeof(double *) );
+  pptr4 = (double **) calloc(numthreads, sizeof(double *) );
 
-  /* allocate the l, r, and p arrays for each thread */
+  /* allocate the l, r, p and p4 arrays for each thread; p4 is the one */
+  /*	the twork routines accumulate into */
   for ( int k = 0; k < numthreads; k++) {
 #if 0
     fprintf(stderr, "  [%d] thread %d allocating and initializing data\n", thispid, k );
 #endif
 
     /* allocate and initialize the l and r arrays */
-    lptr[k] = (double *) malloc (nn * sizeof(double) );
-    if(lptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for lptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    lptr[k] = allocarray("lptr", k, false);
     init(lptr[k], nn);
 
-    rptr[k] = (double *) malloc (nn * sizeof(double) );
-    if(rptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for rptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    rptr[k] = allocarray("rptr", k, false);
     init(rptr[k], nn);
 
-    /* allocate and clear the result array */
-    pptr[k] = (double *) calloc(nn, sizeof(double) );
-    if(pptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for pptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    /* allocate and clear the result arrays */
+    pptr[k] = allocarray("pptr", k, true);
+    pptr4[k] = allocarray("pptr4", k, true);
 #if 0
     fprintf(stderr, "  [%d] thread %d finished allocating and initializing data\n", thispid, k );
 #endif
@@ -286,13 +416,60 @@ allocinitdata(int numthreads)
 #endif
 }
 
+/* free every thread's arrays, whichever of l, r and p..p4 the */
+/*	front-end allocated, and the pointer arrays; after the last use of */
+/*	the queues' arrays, while the queues are still alive */
+void
+freedata(int numthreads)
+{
+  double **all[] = { lptr, rptr, pptr, pptr2, pptr3, pptr4 };
+  for (double **arrays : all) {
+    if (arrays == NULL) {
+      continue;
+    }
+    for ( int k = 0; k < numthreads; k++) {
+      if (arrays[k] != NULL) {
+        freearray(arrays[k], k);
+      }
+    }
+    free(arrays);
+  }
+  lptr = rptr = pptr = pptr2 = pptr3 = pptr4 = NULL;
+}
+
+/* number of threads the host loops below get: all of them from serial */
+/*	code, one when called from a thread that is already in a parallel */
+/*	region (each OpenMP front-end thread then touches its own arrays) */
+static int
+hostthreads(void)
+{
+  return omp_in_parallel() ? 1 : omp_get_max_threads();
+}
+
 /* initialize a double array with each element set to its index */
+/*	The pages are first touched here, with the same static schedule as */
+/*	checkdata() uses, so each page lands on the NUMA node of the thread */
+/*	that later reads it */
 void
 init(double *pp, size_t size)
 {
+  hrtime_t t0 = gethrtime();
+#pragma omp parallel for simd schedule(static)
   for (size_t i = 0; i < size; ++i) {
     pp[i] = (double) (i+1);
   }
+  fprintf(stderr, "      [%d] init of %zu elements: %10.3f ms, %d host thread%s\n",
+    thispid, size, (gethrtime() - t0) / 1.e6, hostthreads(), (hostthreads() == 1 ? "" : "s") );
+}
+
+/* clear a double array, first-touching it like init() */
+void
+initzero(double *pp, size_t size)
+{
+#pragma omp parallel for simd schedule(static)
+  for (size_t i = 0; i < size; ++i) {
+    pp[i] = 0.;
+  }
 }
 
 /* write out various elements from a double array, with a label */
@@ -310,25 +487,79 @@ output( int threadnum, double *p, size_t size, const char *label)
 void
 checkdata(int threadnum, double *p, size_t size)
 {
-  int cnt = 0;
-  for( int m = 0; m < size; m++) {
-    /* check that the elements of the p array are all the same */
-    if (p[m] != p[0])  {
-      if ( cnt < 5) {
-        fprintf(stderr, "    [%d] ==> ERROR -- thread %d: p[%d] (=%g) != p[0] (=%g)\n",
-          thispid, threadnum, m, p[m], p[0]);
+  hrtime_t t0 = gethrtime();
+  const double p0 = p[0];
+  size_t cnt = 0;
+
+  /* check that the elements of the p array are all the same */
+#pragma omp parallel for simd schedule(static) reduction(+:cnt)
+  for (size_t m = 0; m < size; m++) {
+    cnt += (p[m] != p0);
+  }
+
+  /* only on failure: go back for the first few bad elements */
+  if (cnt != 0) {
+    size_t shown = 0;
+    for (size_t m = 0; m < size && shown < 5; m++) {
+      if (p[m] != p0)  {
+        fprintf(stderr, "    [%d] ==> ERROR -- thread %d: p[%zu] (=%g) != p[0] (=%g)\n",
+          thispid, threadnum, m, p[m], p0);
+        shown ++;
       }
-      cnt ++;
     }
   }
+  double checkms = (gethrtime() - t0) / 1.e6;
+
   // print the count of errors
   if (cnt != 0) {
-    fprintf(stderr, "      [%d] ==> ERROR count -- thread %d: %d;  good count = %d\n",
-      thispid, threadnum, cnt, (int)size - cnt);
+    fprintf(stderr, "      [%d] ==> ERROR count -- thread %d: %zu;  good count = %zu; check %10.3f ms\n",
+      thispid, threadnum, cnt, size - cnt, checkms);
   } else {
-    fprintf(stderr, "      [%d] all good -- thread %d:  good count = %d\n",
-      thispid, threadnum, (int)size - cnt);
+    fprintf(stderr, "      [%d] all good -- thread %d:  good count = %zu; check %10.3f ms, %d host thread%s\n",
+      thispid, threadnum, size - cnt, checkms, hostthreads(), (hostthreads() == 1 ? "" : "s") );
+  }
+}
+
+/* burn CPU which will be visible in the traced callstacks */
+static void
+hostworkloop(long long count)
+{
+  volatile float	x = 0.0;	/* temp variable for f.p. calculation */
+
+  for (long long j = 0; j < count; j++) {
+    x = x + 1.0;
+  }
+}
+
+/* Measure how many iterations of the host work loop run per us */
+/*	Doubles the count until one run takes at least 20 ms */
+static void
+calibratehostwork(void)
+{
+  long long count = 1000000;
+  hrtime_t t;
+
+  for (;;) {
+    hrtime_t t0 = gethrtime();
+    hostworkloop(count);
+    t = gethrtime() - t0;
+    if (t >= 20000000) break;
+    count *= 2;
   }
+  hostwork_ipus = (double) count * 1000. / (double) t;
+  fprintf(stderr, "       [%d] host work calibrated: %10.1f iterations per us\n\n",
+    thispid, hostwork_ipus);
+}
+
+/* Run host compute for about us microseconds; returns the time it took, in ns */
+hrtime_t
+hostwork(long us)
+{
+  hrtime_t t0 = gethrtime();
+  if (us > 0) {
+    hostworkloop( (long long) (us * hostwork_ipus) );
+  }
+  return gethrtime() - t0;
 }
 
 void
@@ -336,7 +567,7 @@ spacer(int timems, bool spin )
 {
   if (spin == false ){ 
     // convert the integer millisecond argument to a timespec
-    const struct timespec tspec = {0, (long) timems * 10000000 };
+    const struct timespec tspec = {timems / 1000, (long) (timems % 1000) * 1000000 };
 
     // sleep for that amount of time
     int ret = nanosleep( &tspec, NULL);
@@ -345,19 +576,7 @@ spacer(int timems, bool spin )
     }
 
   } else {
-    // burn CPU which will be visible in the traced callstacks
-
-    int	j,k;	/* temp values for loops */
-    volatile float	x;	/* temp variable for f.p. calculation */
-    long long count = 0;
-
-    for (k= 0; k < 50; k++) {
-      x = 0.0;
-      for(j=0; j<1000000; j++) {
-        x = x + 1.0;
-      }
-      count++;
-    }
+    hostwork( (long) timems * 1000 );
   }
 }
 
@@ -1,4 +1,12 @@
 #include <sycl/sycl.hpp>
+#include <vector>
+#include "minitest.h"
 using namespace sycl;
 
 queue q4;
+
+/* per-thread queues, set up by initqueues(); tq[k] is used by thread k */
+queue *tq;
+
+/* kernel-chain windows recorded by each thread, see recordspan() */
+std::vector<std::vector<kernelspan>> kspans;
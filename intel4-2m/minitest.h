@@ -13,6 +13,12 @@
 #include <time.h>
 
 #include <sycl/sycl.hpp>
+#include <vector>
+
+#include "cmdgraph.h"
+#include "harness.h"
+#include "roofline.h"
+#include "usm_pool.h"
 
 extern size_t nn;
 extern int omp_num_t;
@@ -29,27 +35,89 @@ extern double **pptr4;
 using namespace sycl;
 extern sycl::queue q4;
 
+/* per-thread queues: thread k submits to tq[k] */
+/*	queue mode 0: every thread shares q4 */
+/*	queue mode 1: one queue per thread on q4's device, in q4's context */
+/*	queue mode 2: one queue per thread on its own sub-device (tile) */
+extern sycl::queue *tq;
+extern int queuemode;
+
+/* host compute, in us, run by each twork while its kernels are in flight */
+extern long hostwork_us;
+
+/* how the host data arrays are allocated, see allocarray() */
+/*	0: malloc, 1: pinned with sycl::malloc_host, 2: malloc + registered */
+extern int allocmode;
+
+/* how the twork routines submit their 10 identical kernels */
+/*	0: one submit each, 1: recorded once as a command graph and replayed, */
+/*	2: the same with the emulated replay list, see common/cmdgraph.h */
+extern int graphmode;
+
+/* device-time window of one chain of kernels, in ns of the device clock */
+struct kernelspan {
+  unsigned long long start;
+  unsigned long long end;
+  int launches;
+};
+extern std::vector<std::vector<kernelspan>> kspans;
+
 extern bool run_post_rept;
 
 extern void setup_run(int argc, char** argv);
 extern void mpisync(void);
+extern int mpilocalrank(int *localsize);
+extern void mpireport(const char *label, double value);
 extern void teardown_run(void);
+
+/* shared benchmark harness, set up with the run's parameters, and the */
+/*	samples left once its warm-up count of leading iterations, of */
+/*	periter samples each, is dropped */
+extern Harness benchharness(const char *program);
+extern std::vector<double> afterwarmup(const Harness &bench, const std::vector<double> &samples, size_t periter = 1);
  
 extern void allocinitdata(int numthreads);
+extern void freedata(int numthreads);
 extern void init(double *pp, size_t size);
+extern void initzero(double *pp, size_t size);
 extern void output( int threadnum, double *p, size_t size, const char *label );
 extern void checkdata( int threadnum, double *p, size_t size );
 extern void spacer(int time, bool spin);
 
 /* routine to determine if GPU is available, and how many devices */
 void initgpu();
+/* routine to create the per-thread queues, according to queuemode */
+void initqueues(int numthreads);
+/* host array allocation for thread k, according to allocmode */
+double *allocarray(const char *name, int k, bool clear);
+void freearray(double *p, int k);
+const char *allocmodename();
+const char *graphmodename();
 
 /* routine to do the off-loaded work on the GPU */
+/*	twork: buffers + host_accessor; twork2: USM + events; */
+/*	twork3: USM, checking batch i while batch i+1 runs */
 void twork(int iter, int threadnum);
 void twork2(int iter, int threadnum);
 void twork3(int iter, int threadnum);
 
+/* per-phase timing helpers for the twork routines */
+double devicespan(sycl::event &first, sycl::event &last);
+void recordspan(int threadnum, sycl::event &first, sycl::event &last, int launches);
+void phasereport(const char *label, int iter, int threadnum,
+  double submit, double wait, double check, double device, double total);
+void transferreport(const char *label, int iter, int threadnum,
+  size_t h2dbytes, double h2d, size_t d2hbytes, double d2h);
+void overlapreport(const char *label, int iter, int threadnum,
+  double host, double device, double elapsed);
+/* FLOPs and compulsory bytes of one accumulation kernel launch */
+KernelCost tworkcost(size_t nelements);
+void rooflinereport(const char *label, int iter, int threadnum,
+  int launches, double device);
+
 /* Timing routines */
 typedef long long  hrtime_t;
 extern hrtime_t gethrtime();
 extern hrtime_t gethrvtime();
+/* calibrated host compute of about us microseconds; returns its duration in ns */
+extern hrtime_t hostwork(long us);
@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+#include "minitest.h"
+
+double **lptr;
+double **rptr;
+double **pptr;
+double **pptr2;
+double **pptr3;
+double **pptr4;
+
+/* Parameters governing the size of the test */
+#define        N 10000000      /* size of the data arrays used */
+#define        NITER 1         /* number of iterations performed by each thread */
+
+size_t nn = N;
+int niter = NITER;
+int omp_num_t = 0;             /* 0: use omp_get_max_threads() */
+
+/* report per-thread and aggregate throughput, and whether the kernel
+   chains of different threads overlapped on the device */
+/*	Device timestamps are only comparable between queues on the same
+ *	device; with queue mode 2 they are assumed to share the root device's
+ *	clock, which holds for the tiles of one GPU */
+static void
+reportthroughput(int iter, double wall, double *threadtime)
+{
+  std::vector<kernelspan> all;
+  double launchestotal = 0.;
+
+  for (int k = 0; k < omp_num_t; k++) {
+    double launches = 0.;
+    for (const kernelspan &s : kspans[k]) {
+      launches += s.launches;
+      all.push_back(s);
+    }
+    launchestotal += launches;
+    fprintf(stderr, "    [%d] iteration %d, thread %d: %d kernel launches in %10.6f s, %10.3f Melem/s\n",
+      thispid, iter, k, (int) launches, threadtime[k],
+      launches * (double) nn / threadtime[k] / 1.e6 );
+  }
+  fprintf(stderr, "    [%d] iteration %d, aggregate: %d kernel launches in %10.6f s, %10.3f Melem/s\n",
+    thispid, iter, (int) launchestotal, wall, launchestotal * (double) nn / wall / 1.e6 );
+
+  /* busy = sum of the chain windows; covered = length of their union */
+  std::sort(all.begin(), all.end(),
+    [](const kernelspan &a, const kernelspan &b) { return a.start < b.start; });
+  double busy = 0., covered = 0.;
+  unsigned long long curstart = 0, curend = 0;
+  for (size_t i = 0; i < all.size(); i++) {
+    busy += (double) (all[i].end - all[i].start);
+    if (i == 0 || all[i].start > curend) {
+      covered += (double) (curend - curstart);
+      curstart = all[i].start;
+      curend = all[i].end;
+    } else {
+      curend = std::max(curend, all[i].end);
+    }
+  }
+  covered += (double) (curend - curstart);
+
+  if (covered > 0.) {
+    fprintf(stderr, "    [%d] iteration %d, device: kernel chains %10.3f ms, covering %10.3f ms; concurrency %5.2f (%s)\n",
+      thispid, iter, busy / 1.e6, covered / 1.e6, busy / covered,
+      (busy > covered * 1.01 ? "threads overlap" : "threads serialized") );
+  }
+}
+
+int
+main(int argc, char **argv, char **envp)
+{
+  /* setup_run -- parse the arguments, to reset N, NITER, threads and queue mode */
+  setup_run(argc, argv);
+
+  /* check number and accessibility of GPU devices */
+  initgpu();
+
+  if (omp_num_t <= 0) {
+    omp_num_t = omp_get_max_threads();
+  }
+  fprintf(stderr, "    [%d] This test will use %d CPU threads with data array size = %ld; for %d iterations\n\n",
+    thispid, omp_num_t, nn, niter );
+
+  /* one queue per thread, or a shared one, according to -Q */
+  initqueues(omp_num_t);
+
+  fprintf(stderr, "    [%d] using %s host arrays\n", thispid, allocmodename() );
+  fprintf(stderr, "    [%d] kernel submission: %s\n", thispid, graphmodename() );
+  fprintf(stderr, "    [%d] twork2/twork3 device arrays: %s\n", thispid,
+    (usm_pool_enabled() ? "USM pool" : "allocated per call") );
+
+  /* the same l, r and p arrays per thread as the other front-ends, */
+  /*	and the p4 arrays the twork routines accumulate into */
+  allocinitdata(omp_num_t);
+
+  double *threadtime = (double *) calloc(omp_num_t, sizeof(double) );
+
+  /* perform the number of iterations requested */
+  fprintf(stderr, "  [%d] start %d iteration%s\n", thispid, niter, (niter ==1 ? "" : "s") );
+  hrtime_t loopstart = gethrtime();
+  std::vector<double> itertimes, threadtimes;
+  for (int it = 0; it < niter; it++) {
+    for (int k = 0; k < omp_num_t; k++) {
+      kspans[k].clear();
+    }
+
+    hrtime_t wallstart = gethrtime();
+#pragma omp parallel num_threads(omp_num_t)
+    {
+      int k = omp_get_thread_num();
+      hrtime_t t0 = gethrtime();
+      twork(it, k );
+      twork2(it, k );
+      twork3(it, k );
+      threadtime[k] = (double) (gethrtime() - t0) / (double)1000000000.;
+    }
+    double wall = (double) (gethrtime() - wallstart) / (double)1000000000.;
+    itertimes.push_back(wall * 1.e3);
+    for (int k = 0; k < omp_num_t; k++) {
+      threadtimes.push_back(threadtime[k] * 1.e3);
+    }
+
+    reportthroughput(it, wall, threadtime);
+    mpisync();
+  }
+  fprintf(stderr, "  [%d] end %d iteration%s\n", thispid, niter,  (niter ==1 ? "" : "s") );
+  mpireport("iteration loop time", (double) (gethrtime() - loopstart) / (double)1000000000.);
+
+  /* statistical summary of the iteration and per-thread times, from one rank */
+  Harness bench = benchharness("intel4-2m_omp");
+  bench.record("iteration", afterwarmup(bench, itertimes) );
+  bench.record("thread", afterwarmup(bench, threadtimes, omp_num_t) );
+  if (mpi_rank <= 0) {
+    bench.report();
+  }
+
+  freedata(omp_num_t);
+  free(threadtime);
+  teardown_run();
+
+  return 0;
+}
+
+#include "maincommon.cc"
@@ -33,8 +33,14 @@ main(int argc, char **argv, char **envp)
   omp_num_t = 1;
   fprintf(stderr, "    [%d] This test will use a single CPU thread with data array size = %ld; for %d iterations\n\n",
     thispid, nn, niter );
+  initqueues(omp_num_t);
 
-  /* Allocate and initialize data */
+  /* Allocate and initialize data, after the queues: pinned arrays belong */
+  /*	to the context of their thread's queue */
+  fprintf(stderr, "    [%d] using %s host arrays\n", thispid, allocmodename() );
+  fprintf(stderr, "    [%d] kernel submission: %s\n", thispid, graphmodename() );
+  fprintf(stderr, "    [%d] twork2/twork3 device arrays: %s\n", thispid,
+    (usm_pool_enabled() ? "USM pool" : "allocated per call") );
 
   /* allocate pointer arrays for the threads */
   rptr = (double **) calloc(omp_num_t, sizeof(double *) );
@@ -46,57 +52,34 @@ main(int argc, char **argv, char **envp)
 
   for ( int k = 0; k < omp_num_t; k++) {
     /* allocate and initialize the l and r arrays */
-    lptr[k] = (double *) malloc (nn * sizeof(double) );
-    if(lptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for lptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    lptr[k] = allocarray("lptr", k, false);
     init(lptr[k], nn);
 
-    rptr[k] = (double *) malloc (nn * sizeof(double) );
-    if(rptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for rptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    rptr[k] = allocarray("rptr", k, false);
     init(rptr[k], nn);
 
-    /* allocate and clear the result array */
-    pptr[k] = (double *) calloc(nn, sizeof(double) );
-    if(pptr[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for pptr[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
-
-    pptr2[k] = (double *) calloc(nn, sizeof(double) );
-    if(pptr2[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for pptr2[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
-
-    pptr3[k] = (double *) calloc(nn, sizeof(double) );
-    if(pptr3[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for pptr2[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
-
-    pptr4[k] = (double *) calloc(nn, sizeof(double) );
-    if(pptr4[k] == NULL) {
-      fprintf(stderr, "[%d] Allocation for pptr2[%d] failed; aborting\n", thispid, k);
-      abort();
-    }
+    /* allocate and clear the result arrays */
+    pptr[k] = allocarray("pptr", k, true);
+    pptr2[k] = allocarray("pptr2", k, true);
+    pptr3[k] = allocarray("pptr3", k, true);
+    pptr4[k] = allocarray("pptr4", k, true);
   }
 
   /* perform the number of iterations requested */
   fprintf(stderr, "  [%d] start %d iteration%s\n", thispid, niter, (niter ==1 ? "" : "s") );
+  hrtime_t loopstart = gethrtime();
+  std::vector<double> itertimes;
   for (int k = 0; k < niter; k++) {
 #if 0
     fprintf(stderr, "    [%d] start iteration %d\n", thispid, k);
 #endif
+    hrtime_t iterstart = gethrtime();
     {
       twork(k, 0 );
       twork2(k, 0 );
       twork3(k, 0 );
     }
+    itertimes.push_back( (gethrtime() - iterstart) / 1.e6);
     mpisync();
 #if 0
     fprintf(stderr, "  [%d] end     iteration %d\n", thispid, k);
@@ -104,6 +87,21 @@ main(int argc, char **argv, char **envp)
   }
   fprintf(stderr, "  [%d] end %d iteration%s\n", thispid, niter,  (niter ==1 ? "" : "s") );
 
+  /* per-rank loop time, and device time summed over all kernel chains */
+  double devicetime = 0.;
+  for (const kernelspan &s : kspans[0]) {
+    devicetime += (double) (s.end - s.start) / (double)1000000000.;
+  }
+  mpireport("iteration loop time", (double) (gethrtime() - loopstart) / (double)1000000000.);
+  mpireport("device kernel time", devicetime);
+
+  /* statistical summary of the iteration times, from one rank */
+  Harness bench = benchharness("intel4-2m_single");
+  bench.record("iteration", afterwarmup(bench, itertimes) );
+  if (mpi_rank <= 0) {
+    bench.report();
+  }
+
   /* write out various elements in each thread's result array */
   // for (int k = 0; k < omp_num_t; k++) {
   //   output(k, pptr[k], nn, "result p array");
@@ -125,6 +123,7 @@ main(int argc, char **argv, char **envp)
   //   checkdata(k, pptr4[k], nn );
   // }
 
+  freedata(omp_num_t);
   teardown_run();
 
   return 0;
@@ -2,6 +2,8 @@
 // This code performs GPU offloading using sycl.
 // =============================================================
 #include "minitest.h"
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <string>
@@ -9,54 +11,169 @@
 #define kkmax 2000
 // sycl::default_selector d_selector;
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    }
-    catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
+/* device time covered by a chain of kernels, from the start of the first
+   to the end of the last, in ms; all queues are created with profiling enabled */
+double
+devicespan(event &first, event &last)
+{
+  auto start = first.get_profiling_info<info::event_profiling::command_start>();
+  auto end = last.get_profiling_info<info::event_profiling::command_end>();
+  return (double) (end - start) / (double)1000000.;
+}
+
+/* remember the device-time window of a chain of launches by threadnum,
+   so the front-end can tell whether kernels of different threads overlap */
+void
+recordspan(int threadnum, event &first, event &last, int launches)
+{
+  kernelspan span;
+  span.start = first.get_profiling_info<info::event_profiling::command_start>();
+  span.end = last.get_profiling_info<info::event_profiling::command_end>();
+  span.launches = launches;
+  kspans[threadnum].push_back(span);
+}
+
+/* print the per-phase timings of one twork call, all in ms */
+void
+phasereport(const char *label, int iter, int threadnum,
+  double submit, double wait, double check, double device, double total)
+{
+  fprintf(stderr, "    [%d] %s iteration %d, thread %d: submit %10.3f ms, wait %10.3f ms, "
+    "check %10.3f ms, device %10.3f ms, total %10.3f ms\n",
+    thispid, label, iter, threadnum, submit, wait, check, device, total);
+}
+
+/* report host-to-device and device-to-host copy bandwidth, in GB/s */
+/*	h2d and d2h are the device-side copy times, in ms */
+void
+transferreport(const char *label, int iter, int threadnum,
+  size_t h2dbytes, double h2d, size_t d2hbytes, double d2h)
+{
+  fprintf(stderr, "    [%d] %s iteration %d, thread %d: %s host arrays, transfer h2d %10.3f ms (%8.3f GB/s), "
+    "d2h %10.3f ms (%8.3f GB/s)\n",
+    thispid, label, iter, threadnum, allocmodename(),
+    h2d, (h2d > 0. ? h2dbytes / h2d / 1.e6 : 0.),
+    d2h, (d2h > 0. ? d2hbytes / d2h / 1.e6 : 0.) );
+}
+
+/* report how much of the host work was hidden behind the device work */
+/*	Run one after the other, host and device would take host + device ms;
+ *	perfectly overlapped, max(host, device).  elapsed is the time from the
+ *	end of submission to the results being ready, so "hidden" is
+ *	host + device - elapsed, and the ratio compares it to the ideal
+ *	min(host, device).  Device work that started during submission counts
+ *	as hidden, so short submissions give the most accurate figure. */
+void
+overlapreport(const char *label, int iter, int threadnum,
+  double host, double device, double elapsed)
+{
+  double hidden = host + device - elapsed;
+  double ideal = std::min(host, device);
+
+  fprintf(stderr, "    [%d] %s iteration %d, thread %d: host work %10.3f ms, device %10.3f ms, "
+    "hidden %10.3f ms of %10.3f ms ideal; overlap %6.1f%%\n",
+    thispid, label, iter, threadnum, host, device, hidden, ideal,
+    (ideal > 0. ? 100. * hidden / ideal : 0.) );
+}
 
+/* one launch of the accumulation kernel on nelements: kkmax rounds of two
+   divides and two adds per element, in double.  p is read and written once,
+   and each work-item reads the same kkmax elements of l and r */
+KernelCost
+tworkcost(size_t nelements)
+{
+  KernelCost cost;
+  cost.flops = 4. * kkmax * nelements;
+  cost.bytes = 2. * nelements * sizeof(double) + 2. * kkmax * sizeof(double);
+  return cost;
+}
+
+/* report where a chain of launches kernels, taking device ms of device
+   time, sits under the roofline of the thread's device */
+void
+rooflinereport(const char *label, int iter, int threadnum,
+  int launches, double device)
+{
+  RooflinePoint point = roofline(tworkcost(nn) * launches, device,
+    measure_peaks(tq[threadnum]), Precision::kDouble);
+
+  fprintf(stderr, "    [%d] %s iteration %d, thread %d: %d launches, %s\n",
+    thispid, label, iter, threadnum, launches, format_roofline(point).c_str() );
+}
+
+/* twork -- buffers and accessors; the result is read back through an
+   explicit host_accessor, so the wait for the device is visible and timed
+   instead of being hidden in the buffer destructors */
 void
 twork( int iter, int threadnum)
 {
   hrtime_t starttime = gethrtime();
 
-  int nelements = nn;
+  size_t nelements = nn;
   double *l1 = lptr[threadnum];
   double *r1 = rptr[threadnum];
   double *p1 = pptr4[threadnum];
+  queue &q = tq[threadnum];
 
-  // Create buffers that hold the data shared between the host and the devices.
-  // The buffer destructor is responsible to copy the data back to host when it
-  // goes out of scope.
-  buffer<double, 1> a(l1, nn);
-  buffer<double, 1> b(r1, nn);
-  buffer<double, 1> c(p1, nn);
+  {
+    // with pinned or registered arrays, let the buffers work on them
+    // directly instead of on a runtime-allocated host copy
+    property_list props;
+    if (allocmode != 0) {
+      props = property_list{property::buffer::use_host_ptr()};
+    }
+    buffer<double, 1> a(l1, nn, props);
+    buffer<double, 1> b(r1, nn, props);
+    buffer<double, 1> c(p1, nn, props);
 
-  for (int i = 0; i < 10; i++) {
-    q4.submit([&](handler &h) {
+    auto kernel = [&](handler &h) {
       accessor d_l1(a, h, read_only);
       accessor d_r1(b, h, read_only);
-      accessor d_p1(c, h, write_only);
+      accessor d_p1(c, h, read_write);
       h.parallel_for(nelements, [=](auto i) {
         for (int kk = 0 ; kk < kkmax ; kk++ ) {
-          d_p1[i] = d_p1[i] + d_l1[nelements - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
+          d_p1[i] = d_p1[i] + d_l1[nelements - 1 - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
         }
       } );
-    } );
-  }
+    };
+
+    // with -G, the kernel is recorded once and replayed; recording and
+    // finalizing count as submission time.  Declared after the buffers,
+    // so it goes before they do
+    std::unique_ptr<CommandGraph> graph;
+    if (graphmode != 0) {
+      graph.reset(new CommandGraph(q, graphmode == 2));
+      graph->add(kernel);
+      graph->finalize();
+    }
 
-  for (int k = 0; k < omp_num_t; k++) {
-    output(k, pptr4[k], nn, "result p4 array");
-    checkdata(k, pptr4[k], nn );
+    event first, last;
+    for (int i = 0; i < 10; i++) {
+      last = graph ? graph->replay() : q.submit(kernel);
+      if (i == 0) first = last;
+    }
+    hrtime_t submittime = gethrtime();
+
+    // host compute while the kernels run
+    hrtime_t hostns = hostwork(hostwork_us);
+    hrtime_t hosttime = gethrtime();
+
+    // blocks until all kernels writing c are done, and makes c host-visible
+    host_accessor h_p1(c, read_only);
+    hrtime_t waittime = gethrtime();
+
+    output(threadnum, h_p1.get_pointer(), nn, "result p4 array");
+    checkdata(threadnum, h_p1.get_pointer(), nn );
+    hrtime_t checktime = gethrtime();
+
+    phasereport("twork ", iter, threadnum,
+      (submittime - starttime) / 1.e6, (waittime - hosttime) / 1.e6,
+      (checktime - waittime) / 1.e6, devicespan(first, last),
+      (checktime - starttime) / 1.e6);
+    overlapreport("twork ", iter, threadnum,
+      hostns / 1.e6, devicespan(first, last), (waittime - submittime) / 1.e6);
+    rooflinereport("twork ", iter, threadnum, 10, devicespan(first, last));
+    recordspan(threadnum, first, last, 10);
   }
 
   hrtime_t endtime = gethrtime();
@@ -65,15 +182,61 @@ twork( int iter, int threadnum)
  fprintf(stderr, "    [%d] Completed iteration %d, thread %d in %13.9f s.\n",
    thispid, iter, threadnum, tempus);
 #endif
-  spacer(50, true);
 
 }
 
+/* pick the device for this process; with several ranks on a node, each */
+/*	rank gets its own root device, or its own tile when there are more */
+/*	ranks than root devices -- no ZE_AFFINITY_MASK needed */
+static device
+rankdevice()
+{
+  int localsize;
+  int localrank = mpilocalrank(&localsize);
+
+  device defdev(default_selector_v);
+  if (localsize == 1) {
+    return defdev;
+  }
+
+  /* devices of the same type and platform as the default one, e.g. */
+  /*	the GPUs of one backend, or the CPUs when running with */
+  /*	ONEAPI_DEVICE_SELECTOR=opencl:cpu; with a GPU visible through */
+  /*	both Level Zero and OpenCL, the ranks must not split over both */
+  std::vector<device> candidates = defdev.get_platform().get_devices(
+    defdev.get_info<info::device::device_type>());
+
+  if (localsize > (int) candidates.size() && defdev.is_gpu()) {
+    std::vector<device> tiles;
+    for (const auto &root : candidates) {
+      try {
+        auto sub = root.create_sub_devices<
+            info::partition_property::partition_by_affinity_domain>(
+            info::partition_affinity_domain::next_partitionable);
+        tiles.insert(tiles.end(), sub.begin(), sub.end());
+      } catch (exception const &e) {
+        tiles.push_back(root);
+      }
+    }
+    candidates = tiles;
+  }
+
+  if (localsize > (int) candidates.size()) {
+    fprintf(stderr, "    [%d] WARNING: %d ranks on this node share %zu devices\n",
+      thispid, localsize, candidates.size() );
+  }
+  fprintf(stderr, "    [%d] MPI Rank %d is local rank %d of %d, using device %d of %zu\n",
+    thispid, mpi_rank, localrank, localsize,
+    (int) (localrank % candidates.size()), candidates.size() );
+
+  return candidates[localrank % candidates.size()];
+}
+
 void
 initgpu()
 {
   try {
-    queue origq4(exception_handler, property::queue::enable_profiling{});
+    queue origq4(rankdevice(), harness_exception_handler, property::queue::enable_profiling{});
 
     // Print out the device information used for the kernel code.
     std::cout << "    [" << thispid << "] running on device: "
@@ -86,3 +249,147 @@ initgpu()
     std::terminate();
   }
 }
+
+void
+initqueues(int numthreads)
+{
+  tq = new queue[numthreads];
+  kspans.assign(numthreads, std::vector<kernelspan>());
+
+  std::vector<device> tiles;
+  if (queuemode == 2) {
+    try {
+      tiles = q4.get_device().create_sub_devices<
+          info::partition_property::partition_by_affinity_domain>(
+          info::partition_affinity_domain::next_partitionable);
+    } catch (exception const &e) {
+      fprintf(stderr, "    [%d] device cannot be partitioned (%s); using one queue per thread on the device\n",
+        thispid, e.what() );
+      queuemode = 1;
+    }
+  }
+
+  try {
+    if (queuemode == 2) {
+      /* one context across the tiles, so allocations stay usable on all of them */
+      context tilectx(tiles);
+      for (int k = 0; k < numthreads; k++) {
+        device dev = tiles[k % tiles.size()];
+        tq[k] = queue(tilectx, dev, harness_exception_handler, property::queue::enable_profiling{});
+      }
+      fprintf(stderr, "    [%d] %d threads, one queue each on %zu sub-devices\n",
+        thispid, numthreads, tiles.size() );
+    } else if (queuemode == 1) {
+      for (int k = 0; k < numthreads; k++) {
+        tq[k] = queue(q4.get_context(), q4.get_device(), harness_exception_handler,
+          property::queue::enable_profiling{});
+      }
+      fprintf(stderr, "    [%d] %d threads, one queue each on the device\n",
+        thispid, numthreads );
+    } else {
+      for (int k = 0; k < numthreads; k++) {
+        tq[k] = q4;
+      }
+      fprintf(stderr, "    [%d] %d thread%s sharing one queue\n",
+        thispid, numthreads, (numthreads == 1 ? "" : "s") );
+    }
+  } catch (exception const &e) {
+    std::cout << "An exception is caught trying to create the thread queues.\n";
+    std::terminate();
+  }
+  /* peaks of every device in use, measured now rather than by the first */
+  /*	rooflinereport() while other threads' kernels are running */
+  std::vector<device> measured;
+  for (int k = 0; k < numthreads; k++) {
+    device dev = tq[k].get_device();
+    if (std::find(measured.begin(), measured.end(), dev) != measured.end()) {
+      continue;
+    }
+    measured.push_back(dev);
+    DevicePeaks peaks = measure_peaks(tq[k]);
+    fprintf(stderr, "    [%d] device peaks, queue %d: %10.1f GFLOP/s fp32, %10.1f GFLOP/s fp64, %8.1f GB/s\n",
+      thispid, k, peaks.fp32_gflops, peaks.fp64_gflops, peaks.gbps );
+  }
+}
+
+const char *
+allocmodename()
+{
+  switch (allocmode) {
+    case 1:
+      return "pinned (malloc_host)";
+    case 2:
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+      return "registered malloc";
+#else
+      /* allocarray() cannot register without the extension */
+      return "malloc (not registered: no sycl_ext_oneapi_copy_optimize)";
+#endif
+    default:
+      return "malloc";
+  }
+}
+
+const char *
+graphmodename()
+{
+  if (graphmode == 0) {
+    return "eager, one submit per kernel";
+  }
+  if (graphmode == 1 && native_graphs_supported(q4.get_device())) {
+    return "command graph replay";
+  }
+  return "emulated graph replay";
+}
+
+/* allocate one of thread k's host arrays, according to allocmode; */
+/*	abort on failure.  Must be called after initqueues(), since pinned */
+/*	and registered memory belong to the context of the thread's queue */
+/*	allocmode 0: plain malloc; the runtime stages copies through its own */
+/*		pinned memory */
+/*	allocmode 1: sycl::malloc_host; copies DMA directly from the array */
+/*	allocmode 2: malloc, then registered with the driver where the */
+/*		sycl_ext_oneapi_copy_optimize extension is available */
+double *
+allocarray(const char *name, int k, bool clear)
+{
+  size_t bytes = nn * sizeof(double);
+  double *p = NULL;
+
+  if (allocmode == 1) {
+    p = malloc_host<double>(nn, tq[k]);
+  } else {
+    p = (double *) malloc(bytes);
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+    if (p != NULL && allocmode == 2) {
+      ext::oneapi::experimental::prepare_for_device_copy(p, bytes, tq[k]);
+    }
+#endif
+  }
+  if(p == NULL) {
+    fprintf(stderr, "[%d] Allocation for %s[%d] failed; aborting\n", thispid, name, k);
+    abort();
+  }
+  /* clear through initzero() rather than calloc, so the pages are */
+  /*	first touched by the threads that use them */
+  if (clear) {
+    initzero(p, nn);
+  }
+  return p;
+}
+
+/* free an array from allocarray() */
+void
+freearray(double *p, int k)
+{
+  if (allocmode == 1) {
+    free(p, tq[k]);
+    return;
+  }
+#ifdef SYCL_EXT_ONEAPI_COPY_OPTIMIZE
+  if (allocmode == 2) {
+    ext::oneapi::experimental::release_from_device_copy(p, tq[k]);
+  }
+#endif
+  ::free(p);
+}
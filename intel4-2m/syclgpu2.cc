@@ -2,6 +2,8 @@
 // This code performs GPU offloading using sycl.
 // =============================================================
 #include "minitest.h"
+#include <algorithm>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <string>
@@ -10,72 +12,125 @@
 #define kkmax 2000
 // sycl::default_selector d_selector;
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    }
-    catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
+#define NBATCH 2   /* batches of 10 kernels in the pipelined twork3: the 20 */
+                   /*	kernels and two checks twork3 has always run */
+
+/* submit the 10 accumulation kernels on device (USM) arrays, chained by
+   events after deps; returns the last kernel's event, *first gets the first.
+   With a graph, the kernel is recorded into it on the first call and every
+   launch is a replay; the caller keeps the graph for as long as the arrays */
+static event
+submitkernels(queue &q, double *d_l1, double *d_r1, double *d_p1, size_t nelements,
+  std::vector<event> deps, event *first, CommandGraph *graph)
+{
+  auto kernel = [=](handler &h) {
+    h.parallel_for(nelements, [=](auto i) {
+      for (int kk = 0 ; kk < kkmax ; kk++ ) {
+        d_p1[i] = d_p1[i] + d_l1[nelements - 1 - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
+      }
+    } );
+  };
+  if (graph != NULL && graph->size() == 0) {
+    graph->add(kernel);
+    graph->finalize();
+  }
+
+  event last;
+  for (int i = 0; i < 10; i++) {
+    if (graph != NULL) {
+      last = graph->replay(deps);
+    } else {
+      last = q.submit([&](handler &h) {
+        h.depends_on(deps);
+        kernel(h);
+      } );
     }
+    if (i == 0) *first = last;
+    deps = {last};
   }
-};
+  return last;
+}
 
+/* the command graph for a twork's kernels under -G, or none */
+static std::unique_ptr<CommandGraph>
+makegraph(queue &q)
+{
+  if (graphmode == 0) {
+    return nullptr;
+  }
+  return std::unique_ptr<CommandGraph>(new CommandGraph(q, graphmode == 2));
+}
+
+/* twork2 -- USM device arrays; copies and kernels are ordered by events and
+   the host waits on the copy-back event before checking the result.
+   With -P 1 the arrays come from the USM pool, so only the first call on
+   each queue pays for the driver allocations */
 void
 twork2( int iter, int threadnum)
 {
   hrtime_t starttime = gethrtime();
 
-  int nelements = nn;
+  size_t nelements = nn;
+  size_t bytes = nn * sizeof(double);
   double *l1 = lptr[threadnum];
   double *r1 = rptr[threadnum];
   double *p1 = pptr4[threadnum];
-
-  buffer<double, 1> a(l1, nn);
-  buffer<double, 1> b(r1, nn);
-  buffer<double, 1> c(p1, nn);
-
-  // run kernel 10 times
-  for (int i = 0; i < 10; i++) {
-    q4.submit([&](handler &h) {
-      accessor d_l1(a, h, read_only);
-      accessor d_r1(b, h, read_only);
-      accessor d_p1(c, h, write_only);
-      h.parallel_for(nelements, [=](auto i) {
-        for (int kk = 0 ; kk < kkmax ; kk++ ) {
-          d_p1[i] = d_p1[i] + d_l1[nelements - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
-        }
-      } );
-    } );
+  queue &q = tq[threadnum];
+
+  double *d_l1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  double *d_r1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  double *d_p1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  if (d_l1 == NULL || d_r1 == NULL || d_p1 == NULL) {
+    fprintf(stderr, "[%d] Device allocation in twork2 failed; aborting\n", thispid);
+    abort();
   }
 
-  for (int k = 0; k < omp_num_t; k++) {
-    output(k, pptr4[k], nn, "result p4 array");
-    checkdata(k, pptr4[k], nn );
+  std::vector<event> copies = {
+    q.memcpy(d_l1, l1, bytes),
+    q.memcpy(d_r1, r1, bytes),
+    q.memcpy(d_p1, p1, bytes) };
+
+  std::unique_ptr<CommandGraph> graph = makegraph(q);
+  event first;
+  event last = submitkernels(q, d_l1, d_r1, d_p1, nelements, copies, &first, graph.get());
+  event back = q.memcpy(p1, d_p1, bytes, last);
+  hrtime_t submittime = gethrtime();
+
+  // host compute while the copies and kernels run
+  hrtime_t hostns = hostwork(hostwork_us);
+  hrtime_t hosttime = gethrtime();
+
+  back.wait();
+  hrtime_t waittime = gethrtime();
+
+  output(threadnum, p1, nn, "result p4 array");
+  checkdata(threadnum, p1, nn );
+  hrtime_t checktime = gethrtime();
+
+  unsigned long long h2dstart = copies[0].get_profiling_info<info::event_profiling::command_start>();
+  unsigned long long h2dend = copies[0].get_profiling_info<info::event_profiling::command_end>();
+  for (event &e : copies) {
+    h2dstart = std::min(h2dstart, (unsigned long long) e.get_profiling_info<info::event_profiling::command_start>());
+    h2dend = std::max(h2dend, (unsigned long long) e.get_profiling_info<info::event_profiling::command_end>());
   }
-
-  for (int i = 0; i < 10; i++) {
-    q4.submit([&](handler &h) {
-      accessor d_l1(a, h, read_only);
-      accessor d_r1(b, h, read_only);
-      accessor d_p1(c, h, write_only);
-      h.parallel_for(nelements, [=](auto i) {
-        for (int kk = 0 ; kk < kkmax ; kk++ ) {
-          d_p1[i] = d_p1[i] + d_l1[nelements - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
-        }
-      } );
-    } );
-  }
-
-  for (int k = 0; k < omp_num_t; k++) {
-    output(k, pptr4[k], nn, "result p4 array");
-    checkdata(k, pptr4[k], nn );
-  }
-
+  transferreport("twork2", iter, threadnum,
+    3 * bytes, (h2dend - h2dstart) / 1.e6, bytes, devicespan(back, back));
+
+  phasereport("twork2", iter, threadnum,
+    (submittime - starttime) / 1.e6, (waittime - hosttime) / 1.e6,
+    (checktime - waittime) / 1.e6, devicespan(first, last),
+    (checktime - starttime) / 1.e6);
+  /* the wait covers the whole chain, from the first copy in to the copy */
+  /*	back, so the device side of the overlap does too */
+  unsigned long long backend = back.get_profiling_info<info::event_profiling::command_end>();
+  overlapreport("twork2", iter, threadnum,
+    hostns / 1.e6, (backend - h2dstart) / 1.e6, (waittime - submittime) / 1.e6);
+  rooflinereport("twork2", iter, threadnum, 10, devicespan(first, last));
+  recordspan(threadnum, first, last, 10);
+
+  usm_free(d_l1, q);
+  usm_free(d_r1, q);
+  usm_free(d_p1, q);
 
   hrtime_t endtime = gethrtime();
   double  tempus =  (double) (endtime - starttime) / (double)1000000000.;
@@ -83,62 +138,89 @@ twork2( int iter, int threadnum)
  fprintf(stderr, "    [%d] Completed iteration %d, thread %d in %13.9f s.\n",
    thispid, iter, threadnum, tempus);
 #endif
-  spacer(50, true);
 
 }
 
-
+/* twork3 -- pipelined: NBATCH batches of 10 kernels; the result of batch b
+   is copied to one of two pinned host staging arrays and checked on the
+   host while batch b+1 runs on the device */
 void
 twork3( int iter, int threadnum)
 {
   hrtime_t starttime = gethrtime();
 
-  int nelements = nn;
+  size_t nelements = nn;
+  size_t bytes = nn * sizeof(double);
   double *l1 = lptr[threadnum];
   double *r1 = rptr[threadnum];
   double *p1 = pptr4[threadnum];
-
-  buffer<double, 1> a(l1, nn);
-  buffer<double, 1> b(r1, nn);
-  buffer<double, 1> c(p1, nn);
-
-  // run kernel 10 times
-  for (int i = 0; i < 10; i++) {
-    q4.submit([&](handler &h) {
-      accessor d_l1(a, h, read_only);
-      accessor d_r1(b, h, read_only);
-      accessor d_p1(c, h, write_only);
-      h.parallel_for(nelements, [=](auto i) {
-        for (int kk = 0 ; kk < kkmax ; kk++ ) {
-          d_p1[i] = d_p1[i] + d_l1[nelements - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
-        }
-      } );
-    } );
+  queue &q = tq[threadnum];
+
+  double *d_l1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  double *d_r1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  double *d_p1 = usm_malloc<double>(nn, usm::alloc::device, q);
+  double *stage[2] = { usm_malloc<double>(nn, usm::alloc::host, q),
+    usm_malloc<double>(nn, usm::alloc::host, q) };
+  if (d_l1 == NULL || d_r1 == NULL || d_p1 == NULL || stage[0] == NULL || stage[1] == NULL) {
+    fprintf(stderr, "[%d] Allocation in twork3 failed; aborting\n", thispid);
+    abort();
   }
 
-  for (int k = 0; k < omp_num_t; k++) {
-    output(k, pptr4[k], nn, "result p4 array");
-    checkdata(k, pptr4[k], nn );
-  }
+  std::vector<event> deps = {
+    q.memcpy(d_l1, l1, bytes),
+    q.memcpy(d_r1, r1, bytes),
+    q.memcpy(d_p1, p1, bytes) };
+
+  event first, batchfirst, last;
+  event copied[NBATCH];
+
+  /* every batch runs the same kernel on the same arrays, so one recording */
+  /*	serves all NBATCH * 10 launches */
+  std::unique_ptr<CommandGraph> graph = makegraph(q);
+  last = submitkernels(q, d_l1, d_r1, d_p1, nelements, deps, &first, graph.get());
+  copied[0] = q.memcpy(stage[0], d_p1, bytes, last);
+
+  hrtime_t submit = gethrtime() - starttime;
+  hrtime_t wait = 0, check = 0, hidden = 0;
+
+  for (int b = 0; b < NBATCH; b++) {
+    hrtime_t t0 = gethrtime();
+    /* the next batch overwrites d_p1, so it waits for this batch's copy-out */
+    if (b + 1 < NBATCH) {
+      last = submitkernels(q, d_l1, d_r1, d_p1, nelements, {copied[b]}, &batchfirst, graph.get());
+      copied[b + 1] = q.memcpy(stage[(b + 1) % 2], d_p1, bytes, last);
+    }
+    hrtime_t t1 = gethrtime();
 
-  for (int i = 0; i < 10; i++) {
-    q4.submit([&](handler &h) {
-      accessor d_l1(a, h, read_only);
-      accessor d_r1(b, h, read_only);
-      accessor d_p1(c, h, write_only);
-      h.parallel_for(nelements, [=](auto i) {
-        for (int kk = 0 ; kk < kkmax ; kk++ ) {
-          d_p1[i] = d_p1[i] + d_l1[nelements - kk] / double(kkmax) + d_r1[kk] / double(kkmax);
-        }
-      } );
-    } );
-  }
+    copied[b].wait();
+    hrtime_t t2 = gethrtime();
 
-  for (int k = 0; k < omp_num_t; k++) {
-    output(k, pptr4[k], nn, "result p4 array");
-    checkdata(k, pptr4[k], nn );
-  }
+    output(threadnum, stage[b % 2], nn, "result p4 array");
+    checkdata(threadnum, stage[b % 2], nn );
+    hrtime_t t3 = gethrtime();
 
+    submit += t1 - t0;
+    wait += t2 - t1;
+    check += t3 - t2;
+    if (b + 1 < NBATCH) hidden += t3 - t2;
+  }
+  memcpy(p1, stage[(NBATCH - 1) % 2], bytes);
+  hrtime_t checktime = gethrtime();
+
+  phasereport("twork3", iter, threadnum,
+    submit / 1.e6, wait / 1.e6, check / 1.e6, devicespan(first, last),
+    (checktime - starttime) / 1.e6);
+  /* the device span includes the copy-outs between batches */
+  rooflinereport("twork3", iter, threadnum, 10 * NBATCH, devicespan(first, last));
+  recordspan(threadnum, first, last, 10 * NBATCH);
+  fprintf(stderr, "    [%d] twork3 iteration %d, thread %d: %d batches, %10.3f ms of %10.3f ms checking overlapped with device work\n",
+    thispid, iter, threadnum, NBATCH, hidden / 1.e6, check / 1.e6);
+
+  usm_free(d_l1, q);
+  usm_free(d_r1, q);
+  usm_free(d_p1, q);
+  usm_free(stage[0], q);
+  usm_free(stage[1], q);
 
   hrtime_t endtime = gethrtime();
   double  tempus =  (double) (endtime - starttime) / (double)1000000000.;
@@ -146,6 +228,5 @@ twork3( int iter, int threadnum)
  fprintf(stderr, "    [%d] Completed iteration %d, thread %d in %13.9f s.\n",
    thispid, iter, threadnum, tempus);
 #endif
-  spacer(50, true);
 
 }
@@ -0,0 +1,410 @@
+#include "gemm.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "autotune.h"
+#include "usm_pool.h"
+
+class GemmDirectKernel;
+class GemmSplitKKernel;
+class GemmSplitKReduceKernel;
+class GemmSplitKAtomicKernel;
+template <size_t S>
+class GemmGemvKernel;
+template <size_t S>
+class GemmSkinnyKernel;
+
+namespace {
+
+using CommandGroup = std::function<void(sycl::handler&)>;
+
+// Sub-groups per work-group of the gemv and skinny kernels, one row each
+constexpr size_t kRowsPerGroup = 8;
+
+size_t ceil_div(size_t a, size_t b) { return (a + b - 1) / b; }
+
+CommandGroup direct_command(const GemmShape& shape, const float* a,
+                            const float* b, float* c) {
+  size_t m = shape.m;
+  size_t n = shape.n;
+  size_t k = shape.k;
+  return [=](sycl::handler& h) {
+    h.parallel_for<GemmDirectKernel>(
+        sycl::range<2>(m, n), [=](sycl::id<2> idx) {
+          size_t row = idx[0];
+          size_t col = idx[1];
+          float sum = 0.0f;
+          for (size_t i = 0; i < k; i++) {
+            sum += a[row * k + i] * b[i * n + col];
+          }
+          c[row * n + col] = sum;
+        });
+  };
+}
+
+// One sub-group per row of a: lane l takes elements l, l + S, ... of the
+// row, so the sub-group reads it in contiguous S-wide pieces.
+CommandGroup gemv_command(const GemmShape& shape, size_t sub_group_size,
+                          const float* a, const float* b, float* c) {
+  size_t m = shape.m;
+  size_t k = shape.k;
+  return [=](sycl::handler& h) {
+    with_sub_group_size(sub_group_size, [&](auto size) {
+      constexpr size_t S = decltype(size)::value;
+      if constexpr (S != 0) {
+        sycl::nd_range<1> range(ceil_div(m, kRowsPerGroup) * kRowsPerGroup * S,
+                                kRowsPerGroup * S);
+        h.parallel_for<GemmGemvKernel<S>>(
+            range,
+            [=](sycl::nd_item<1> item) [[sycl::reqd_sub_group_size(S)]] {
+              sycl::sub_group sg = item.get_sub_group();
+              size_t row = item.get_group(0) * kRowsPerGroup +
+                           sg.get_group_linear_id();
+              if (row >= m) return;
+              size_t lane = sg.get_local_linear_id();
+              float sum = 0.0f;
+              for (size_t i = lane; i < k; i += S) {
+                sum += a[row * k + i] * b[i];
+              }
+              sum = sycl::reduce_over_group(sg, sum, sycl::plus<float>());
+              if (lane == 0) c[row] = sum;
+            });
+      }
+    });
+  };
+}
+
+// One sub-group per row of c. The row of a is loaded once, lane l holding
+// elements l, l + S, ... in registers; element i is then broadcast from
+// its lane while every lane accumulates its own column of b, S columns of
+// c at a time.
+CommandGroup skinny_command(const GemmShape& shape, size_t sub_group_size,
+                            const float* a, const float* b, float* c) {
+  size_t m = shape.m;
+  size_t n = shape.n;
+  size_t k = shape.k;
+  return [=](sycl::handler& h) {
+    with_sub_group_size(sub_group_size, [&](auto size) {
+      constexpr size_t S = decltype(size)::value;
+      if constexpr (S != 0) {
+        constexpr size_t kRegisters = kSkinnyMaxDepth / S;
+        sycl::nd_range<1> range(ceil_div(m, kRowsPerGroup) * kRowsPerGroup * S,
+                                kRowsPerGroup * S);
+        h.parallel_for<GemmSkinnyKernel<S>>(
+            range,
+            [=](sycl::nd_item<1> item) [[sycl::reqd_sub_group_size(S)]] {
+              sycl::sub_group sg = item.get_sub_group();
+              size_t row = item.get_group(0) * kRowsPerGroup +
+                           sg.get_group_linear_id();
+              if (row >= m) return;
+              size_t lane = sg.get_local_linear_id();
+
+              float a_row[kRegisters];
+#pragma unroll
+              for (size_t r = 0; r < kRegisters; r++) {
+                size_t i = r * S + lane;
+                a_row[r] = i < k ? a[row * k + i] : 0.0f;
+              }
+
+              // Every lane runs every iteration, so the broadcasts stay
+              // uniform; lanes past n just do not store
+              for (size_t base = 0; base < n; base += S) {
+                size_t col = base + lane;
+                bool active = col < n;
+                float sum = 0.0f;
+#pragma unroll
+                for (size_t r = 0; r < kRegisters; r++) {
+                  if (r * S >= k) break;
+                  size_t left = k - r * S;
+                  size_t lanes = left < S ? left : S;
+                  for (size_t l = 0; l < lanes; l++) {
+                    float a_i = sycl::group_broadcast(sg, a_row[r], l);
+                    if (active) sum += a_i * b[(r * S + l) * n + col];
+                  }
+                }
+                if (active) c[row * n + col] = sum;
+              }
+            });
+      }
+    });
+  };
+}
+
+// Chunk s of k covers [s * depth, min(k, (s + 1) * depth)); partial sums
+// go to partial[s][row][col], which the reduction adds up in chunk order.
+sycl::event gemm_split_k_workspace(sycl::queue& q, const GemmShape& shape,
+                                   size_t splits, const float* a,
+                                   const float* b, float* c,
+                                   const std::vector<sycl::event>& deps) {
+  size_t m = shape.m;
+  size_t n = shape.n;
+  size_t k = shape.k;
+  size_t depth = ceil_div(k, splits);
+  float* partial =
+      usm_malloc<float>(splits * m * n, sycl::usm::alloc::device, q);
+  if (!partial) throw std::runtime_error("Split-k workspace allocation failed");
+
+  sycl::event partials = q.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    h.parallel_for<GemmSplitKKernel>(
+        sycl::range<3>(splits, m, n), [=](sycl::id<3> idx) {
+          size_t s = idx[0];
+          size_t row = idx[1];
+          size_t col = idx[2];
+          size_t begin = s * depth;
+          size_t end = std::min(k, begin + depth);
+          float sum = 0.0f;
+          for (size_t i = begin; i < end; i++) {
+            sum += a[row * k + i] * b[i * n + col];
+          }
+          partial[(s * m + row) * n + col] = sum;
+        });
+  });
+
+  size_t elements = m * n;
+  sycl::event reduced = q.submit([&](sycl::handler& h) {
+    h.depends_on(partials);
+    h.parallel_for<GemmSplitKReduceKernel>(
+        sycl::range<1>(elements), [=](sycl::id<1> idx) {
+          size_t e = idx[0];
+          float sum = 0.0f;
+          for (size_t s = 0; s < splits; s++) {
+            sum += partial[s * elements + e];
+          }
+          c[e] = sum;
+        });
+  });
+
+  usm_free(partial, q, reduced);
+  return reduced;
+}
+
+sycl::event gemm_split_k_atomic(sycl::queue& q, const GemmShape& shape,
+                                size_t splits, const float* a, const float* b,
+                                float* c,
+                                const std::vector<sycl::event>& deps) {
+  size_t n = shape.n;
+  size_t k = shape.k;
+  size_t depth = ceil_div(k, splits);
+
+  sycl::event zeroed = q.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    h.fill(c, 0.0f, shape.m * n);
+  });
+
+  return q.submit([&](sycl::handler& h) {
+    h.depends_on(zeroed);
+    h.parallel_for<GemmSplitKAtomicKernel>(
+        sycl::range<3>(splits, shape.m, n), [=](sycl::id<3> idx) {
+          size_t s = idx[0];
+          size_t row = idx[1];
+          size_t col = idx[2];
+          size_t begin = s * depth;
+          size_t end = std::min(k, begin + depth);
+          float sum = 0.0f;
+          for (size_t i = begin; i < end; i++) {
+            sum += a[row * k + i] * b[i * n + col];
+          }
+          sycl::atomic_ref<float, sycl::memory_order::relaxed,
+                           sycl::memory_scope::device,
+                           sycl::access::address_space::global_space>
+              out(c[row * n + col]);
+          out.fetch_add(sum);
+        });
+  });
+}
+
+}  // namespace
+
+std::string to_string(const GemmShape& shape) {
+  return std::to_string(shape.m) + "x" + std::to_string(shape.n) + "x" +
+         std::to_string(shape.k);
+}
+
+KernelCost gemm_cost(const GemmShape& shape) {
+  KernelCost cost;
+  cost.flops = 2.0 * shape.m * shape.n * shape.k;
+  cost.bytes = sizeof(float) * (double(shape.m) * shape.k +
+                                double(shape.k) * shape.n +
+                                double(shape.m) * shape.n);
+  return cost;
+}
+
+const char* to_string(GemmAlgorithm algorithm) {
+  switch (algorithm) {
+    case GemmAlgorithm::kDirect:
+      return "direct";
+    case GemmAlgorithm::kSplitK:
+      return "split-k";
+    case GemmAlgorithm::kGemv:
+      return "gemv";
+    case GemmAlgorithm::kSkinny:
+      return "skinny";
+  }
+  return "unknown";
+}
+
+const char* to_string(SplitKReduction reduction) {
+  switch (reduction) {
+    case SplitKReduction::kWorkspace:
+      return "workspace";
+    case SplitKReduction::kAtomic:
+      return "atomic";
+  }
+  return "unknown";
+}
+
+GemmAlgorithm parse_gemm_algorithm(const std::string& name) {
+  if (name == "direct") return GemmAlgorithm::kDirect;
+  if (name == "split-k") return GemmAlgorithm::kSplitK;
+  if (name == "gemv") return GemmAlgorithm::kGemv;
+  if (name == "skinny") return GemmAlgorithm::kSkinny;
+  throw std::invalid_argument("Unknown GEMM algorithm: " + name);
+}
+
+SplitKReduction parse_split_k_reduction(const std::string& name) {
+  if (name == "workspace") return SplitKReduction::kWorkspace;
+  if (name == "atomic") return SplitKReduction::kAtomic;
+  throw std::invalid_argument("Unknown split-k reduction: " + name);
+}
+
+std::string to_string(const GemmPlan& plan) {
+  std::string s = to_string(plan.algorithm);
+  if (plan.algorithm == GemmAlgorithm::kSplitK) {
+    s += " x" + std::to_string(plan.splits) + " (" +
+         to_string(plan.reduction) + ")";
+  }
+  if (plan.algorithm == GemmAlgorithm::kGemv ||
+      plan.algorithm == GemmAlgorithm::kSkinny) {
+    s += " (sub-group " + std::to_string(plan.sub_group_size) + ")";
+  }
+  return s;
+}
+
+const char* to_string(GemmShapeClass shape_class) {
+  switch (shape_class) {
+    case GemmShapeClass::kGemv:
+      return "gemv";
+    case GemmShapeClass::kSkinny:
+      return "skinny";
+    case GemmShapeClass::kSmallOutput:
+      return "small-output";
+    case GemmShapeClass::kGeneral:
+      return "general";
+  }
+  return "unknown";
+}
+
+size_t gemm_parallelism(const sycl::device& device) {
+  // About a work-group's worth of work-items in flight per compute unit
+  // hides memory latency; at least 256 for devices with small groups.
+  size_t units = device.get_info<sycl::info::device::max_compute_units>();
+  size_t group = device.get_info<sycl::info::device::max_work_group_size>();
+  return units * std::max<size_t>(group, 256);
+}
+
+GemmShapeClass classify_gemm(const GemmShape& shape,
+                             const sycl::device& device) {
+  if (shape.n == 1) return GemmShapeClass::kGemv;
+  if (shape.k <= kSkinnyMaxDepth) return GemmShapeClass::kSkinny;
+  if (shape.m * shape.n < gemm_parallelism(device) &&
+      shape.k >= 2 * kMinSplitDepth) {
+    return GemmShapeClass::kSmallOutput;
+  }
+  return GemmShapeClass::kGeneral;
+}
+
+size_t gemm_sub_group_size(const sycl::device& device) {
+  auto sizes = device.get_info<sycl::info::device::sub_group_sizes>();
+  for (size_t preferred : {16, 32, 8}) {
+    if (std::find(sizes.begin(), sizes.end(), preferred) != sizes.end()) {
+      return preferred;
+    }
+  }
+  return 0;
+}
+
+GemmPlan plan_gemm(const GemmShape& shape, const sycl::device& device,
+                   GemmAlgorithm algorithm) {
+  GemmPlan plan;
+  plan.algorithm = algorithm;
+  if (algorithm == GemmAlgorithm::kGemv ||
+      algorithm == GemmAlgorithm::kSkinny) {
+    if (algorithm == GemmAlgorithm::kGemv && shape.n != 1) {
+      throw std::invalid_argument("gemv needs n = 1, not " +
+                                  std::to_string(shape.n));
+    }
+    if (algorithm == GemmAlgorithm::kSkinny && shape.k > kSkinnyMaxDepth) {
+      throw std::invalid_argument("skinny needs k <= " +
+                                  std::to_string(kSkinnyMaxDepth) + ", not " +
+                                  std::to_string(shape.k));
+    }
+    plan.sub_group_size = gemm_sub_group_size(device);
+    if (plan.sub_group_size == 0) {
+      throw std::invalid_argument(std::string(to_string(algorithm)) +
+                                  " needs sub-groups of 8, 16 or 32");
+    }
+    return plan;
+  }
+  if (algorithm != GemmAlgorithm::kSplitK) return plan;
+
+  size_t outputs = std::max<size_t>(1, shape.m * shape.n);
+  size_t wanted = ceil_div(gemm_parallelism(device), outputs);
+  size_t possible = std::max<size_t>(1, shape.k / kMinSplitDepth);
+  plan.splits = std::max<size_t>(1, std::min({wanted, possible, kMaxSplits}));
+  size_t workspace = plan.splits * shape.m * shape.n * sizeof(float);
+  plan.reduction = workspace <= kMaxWorkspaceBytes ? SplitKReduction::kWorkspace
+                                                   : SplitKReduction::kAtomic;
+  return plan;
+}
+
+GemmPlan plan_gemm(const GemmShape& shape, const sycl::device& device) {
+  // Without a usable sub-group size gemv and skinny shapes go to direct
+  bool sub_groups = gemm_sub_group_size(device) != 0;
+  switch (classify_gemm(shape, device)) {
+    case GemmShapeClass::kGemv:
+      if (sub_groups) return plan_gemm(shape, device, GemmAlgorithm::kGemv);
+      break;
+    case GemmShapeClass::kSkinny:
+      if (sub_groups) return plan_gemm(shape, device, GemmAlgorithm::kSkinny);
+      break;
+    case GemmShapeClass::kSmallOutput:
+      return plan_gemm(shape, device, GemmAlgorithm::kSplitK);
+    case GemmShapeClass::kGeneral:
+      break;
+  }
+  return plan_gemm(shape, device, GemmAlgorithm::kDirect);
+}
+
+CommandGroup gemm_command(const GemmPlan& plan, const GemmShape& shape,
+                          const float* a, const float* b, float* c) {
+  switch (plan.algorithm) {
+    case GemmAlgorithm::kDirect:
+      return direct_command(shape, a, b, c);
+    case GemmAlgorithm::kSplitK:
+      if (plan.splits <= 1) return direct_command(shape, a, b, c);
+      break;
+    case GemmAlgorithm::kGemv:
+      return gemv_command(shape, plan.sub_group_size, a, b, c);
+    case GemmAlgorithm::kSkinny:
+      return skinny_command(shape, plan.sub_group_size, a, b, c);
+  }
+  throw std::invalid_argument("split-k is more than one command group");
+}
+
+sycl::event gemm(sycl::queue& q, const GemmPlan& plan, const GemmShape& shape,
+                 const float* a, const float* b, float* c,
+                 const std::vector<sycl::event>& deps) {
+  if (plan.algorithm == GemmAlgorithm::kSplitK && plan.splits > 1) {
+    if (plan.reduction == SplitKReduction::kAtomic) {
+      return gemm_split_k_atomic(q, shape, plan.splits, a, b, c, deps);
+    }
+    return gemm_split_k_workspace(q, shape, plan.splits, a, b, c, deps);
+  }
+  CommandGroup command = gemm_command(plan, shape, a, b, c);
+  return q.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    command(h);
+  });
+}
@@ -0,0 +1,119 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <sycl/sycl.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "roofline.h"
+
+// Runtime-shaped single-precision GEMM for the matmul samples:
+// c(m x n) = a(m x k) * b(k x n), all row-major and packed, in USM of the
+// queue's context.
+struct GemmShape {
+  size_t m = 0;
+  size_t n = 0;
+  size_t k = 0;
+};
+
+std::string to_string(const GemmShape& shape);  // "256x256x65536"
+
+// One multiplication: a multiply and an add per term, and a, b and c each
+// moved once.
+KernelCost gemm_cost(const GemmShape& shape);
+
+// How the work is spread over the device:
+//   direct   one work-item per element of c, looping over all of k
+//   split-k  k cut into chunks; one work-item per element of c and chunk,
+//            the partial sums added up afterwards. For a small c and a
+//            long k, where direct leaves most of the device idle.
+//   gemv     n = 1: a sub-group per row of a, its lanes reading the row
+//            side by side and adding up with a sub-group reduction, so a
+//            (all the traffic there is) streams at full width
+//   skinny   k <= kSkinnyMaxDepth: a sub-group per row of c holding that
+//            row of a in registers, each element broadcast to the lanes
+//            as they work through the row of c a column per lane
+enum class GemmAlgorithm { kDirect, kSplitK, kGemv, kSkinny };
+
+// How split-k adds up its partial sums:
+//   workspace  each chunk writes its own copy of c to a scratch buffer,
+//              and a second kernel sums them in a fixed order
+//   atomic     chunks add into c with float atomics: no scratch, but the
+//              order of the additions, so the rounding, varies by run
+enum class SplitKReduction { kWorkspace, kAtomic };
+
+const char* to_string(GemmAlgorithm algorithm);
+const char* to_string(SplitKReduction reduction);
+// "auto" is not an algorithm; callers check for it before parsing
+GemmAlgorithm parse_gemm_algorithm(const std::string& name);
+SplitKReduction parse_split_k_reduction(const std::string& name);
+
+struct GemmPlan {
+  GemmAlgorithm algorithm = GemmAlgorithm::kDirect;
+  size_t splits = 1;  // chunks of k for split-k
+  SplitKReduction reduction = SplitKReduction::kWorkspace;
+  size_t sub_group_size = 0;  // of gemv and skinny
+};
+
+// "split-k x16 (workspace)", "gemv (sub-group 16)"
+std::string to_string(const GemmPlan& plan);
+
+// What a shape looks like to the planner:
+//   gemv          n = 1, a matrix-vector product: bandwidth-bound on a
+//   skinny        k <= kSkinnyMaxDepth: short dot products, a row of a
+//                 fits in a sub-group's registers
+//   small-output  fewer elements of c than gemm_parallelism() and k of at
+//                 least 2 * kMinSplitDepth
+//   general       everything else
+enum class GemmShapeClass { kGemv, kSkinny, kSmallOutput, kGeneral };
+
+const char* to_string(GemmShapeClass shape_class);
+constexpr size_t kSkinnyMaxDepth = 256;
+GemmShapeClass classify_gemm(const GemmShape& shape,
+                             const sycl::device& device);
+
+// Sub-group size for the gemv and skinny kernels on device: 16 where
+// supported, else 32, else 8; 0 when it supports none of them and those
+// shapes have to go to direct.
+size_t gemm_sub_group_size(const sycl::device& device);
+
+// Work-items it takes to keep every compute unit of device busy: above
+// this many elements of c, direct parallelism is enough.
+size_t gemm_parallelism(const sycl::device& device);
+
+// The plan for shape on device, by its class: gemv and skinny to their
+// kernels, small-output to split-k, general to direct. Split-k cuts k into
+// chunks of at least kMinSplitDepth, as many as bring the work-items up
+// to gemm_parallelism(). Partial sums go to a workspace while it fits in
+// kMaxWorkspaceBytes, through atomics beyond.
+constexpr size_t kMinSplitDepth = 256;
+constexpr size_t kMaxSplits = 64;
+constexpr size_t kMaxWorkspaceBytes = size_t(256) << 20;
+GemmPlan plan_gemm(const GemmShape& shape, const sycl::device& device);
+
+// The plan with algorithm forced, the rest chosen as plan_gemm would. A
+// split-k plan of one chunk, when k is too short to cut, runs as direct.
+// Throws std::invalid_argument when gemv or skinny cannot take the shape
+// or the device.
+GemmPlan plan_gemm(const GemmShape& shape, const sycl::device& device,
+                   GemmAlgorithm algorithm);
+
+// Submits c = a * b to q after deps and returns the event of its last
+// command. The split-k workspace comes from the USM pool and is released
+// against that event; with the pool off it is allocated on every call and
+// freed after waiting for the event, so callers that run split-k more than
+// once turn the pool on.
+sycl::event gemm(sycl::queue& q, const GemmPlan& plan, const GemmShape& shape,
+                 const float* a, const float* b, float* c,
+                 const std::vector<sycl::event>& deps = {});
+
+// The one command group of a plan other than split-k, which takes
+// several: for callers that record their commands, e.g. in a CommandGraph.
+// Throws std::invalid_argument for split-k.
+std::function<void(sycl::handler&)> gemm_command(const GemmPlan& plan,
+                                                 const GemmShape& shape,
+                                                 const float* a,
+                                                 const float* b, float* c);
+
+#endif  // GEMM_H
@@ -1,10 +1,13 @@
 #include <chrono>
-#include <cstring>
 #include <iostream>
 #include <limits>
 #include <random>
 #include <sycl/sycl.hpp>
 
+#include "harness.h"
+#include "topology.h"
+#include "usm_policy.h"
+
 constexpr int m_size = 2200 * 8;
 constexpr int M = m_size / 8;
 constexpr int N = m_size / 4;
@@ -13,25 +16,13 @@ constexpr int ITERATIONS = 10;
 constexpr int VERIFICATION_SAMPLES =
     2000;  // Number of random samples to verify
 
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const& e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const& e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 void matmul(sycl::queue& q, float (*a)[N], float (*b)[P], float (*c)[P]);
 int verifyResultSingle(float (*c_back)[P], bool full_verify = false);
 int verifyResult(std::vector<float (*)[P]>& c_matrices,
                  bool full_verify = false);
 void initializeMatrixA(sycl::queue& q, float (*a)[N]);
 void initializeMatrixB(sycl::queue& q, float (*b)[P]);
+double elapsedMs(std::chrono::high_resolution_clock::time_point start);
 
 int main(int argc, char* argv[]) {
   std::vector<float(*)[N]> a_matrices(2);
@@ -41,25 +32,46 @@ int main(int argc, char* argv[]) {
   std::vector<sycl::device> sub_devices;
 
   bool full_verify = false;
-  if (argc > 1 && std::strcmp(argv[1], "--full-verify") == 0) {
-    full_verify = true;
+  // Hints for the shared matrices, and whether c is migrated back to the
+  // host before verification
+  UsmPolicy policy = UsmPolicy::kNone;
+  bool prefetch_back = false;
+  HarnessOptions harness_options;
+  harness_options.repetitions = ITERATIONS;
+  try {
+    Args args(argc, argv, harness_options);
+    full_verify = args.flag("full-verify");
+    policy = parse_usm_policy(args.get("usm-policy", to_string(policy)));
+    prefetch_back = args.flag("prefetch-back");
+    harness_options = args.harness();
+    args.finish();
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
   }
+  Harness bench("matmul_1gpu_2sub", harness_options);
 
   auto start_time = std::chrono::high_resolution_clock::now();
 
   try {
-    auto l0_selector = [](const sycl::device& dev) {
-      return dev.get_platform().get_backend() == sycl::backend::ext_oneapi_level_zero;
-    };
-
-    sycl::device root_device(l0_selector);
-    std::cout << "Main device: "
-              << root_device.get_info<sycl::info::device::name>() << "\n";
-
-    // Create sub-devices
-    sub_devices = root_device.create_sub_devices<
-        sycl::info::partition_property::partition_by_affinity_domain>(
-        sycl::info::partition_affinity_domain::next_partitionable);
+    // First Level Zero root device, from the cached topology
+    Topology topology = Topology::load();
+    TopologyFilter filter;
+    filter.backend = "level_zero";
+    filter.tiles = false;
+    auto roots = topology.select(topology_filter_from_env(filter));
+    if (roots.empty()) {
+      throw std::runtime_error("No Level Zero device available");
+    }
+    std::cout << "Main device: " << roots[0].name << "\n";
+
+    // Sub-devices of that root device
+    filter.root = roots[0].root;
+    filter.tiles = true;
+    filter.indices.clear();
+    if (topology.roots()[roots[0].root].tiles > 0) {
+      sub_devices = topology.resolve(topology.select(filter));
+    }
 
     if (sub_devices.size() < 2) {
       throw std::runtime_error("Not enough sub-devices available");
@@ -67,7 +79,7 @@ int main(int argc, char* argv[]) {
 
     // Create queues for each sub-device
     for (int i = 0; i < 2; ++i) {
-      queues.emplace_back(sub_devices[i], exception_handler);
+      queues.emplace_back(sub_devices[i], harness_exception_handler);
       std::cout << "Sub-device " << i << ": "
                 << sub_devices[i].get_info<sycl::info::device::name>() << "\n";
     }
@@ -93,19 +105,42 @@ int main(int argc, char* argv[]) {
     std::cout << "Problem size: c(" << M << "," << P << ") = a(" << M << ","
               << N << ") * b(" << N << "," << P << ")\n";
 
-    for (int iter = 0; iter < ITERATIONS; ++iter) {
-      std::cout << "Iteration " << iter + 1 << " of " << ITERATIONS
-                << std::endl;
+    bench.set_param("m", M);
+    bench.set_param("n", N);
+    bench.set_param("p", P);
+    bench.set_param("device", roots[0].name);
+    bench.set_param("usm_policy", to_string(policy));
+
+    // The matrices were initialized on their tiles; the hints matter for
+    // c, which the host has not touched yet, and for reruns after a
+    // verification pulled it back
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<sycl::event> hints;
+    for (int i = 0; i < 2; ++i) {
+      std::vector<UsmRange> ranges = {
+          {a_matrices[i], M * N * sizeof(float), true},
+          {b_matrices[i], N * P * sizeof(float), true},
+          {c_matrices[i], M * P * sizeof(float), false}};
+      for (auto& e : apply_usm_policy(queues[i], policy, ranges)) {
+        hints.push_back(e);
+      }
+    }
+    for (auto& e : hints) e.wait();
+    bench.record("migrate", {elapsedMs(start)});
 
+    auto round = [&]() {
       for (int i = 0; i < 2; ++i) {
-        std::cout << "Executing on sub-device " << i << ": " << "\n";
         matmul(queues[i], a_matrices[i], b_matrices[i], c_matrices[i]);
       }
 
       for (auto& q : queues) {
         q.wait();
       }
-    }
+    };
+    start = std::chrono::high_resolution_clock::now();
+    round();
+    bench.record("first_kernel", {elapsedMs(start)});
+    bench.run("matmul", round);
   } catch (sycl::exception const& e) {
     std::cout << "An exception is caught while multiplying matrices: "
               << e.what() << "\n";
@@ -125,6 +160,14 @@ int main(int argc, char* argv[]) {
   std::cout << "Matrix multiplication time: " << duration.count() / 1000000.0
             << " seconds" << std::endl;
 
+  if (prefetch_back) {
+    auto migrate_start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 2; ++i) {
+      prefetch_to_host({{c_matrices[i], M * P * sizeof(float), false}});
+    }
+    bench.record("migrate_back", {elapsedMs(migrate_start)});
+  }
+
   auto verify_start = std::chrono::high_resolution_clock::now();
   int result = verifyResult(c_matrices, full_verify);
   auto verify_end = std::chrono::high_resolution_clock::now();
@@ -133,6 +176,7 @@ int main(int argc, char* argv[]) {
 
   std::cout << "Verification time: " << verify_duration.count() / 1000000.0
             << " seconds" << std::endl;
+  bench.record("verify", {verify_duration.count() / 1000.0});
 
   // Free USM memory
   for (int i = 0; i < 2; ++i) {
@@ -145,6 +189,8 @@ int main(int argc, char* argv[]) {
             << (duration + verify_duration).count() / 1000000.0 << " seconds"
             << std::endl;
 
+  bench.report();
+
   return result;
 }
 
@@ -223,4 +269,10 @@ void initializeMatrixB(sycl::queue& q, float (*b)[P]) {
   q.parallel_for(sycl::range(N, P), [=](sycl::id<2> index) {
      b[index[0]][index[1]] = index[0] + 1.0f;
    }).wait();
-}
\ No newline at end of file
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
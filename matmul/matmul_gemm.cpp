@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "device_manager.h"
+#include "gemm.h"
+#include "harness.h"
+#include "matio.h"
+#include "roofline.h"
+#include "usm_pool.h"
+
+// c(m x n) = a(m x k) * b(k x n) at shapes given at run time, with the
+// GEMM algorithm the shape classifier picks (--algorithm auto) or a forced
+// one. The default is the shape split-k is for: a small c over a long
+// inner dimension; --n 1 is a GEMV, --k 128 a tall-skinny product.
+//
+// --compare also times the direct kernel on the same data, so the gain of
+// the planned algorithm shows next to it.
+
+constexpr size_t DEFAULT_M = 256;
+constexpr size_t DEFAULT_N = 256;
+constexpr size_t DEFAULT_K = 65536;
+constexpr int VERIFICATION_SAMPLES = 2000;
+
+void initializeMatrix(std::vector<float>& m, size_t seed) {
+  for (size_t i = 0; i < m.size(); ++i) {
+    m[i] = float((i * 37 + seed) % 101) / 101.0f;
+  }
+}
+
+// Sampled check against double-precision dot products of the host inputs.
+int verifyResult(const std::vector<float>& a, const std::vector<float>& b,
+                 const std::vector<float>& c, const GemmShape& shape) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> dis_m(0, shape.m - 1);
+  std::uniform_int_distribution<size_t> dis_n(0, shape.n - 1);
+
+  int mismatch_count = 0;
+  for (int count = 0; count < VERIFICATION_SAMPLES; ++count) {
+    size_t i = dis_m(gen);
+    size_t j = dis_n(gen);
+    double expected = 0.0;
+    double magnitude = 0.0;
+    for (size_t p = 0; p < shape.k; ++p) {
+      double term = double(a[i * shape.k + p]) * b[p * shape.n + j];
+      expected += term;
+      magnitude += std::fabs(term);
+    }
+    // Float sums over k terms: relative to the sum of magnitudes
+    double got = c[i * shape.n + j];
+    if (std::fabs(got - expected) > 1e-3 * std::max(1.0, magnitude)) {
+      if (mismatch_count < 5) {
+        std::cout << "Mismatch at [" << i << "][" << j << "]: Expected "
+                  << expected << ", Got " << got << "\n";
+      }
+      mismatch_count++;
+    }
+  }
+
+  if (mismatch_count == 0) {
+    std::cout << "Success - All verified elements are correct!\n";
+    return 0;
+  }
+  std::cout << "Fail - " << mismatch_count << " of " << VERIFICATION_SAMPLES
+            << " sampled elements differ\n";
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  GemmShape shape{DEFAULT_M, DEFAULT_N, DEFAULT_K};
+  size_t device_index = 0;
+  std::string algorithm = "auto";
+  size_t splits = 0;
+  std::string reduction;
+  bool compare = false;
+  std::vector<std::string> inputs;
+  std::string output;
+  HarnessOptions harness_options;
+  harness_options.repetitions = 20;
+
+  try {
+    Args args(argc, argv, harness_options);
+    shape.m = args.get_int("m", shape.m);
+    shape.n = args.get_int("n", shape.n);
+    shape.k = args.get_int("k", shape.k);
+    device_index = args.get_int("device", device_index);
+    // --algorithm auto|direct|split-k|gemv|skinny; --splits and --reduction
+    // workspace|atomic override what the plan picks for split-k
+    algorithm = args.get("algorithm", algorithm);
+    if (algorithm != "auto") parse_gemm_algorithm(algorithm);
+    splits = args.get_int("splits", splits);
+    reduction = args.get("reduction", reduction);
+    if (!reduction.empty()) parse_split_k_reduction(reduction);
+    compare = args.flag("compare");
+    // --input a,b: float32 matrices from files, the shape taken from them;
+    // --output: c to a file (the harness results go to --report)
+    std::string input = args.get("input", "");
+    if (!input.empty()) inputs = parse_matrix_paths(input, 2);
+    output = args.get("output", output);
+    // Split-k takes its workspace from the USM pool on every call, so the
+    // pool is on unless --no-pool: without it each timed run would
+    // allocate the workspace and wait for the reduction to free it. The
+    // pool waits for the queue before it gives cached blocks back to the
+    // driver, so an out-of-memory retry cannot free a workspace in use.
+    set_usm_pool_enabled(!args.flag("no-pool"));
+    harness_options = args.harness();
+    args.finish();
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
+  }
+
+  try {
+    std::vector<MatrixFile> files;
+    for (const auto& path : inputs) files.push_back(MatrixFile::open(path));
+    if (!files.empty()) {
+      shape = {files[0].rows(), files[1].cols(), files[0].cols()};
+      files[0].expect<float>(shape.m, shape.k);
+      files[1].expect<float>(shape.k, shape.n);
+    }
+    if (shape.m == 0 || shape.n == 0 || shape.k == 0) {
+      throw std::invalid_argument("Sizes must be positive");
+    }
+
+    DeviceManager manager;
+    if (device_index >= manager.size()) {
+      std::cout << "No device " << device_index << ".\n";
+      return -1;
+    }
+    sycl::queue q = manager.make_queue(
+        device_index, harness_exception_handler,
+        sycl::property_list{sycl::property::queue::in_order{}});
+    sycl::device dev = q.get_device();
+    DevicePeaks peaks = measure_peaks(q);
+
+    GemmPlan plan =
+        algorithm == "auto"
+            ? plan_gemm(shape, dev)
+            : plan_gemm(shape, dev, parse_gemm_algorithm(algorithm));
+    if (splits) plan.splits = splits;
+    if (!reduction.empty()) plan.reduction = parse_split_k_reduction(reduction);
+
+    std::cout << "Device: " << manager.info(device_index).name << "\n";
+    print_peaks(std::cout, std::to_string(device_index), peaks);
+    std::cout << "Problem size: c(" << shape.m << "x" << shape.n << ") = a("
+              << shape.m << "x" << shape.k << ") * b(" << shape.k << "x"
+              << shape.n << ")\n";
+    std::cout << "Shape class: " << to_string(classify_gemm(shape, dev))
+              << " (" << shape.m * shape.n << " outputs, "
+              << gemm_parallelism(dev) << " work-items fill the device)\n";
+    std::cout << "Plan: " << to_string(plan) << "\n";
+
+    std::vector<float> a(shape.m * shape.k);
+    std::vector<float> b(shape.k * shape.n);
+    std::vector<float> c(shape.m * shape.n);
+    if (files.empty()) {
+      initializeMatrix(a, 0);
+      initializeMatrix(b, 1);
+    } else {
+      files[0].read_into(q, a.data());
+      files[1].read_into(q, b.data());
+      files.clear();
+    }
+
+    float* a_dev = usm_malloc<float>(a.size(), sycl::usm::alloc::device, q);
+    float* b_dev = usm_malloc<float>(b.size(), sycl::usm::alloc::device, q);
+    float* c_dev = usm_malloc<float>(c.size(), sycl::usm::alloc::device, q);
+    if (!a_dev || !b_dev || !c_dev) {
+      usm_free(a_dev, q);
+      usm_free(b_dev, q);
+      usm_free(c_dev, q);
+      throw std::runtime_error("Device allocation failed");
+    }
+    q.memcpy(a_dev, a.data(), a.size() * sizeof(float));
+    q.memcpy(b_dev, b.data(), b.size() * sizeof(float)).wait();
+
+    Harness bench("matmul_gemm", harness_options);
+    bench.set_param("m", shape.m);
+    bench.set_param("n", shape.n);
+    bench.set_param("k", shape.k);
+    bench.set_param("class", to_string(classify_gemm(shape, dev)));
+    bench.set_param("plan", to_string(plan));
+
+    KernelCost cost = gemm_cost(shape);
+    Stats planned = bench.run(to_string(plan.algorithm), [&]() {
+      gemm(q, plan, shape, a_dev, b_dev, c_dev).wait();
+    });
+    RooflinePoint point = roofline(cost, planned.median, peaks,
+                                   Precision::kFloat);
+    print_roofline(std::cout, to_string(plan), point);
+    annotate_roofline(bench, point);
+
+    q.memcpy(c.data(), c_dev, c.size() * sizeof(float)).wait();
+    int result = verifyResult(a, b, c, shape);
+
+    if (compare && plan.algorithm != GemmAlgorithm::kDirect) {
+      GemmPlan direct = plan_gemm(shape, dev, GemmAlgorithm::kDirect);
+      Stats baseline = bench.run("direct", [&]() {
+        gemm(q, direct, shape, a_dev, b_dev, c_dev).wait();
+      });
+      RooflinePoint direct_point = roofline(cost, baseline.median, peaks,
+                                            Precision::kFloat);
+      print_roofline(std::cout, "direct", direct_point);
+      annotate_roofline(bench, direct_point);
+      std::cout << to_string(plan) << " is "
+                << baseline.median / planned.median << "x direct\n";
+    }
+
+    if (!output.empty()) {
+      save_matrix(output, q, c.data(), shape.m, shape.n);
+      std::cout << "Result written to " << output << "\n";
+    }
+
+    usm_free(a_dev, q);
+    usm_free(b_dev, q);
+    usm_free(c_dev, q);
+    print_usm_pool_stats(std::cout);
+    bench.report();
+    return result;
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+}
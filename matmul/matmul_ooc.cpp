@@ -0,0 +1,532 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "device_manager.h"
+#include "harness.h"
+
+// Out-of-core GEMM: C(m x n) = A(m x k) * B(k x n), row-major floats kept
+// in host memory (pinned, or a memory-mapped file with --file) and
+// streamed through a fixed-size device workspace.
+//
+// C is computed one tile x tile block at a time, each block as a sum over
+// panels of A and B (tile x tile blocks along k). The workspace holds two
+// C blocks, so one can drain to the host while the next accumulates, and
+// as many A/B panel slots as fit, managed least-recently-used. Three
+// in-order queues overlap the work:
+//   load     host -> device panel copies
+//   compute  the block kernels
+//   drain    device -> host copies of finished C blocks
+// and events carry the dependencies between them: a slot is refilled only
+// after the last kernel reading it, a C block is reused only after it has
+// drained.
+//
+// Blocks are visited in a serpentine: along each row of C blocks in
+// alternating directions, and over k in alternating directions from one
+// block to the next. The panels the previous block used last are the ones
+// the next block needs first, so they are still resident.
+//
+// When the whole problem fits on the device, the same kernel also runs in
+// core (one launch over the full matrices) as the baseline the streaming
+// is measured against.
+
+constexpr size_t DEFAULT_SIZE = 8192;
+constexpr size_t DEFAULT_TILE = 1024;
+constexpr size_t DEFAULT_WORKSPACE_MB = 256;
+constexpr int VERIFICATION_SAMPLES = 2000;
+
+class GemmBlockKernel;
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+double elapsedMs(bench_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(bench_clock::now() - start)
+      .count();
+}
+
+// c(m x n) = [c +] a(m x k) * b(k x n); lda, ldb and ldc are row pitches
+// in elements.
+sycl::event gemmBlock(sycl::queue& q, const float* a, size_t lda,
+                      const float* b, size_t ldb, float* c, size_t ldc,
+                      size_t m, size_t n, size_t k, bool accumulate,
+                      const std::vector<sycl::event>& deps) {
+  return q.submit([&](sycl::handler& h) {
+    h.depends_on(deps);
+    h.parallel_for<GemmBlockKernel>(sycl::range<2>(m, n), [=](sycl::id<2> idx) {
+      size_t row = idx[0];
+      size_t col = idx[1];
+      float sum = accumulate ? c[row * ldc + col] : 0.0f;
+
+      for (size_t i = 0; i < k; i++) {
+        sum += a[row * lda + i] * b[i * ldb + col];
+      }
+
+      c[row * ldc + col] = sum;
+    });
+  });
+}
+
+// rows x cols floats between pitched 2D layouts, in one command where
+// sycl_ext_oneapi_memcpy2d is available, row by row otherwise.
+sycl::event copy2d(sycl::queue& q, float* dst, size_t dst_ld, const float* src,
+                   size_t src_ld, size_t rows, size_t cols,
+                   const std::vector<sycl::event>& deps) {
+#ifdef SYCL_EXT_ONEAPI_MEMCPY2D
+  return q.ext_oneapi_memcpy2d(dst, dst_ld * sizeof(float), src,
+                               src_ld * sizeof(float), cols * sizeof(float),
+                               rows, deps);
+#else
+  // In-order queue: the rows run one after another after deps
+  sycl::event last = q.memcpy(dst, src, cols * sizeof(float), deps);
+  for (size_t r = 1; r < rows; ++r) {
+    last = q.memcpy(dst + r * dst_ld, src + r * src_ld, cols * sizeof(float));
+  }
+  return last;
+#endif
+}
+
+// A, B and C in host memory: pinned USM, or one shared mapping of a file
+// laid out as A, B, C. An existing file of the right size is used as it
+// is; otherwise it is created and A and B are filled in.
+struct HostMatrices {
+  float* a = nullptr;
+  float* b = nullptr;
+  float* c = nullptr;
+  void* mapping = nullptr;
+  size_t mapping_bytes = 0;
+};
+
+void fillInputs(HostMatrices& host, size_t m, size_t n, size_t k) {
+  for (size_t i = 0; i < m * k; ++i) host.a[i] = float(i % 7) * 0.25f;
+  for (size_t i = 0; i < k * n; ++i) host.b[i] = float(i % 5) * 0.5f - 1.0f;
+}
+
+HostMatrices allocateHost(sycl::queue& q, size_t m, size_t n, size_t k,
+                          const std::string& file) {
+  HostMatrices host;
+  size_t elements = m * k + k * n + m * n;
+  if (file.empty()) {
+    host.a = sycl::malloc_host<float>(elements, q);
+    if (!host.a) throw std::runtime_error("Pinned host allocation failed");
+    host.b = host.a + m * k;
+    host.c = host.b + k * n;
+    fillInputs(host, m, n, k);
+    return host;
+  }
+
+  size_t bytes = elements * sizeof(float);
+  int fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) throw std::runtime_error("Cannot open " + file);
+  struct stat st;
+  bool reuse = fstat(fd, &st) == 0 && size_t(st.st_size) == bytes;
+  if (!reuse && ftruncate(fd, bytes) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot size " + file);
+  }
+  void* mapping =
+      mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) throw std::runtime_error("Cannot map " + file);
+
+  host.mapping = mapping;
+  host.mapping_bytes = bytes;
+  host.a = static_cast<float*>(mapping);
+  host.b = host.a + m * k;
+  host.c = host.b + k * n;
+  if (!reuse) fillInputs(host, m, n, k);
+  return host;
+}
+
+void freeHost(HostMatrices& host, sycl::queue& q) {
+  if (host.mapping) {
+    munmap(host.mapping, host.mapping_bytes);
+  } else if (host.a) {
+    sycl::free(host.a, q);
+  }
+}
+
+// Which panel a slot holds: a block of A (matrix 0) or B (matrix 1).
+struct PanelKey {
+  int matrix = -1;
+  size_t row = 0;
+  size_t col = 0;
+
+  bool operator==(const PanelKey& o) const {
+    return matrix == o.matrix && row == o.row && col == o.col;
+  }
+};
+
+// Device slots of tile x tile floats holding panels, least recently used
+// evicted first.
+class PanelCache {
+ public:
+  struct Slot {
+    float* data = nullptr;
+    PanelKey key;
+    sycl::event loaded;       // the copy that filled it
+    sycl::event last_reader;  // the last kernel that read it
+    size_t last_use = 0;
+  };
+
+  using Loader = std::function<sycl::event(
+      float* slot, const std::vector<sycl::event>& deps)>;
+
+  PanelCache(sycl::queue& q, size_t slots, size_t tile) : q_(q) {
+    for (size_t i = 0; i < slots; ++i) {
+      Slot slot;
+      slot.data = sycl::malloc_device<float>(tile * tile, q);
+      if (!slot.data) {
+        release();
+        throw std::runtime_error("Workspace allocation failed");
+      }
+      slots_.push_back(slot);
+    }
+  }
+  ~PanelCache() { release(); }
+
+  // The slot holding key, loaded first if it is not resident. Slots used
+  // during the same step are never evicted, so the A and B panels of one
+  // kernel cannot displace each other.
+  Slot& get(const PanelKey& key, size_t step, const Loader& load) {
+    Slot* victim = nullptr;
+    for (auto& slot : slots_) {
+      if (slot.key == key) {
+        slot.last_use = step;
+        ++hits_;
+        return slot;
+      }
+      if (slot.last_use != step &&
+          (!victim || slot.last_use < victim->last_use)) {
+        victim = &slot;
+      }
+    }
+    ++misses_;
+    victim->loaded = load(victim->data, {victim->last_reader});
+    victim->key = key;
+    victim->last_use = step;
+    return *victim;
+  }
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+  // Empties every slot, keeping the memory, for the next multiplication.
+  // The work that used the slots must be complete.
+  void reset() {
+    for (auto& slot : slots_) {
+      slot.key = PanelKey();
+      slot.loaded = sycl::event();
+      slot.last_reader = sycl::event();
+      slot.last_use = 0;
+    }
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+ private:
+  void release() {
+    for (auto& slot : slots_) sycl::free(slot.data, q_);
+    slots_.clear();
+  }
+
+  sycl::queue& q_;
+  std::vector<Slot> slots_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+// Device memory of gemmOutOfCore: the panel cache and two C blocks, one
+// being computed while the other drains. Allocated once and reused by
+// every multiplication, so the timed runs do not include allocation.
+class OocWorkspace {
+ public:
+  OocWorkspace(sycl::queue& load_q, sycl::queue& compute_q, size_t slots,
+               size_t tile)
+      : cache(load_q, slots, tile), compute_q_(compute_q) {
+    for (float*& p : c_blocks) {
+      p = sycl::malloc_device<float>(tile * tile, compute_q);
+    }
+    if (!c_blocks[0] || !c_blocks[1]) {
+      release();
+      throw std::runtime_error("Workspace allocation failed");
+    }
+  }
+  ~OocWorkspace() { release(); }
+  OocWorkspace(const OocWorkspace&) = delete;
+  OocWorkspace& operator=(const OocWorkspace&) = delete;
+
+  PanelCache cache;
+  float* c_blocks[2] = {nullptr, nullptr};
+
+ private:
+  void release() {
+    for (float*& p : c_blocks) {
+      if (p) sycl::free(p, compute_q_);
+      p = nullptr;
+    }
+  }
+
+  sycl::queue& compute_q_;
+};
+
+struct OocStats {
+  size_t h2d_bytes = 0;
+  size_t d2h_bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+};
+
+// One out-of-core multiplication in workspace, starting from an empty
+// panel cache; returns once C is back on the host.
+OocStats gemmOutOfCore(sycl::queue& load_q, sycl::queue& compute_q,
+                       sycl::queue& drain_q, const HostMatrices& host,
+                       size_t m, size_t n, size_t k, size_t tile,
+                       OocWorkspace& workspace) {
+  PanelCache& cache = workspace.cache;
+  float** c_blocks = workspace.c_blocks;
+  cache.reset();
+  sycl::event drained[2];
+
+  size_t mb = (m + tile - 1) / tile;
+  size_t nb = (n + tile - 1) / tile;
+  size_t kb = (k + tile - 1) / tile;
+  OocStats stats;
+  size_t step = 0;
+  size_t block = 0;
+
+  for (size_t i = 0; i < mb; ++i) {
+    size_t rows = std::min(tile, m - i * tile);
+    for (size_t jj = 0; jj < nb; ++jj) {
+      size_t j = i % 2 == 0 ? jj : nb - 1 - jj;
+      size_t cols = std::min(tile, n - j * tile);
+      float* c_block = c_blocks[block % 2];
+
+      sycl::event last;
+      for (size_t kk = 0; kk < kb; ++kk) {
+        size_t p = block % 2 == 0 ? kk : kb - 1 - kk;
+        size_t depth = std::min(tile, k - p * tile);
+        ++step;
+
+        auto& a = cache.get({0, i, p}, step, [&](float* slot, auto deps) {
+          stats.h2d_bytes += rows * depth * sizeof(float);
+          return copy2d(load_q, slot, tile, host.a + i * tile * k + p * tile,
+                        k, rows, depth, deps);
+        });
+        auto& b = cache.get({1, p, j}, step, [&](float* slot, auto deps) {
+          stats.h2d_bytes += depth * cols * sizeof(float);
+          return copy2d(load_q, slot, tile, host.b + p * tile * n + j * tile,
+                        n, depth, cols, deps);
+        });
+
+        std::vector<sycl::event> deps = {a.loaded, b.loaded};
+        if (kk == 0) deps.push_back(drained[block % 2]);
+        last = gemmBlock(compute_q, a.data, tile, b.data, tile, c_block, tile,
+                         rows, cols, depth, kk != 0, deps);
+        a.last_reader = last;
+        b.last_reader = last;
+      }
+
+      drained[block % 2] =
+          copy2d(drain_q, host.c + i * tile * n + j * tile, n, c_block, tile,
+                 rows, cols, {last});
+      stats.d2h_bytes += rows * cols * sizeof(float);
+      ++block;
+    }
+  }
+
+  drain_q.wait_and_throw();
+  compute_q.wait_and_throw();
+  load_q.wait_and_throw();
+  stats.hits = cache.hits();
+  stats.misses = cache.misses();
+  return stats;
+}
+
+// Sampled check against dot products of the host inputs.
+int verifyResult(const HostMatrices& host, size_t m, size_t n, size_t k) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<size_t> dis_m(0, m - 1);
+  std::uniform_int_distribution<size_t> dis_n(0, n - 1);
+
+  int mismatch_count = 0;
+  for (int count = 0; count < VERIFICATION_SAMPLES; ++count) {
+    size_t i = dis_m(gen);
+    size_t j = dis_n(gen);
+    double expected = 0.0;
+    for (size_t p = 0; p < k; ++p) {
+      expected += double(host.a[i * k + p]) * host.b[p * n + j];
+    }
+    double got = host.c[i * n + j];
+    if (std::fabs(got - expected) > 1e-4 * std::max(1.0, std::fabs(expected))) {
+      if (mismatch_count < 5) {
+        std::cout << "Mismatch at [" << i << "][" << j << "]: Expected "
+                  << expected << ", Got " << got << "\n";
+      }
+      mismatch_count++;
+    }
+  }
+
+  if (mismatch_count == 0) {
+    std::cout << "Success - All verified elements are correct!\n";
+    return 0;
+  }
+  std::cout << "Fail - " << mismatch_count << " of " << VERIFICATION_SAMPLES
+            << " sampled elements differ\n";
+  return -1;
+}
+
+int main(int argc, char* argv[]) {
+  size_t m = DEFAULT_SIZE;
+  size_t n = DEFAULT_SIZE;
+  size_t k = DEFAULT_SIZE;
+  size_t tile = DEFAULT_TILE;
+  size_t workspace_mb = DEFAULT_WORKSPACE_MB;
+  size_t device_index = 0;
+  std::string file;
+  bool verify = false;
+  bool incore = true;
+  HarnessOptions harness_options;
+  harness_options.repetitions = 3;
+
+  try {
+    Args args(argc, argv, harness_options);
+    m = args.get_int("m", m);
+    n = args.get_int("n", n);
+    k = args.get_int("k", k);
+    tile = args.get_int("tile", tile);
+    workspace_mb = args.get_int("workspace-mb", workspace_mb);
+    device_index = args.get_int("device", device_index);
+    // --file: matrices in a memory-mapped file instead of pinned memory
+    file = args.get("file", file);
+    verify = args.flag("verify");
+    // --no-incore: skip the in-core baseline even when it would fit
+    incore = !args.flag("no-incore");
+    harness_options = args.harness();
+    args.finish();
+    if (m == 0 || n == 0 || k == 0 || tile == 0) {
+      throw std::invalid_argument("Sizes must be positive");
+    }
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
+  }
+
+  try {
+    DeviceManager manager;
+    if (device_index >= manager.size()) {
+      std::cout << "No device " << device_index << ".\n";
+      return -1;
+    }
+    sycl::property_list in_order{sycl::property::queue::in_order{}};
+    sycl::queue load_q =
+        manager.make_queue(device_index, harness_exception_handler, in_order);
+    sycl::queue compute_q =
+        manager.make_queue(device_index, harness_exception_handler, in_order);
+    sycl::queue drain_q =
+        manager.make_queue(device_index, harness_exception_handler, in_order);
+    sycl::device dev = compute_q.get_device();
+
+    size_t panel_bytes = tile * tile * sizeof(float);
+    size_t workspace = workspace_mb << 20;
+    if (workspace < 6 * panel_bytes) {
+      throw std::runtime_error(
+          "Workspace too small: it needs two C blocks and four panels");
+    }
+    size_t slots = workspace / panel_bytes - 2;
+
+    std::cout << "Device: " << manager.info(device_index).name << "\n";
+    std::cout << "Problem size: c(" << m << "x" << n << ") = a(" << m << "x"
+              << k << ") * b(" << k << "x" << n << ")\n";
+    std::cout << "Host matrices: " << (file.empty() ? "pinned" : file)
+              << "\n";
+    std::cout << "Workspace: " << workspace_mb << " MiB, " << tile << "x"
+              << tile << " blocks, " << slots << " panel slots\n";
+
+    HostMatrices host = allocateHost(compute_q, m, n, k, file);
+    double flops = 2.0 * m * n * k;
+    double min_bytes = sizeof(float) * (double(m) * k + double(k) * n +
+                                        double(m) * n);
+
+    Harness bench("matmul_ooc", harness_options);
+    bench.set_param("m", m);
+    bench.set_param("n", n);
+    bench.set_param("k", k);
+    bench.set_param("tile", tile);
+    bench.set_param("workspace_mb", workspace_mb);
+    bench.set_param("host", file.empty() ? "pinned" : "mmap");
+
+    // The workspace is allocated outside the timed runs, as the in-core
+    // arrays are, and released before those are allocated
+    OocStats ooc;
+    Stats streamed;
+    {
+      OocWorkspace ooc_workspace(load_q, compute_q, slots, tile);
+      streamed = bench.run("out_of_core", [&]() {
+        ooc = gemmOutOfCore(load_q, compute_q, drain_q, host, m, n, k, tile,
+                            ooc_workspace);
+      });
+    }
+    double ooc_gflops = flops / streamed.median / 1e6;
+    bench.annotate("gflops", ooc_gflops);
+
+    std::cout << "Out of core: " << streamed.median << " ms, " << ooc_gflops
+              << " GFLOP/s\n";
+    std::cout << "Traffic: " << ooc.h2d_bytes / 1e9 << " GB in, "
+              << ooc.d2h_bytes / 1e9 << " GB out, "
+              << (ooc.h2d_bytes + ooc.d2h_bytes) / min_bytes
+              << "x the minimum; panel cache hit rate "
+              << 100.0 * ooc.hits / std::max<size_t>(1, ooc.hits + ooc.misses)
+              << "%\n";
+
+    int result = verify ? verifyResult(host, m, n, k) : 0;
+
+    // In-core baseline: everything resident, one launch, no transfers
+    // timed
+    size_t max_alloc = dev.get_info<sycl::info::device::max_mem_alloc_size>();
+    size_t global = dev.get_info<sycl::info::device::global_mem_size>();
+    bool fits = min_bytes < 0.8 * global &&
+                std::max({m * k, k * n, m * n}) * sizeof(float) <= max_alloc;
+    if (incore && !fits) {
+      std::cout << "In core: does not fit on the device, skipped\n";
+    } else if (incore) {
+      float* a = sycl::malloc_device<float>(m * k, compute_q);
+      float* b = sycl::malloc_device<float>(k * n, compute_q);
+      float* c = sycl::malloc_device<float>(m * n, compute_q);
+      if (!a || !b || !c) {
+        std::cout << "In core: allocation failed, skipped\n";
+      } else {
+        compute_q.memcpy(a, host.a, m * k * sizeof(float));
+        compute_q.memcpy(b, host.b, k * n * sizeof(float)).wait();
+        Stats resident = bench.run("in_core", [&]() {
+          gemmBlock(compute_q, a, k, b, n, c, n, m, n, k, false, {}).wait();
+        });
+        double incore_gflops = flops / resident.median / 1e6;
+        bench.annotate("gflops", incore_gflops);
+        std::cout << "In core: " << resident.median << " ms, "
+                  << incore_gflops << " GFLOP/s; streaming reaches "
+                  << 100.0 * ooc_gflops / incore_gflops << "% of it\n";
+      }
+      for (float* p : {a, b, c}) {
+        if (p) sycl::free(p, compute_q);
+      }
+    }
+
+    freeHost(host, compute_q);
+    bench.report();
+    return result;
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+}
@@ -1,68 +1,165 @@
 #include <chrono>
-#include <cstring>
+#include <cmath>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <random>
 #include <sycl/sycl.hpp>
 
+#include "autotune.h"
+#include "cmdgraph.h"
+#include "device_manager.h"
+#include "gemm.h"
+#include "harness.h"
+#include "matio.h"
+#include "roofline.h"
+#include "usm_policy.h"
+#include "usm_pool.h"
+
 constexpr int M = 12288;
 constexpr int N = 128;
 constexpr int P = 2048;
 constexpr int VERIFICATION_SAMPLES = 2000;  // Number of random samples to verify
 
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const& e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const& e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
+// Block of c each work-item of the packed kernel computes; the packed
+// operands are panels of these widths
+constexpr int PACK_ROWS = 4;
+constexpr int PACK_COLS = 8;
+static_assert(M % PACK_ROWS == 0 && P % PACK_COLS == 0,
+              "Packed panels must tile the matrices");
+
+// Which operands are repacked panel-major before the multiplication:
+//   none  a and b as they are
+//   b     b only, the constant operand
+//   ab    both
+enum class PackMode { kNone, kB, kAB };
+
+const char* to_string(PackMode pack) {
+  switch (pack) {
+    case PackMode::kNone:
+      return "none";
+    case PackMode::kB:
+      return "b";
+    case PackMode::kAB:
+      return "ab";
   }
-};
+  return "unknown";
+}
+
+PackMode parse_pack_mode(const std::string& name) {
+  if (name == "none") return PackMode::kNone;
+  if (name == "b") return PackMode::kB;
+  if (name == "ab") return PackMode::kAB;
+  throw std::invalid_argument("Unknown pack mode: " + name);
+}
 
-void matmul(sycl::queue& q, float (*a)[N], float (*b)[P], float (*c)[P]);
-int verifyResult(float (*c_back)[P], bool full_verify = false);
+CommandGraph::CommandGroup matmulCommand(float (*a)[N], float (*b)[P],
+                                         float (*c)[P],
+                                         const LaunchConfig& shape = {});
+CommandGraph::CommandGroup packACommand(float (*a)[N], float* a_packed);
+CommandGraph::CommandGroup packBCommand(float (*b)[P], float* b_packed);
+CommandGraph::CommandGroup matmulPackedCommand(float (*a)[N],
+                                               const float* a_packed,
+                                               const float* b_packed,
+                                               float (*c)[P]);
+sycl::event submitInOrder(
+    sycl::queue& q, const std::vector<CommandGraph::CommandGroup>& commands);
+KernelCost matmulCost();
+int verifyResult(float (*a)[N], float (*b)[P], float (*c_back)[P],
+                 bool full_verify = false);
 void initializeMatrixA(sycl::queue& q, float (*a)[N]);
 void initializeMatrixB(sycl::queue& q, float (*b)[P]);
+double elapsedMs(std::chrono::high_resolution_clock::time_point start);
 
 int main(int argc, char* argv[]) {
   int num_gpu = 6;
-  int iterations = 50;
   bool full_verify = false;
-  
-  for (int i = 1; i < argc; ++i) {
-    if (std::strcmp(argv[i], "--full-verify") == 0) {
-      full_verify = true;
-    } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
-      iterations = std::stoi(argv[++i]);
-    } else {
-      num_gpu = std::stoi(argv[i]);
+  // All queues share one context per platform unless asked otherwise.
+  ContextScope context_scope = ContextScope::kPerPlatform;
+  Submission submission = Submission::kEager;
+  bool tune = false;
+  bool retune = false;
+  UsmPolicy policy = UsmPolicy::kNone;
+  bool prefetch_back = false;
+  std::vector<std::string> inputs;
+  std::string output;
+  PackMode pack = PackMode::kNone;
+  bool repack = false;
+  bool classify = false;
+  HarnessOptions harness_options;
+  harness_options.repetitions = 50;
+
+  try {
+    Args args(argc, argv, harness_options);
+    full_verify = args.flag("full-verify");
+    // --tune: launch shape from the tuning database, tuned on a miss;
+    // --retune: tune again even when the database has an entry
+    retune = args.flag("retune");
+    tune = args.flag("tune") || retune;
+    // --pool: matrices from the caching USM pool
+    if (args.flag("pool")) set_usm_pool_enabled(true);
+    // --usm-policy: hints for the shared matrices; --prefetch-back: c back
+    // to the host before verification
+    policy = parse_usm_policy(args.get("usm-policy", to_string(policy)));
+    prefetch_back = args.flag("prefetch-back");
+    // --input a,b: the float32 matrices from files (MxN and NxP) instead of
+    // the generated ones; --output: device 0's c to a file
+    std::string input = args.get("input", "");
+    if (!input.empty()) inputs = parse_matrix_paths(input, 2);
+    output = args.get("output", output);
+    // --pack b|ab: multiply panel-major copies of the operands, packed once
+    // up front since a and b never change; --repack: pack them again in
+    // every iteration instead
+    pack = parse_pack_mode(args.get("pack", to_string(pack)));
+    repack = args.flag("repack");
+    // --kernel auto: the GEMM kernel the shape classifier picks for these
+    // dimensions instead of the generic one (the default, "generic")
+    std::string kernel = args.get("kernel", "generic");
+    if (kernel != "generic" && kernel != "auto") {
+      throw std::invalid_argument("Unknown kernel: " + kernel);
+    }
+    classify = kernel == "auto";
+    if (classify && pack != PackMode::kNone) {
+      throw std::invalid_argument("--pack runs its own kernel, not --kernel");
     }
+    harness_options = args.harness();
+    // --iterations is the older spelling of --reps
+    harness_options.repetitions =
+        args.get_int("iterations", harness_options.repetitions);
+    context_scope =
+        parse_context_scope(args.get("context", to_string(context_scope)));
+    submission =
+        parse_submission(args.get("submission", to_string(submission)));
+    num_gpu = args.positional_int(0, num_gpu);
+    args.finish();
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
   }
+  Harness bench("matmul_xgpu", harness_options);
 
   std::vector<float(*)[N]> a_matrices(num_gpu);
   std::vector<float(*)[P]> b_matrices(num_gpu);
   std::vector<float(*)[P]> c_matrices(num_gpu);
+  std::vector<float*> a_packed(num_gpu, nullptr);
+  std::vector<float*> b_packed(num_gpu, nullptr);
+  // c of the baseline runs, so they leave the result under test alone
+  std::vector<float(*)[P]> c_baseline(num_gpu, nullptr);
   std::vector<sycl::queue> queues;
-  std::vector<sycl::context> contexts;
 
   auto start_time = std::chrono::high_resolution_clock::now();
 
   try {
-    auto platforms = sycl::platform::get_platforms();
-    std::vector<sycl::device> gpu_devices;
-    for (auto& platform : platforms) {
-      if (platform.get_backend() != sycl::backend::ext_oneapi_level_zero) {
-        continue;  // Skip non-Level Zero backends
-      }
-      auto devices = platform.get_devices(sycl::info::device_type::gpu);
-      gpu_devices.insert(gpu_devices.end(), devices.begin(), devices.end());
-    }
+    // Level Zero root devices only, without splitting them into tiles.
+    DeviceManagerOptions options;
+    options.scope = context_scope;
+    options.partition = false;
+    options.level_zero_only = true;
+    DeviceManager manager(options);
+    const auto& gpu_devices = manager.devices();
 
     std::cout << "Number of GPU devices: " << gpu_devices.size() << "\n";
+    std::cout << "Context scope: " << to_string(context_scope) << "\n";
 
     if (gpu_devices.size() < num_gpu) {
       std::cout << "Not enough GPU devices available.\n";
@@ -71,56 +168,307 @@ int main(int argc, char* argv[]) {
 
     // Create queues for each GPU device
     for (int i = 0; i < num_gpu; ++i) {
-      contexts.emplace_back(gpu_devices[i]);
-      queues.emplace_back(contexts[i], gpu_devices[i], exception_handler);
+      queues.push_back(manager.make_queue(i, harness_exception_handler));
       std::cout << "Using device " << i << ": "
                 << gpu_devices[i].get_info<sycl::info::device::name>() << "\n";
     }
 
+    // Every device multiplies its own matrices, so the ceiling of an
+    // iteration is the sum of the devices' peaks
+    DevicePeaks peaks;
+    for (int i = 0; i < num_gpu; ++i) {
+      DevicePeaks device_peaks = measure_peaks(queues[i]);
+      print_peaks(std::cout, std::to_string(i), device_peaks);
+      peaks = peaks + device_peaks;
+    }
+
+    std::vector<MatrixFile> files;
+    for (const auto& path : inputs) files.push_back(MatrixFile::open(path));
+    if (!files.empty()) {
+      files[0].expect<float>(M, N);
+      files[1].expect<float>(N, P);
+    }
+
+    auto load_start = std::chrono::high_resolution_clock::now();
     for (int i = 0; i < num_gpu; ++i) {
-      a_matrices[i] = static_cast<float(*)[N]>(
-          sycl::malloc_shared(M * N * sizeof(float), queues[i]));
-      b_matrices[i] = static_cast<float(*)[P]>(
-          sycl::malloc_shared(N * P * sizeof(float), queues[i]));
-      c_matrices[i] = static_cast<float(*)[P]>(
-          sycl::malloc_shared(M * P * sizeof(float), queues[i]));
-
-      if (!a_matrices[i] || !b_matrices[i] || !c_matrices[i]) {
+      a_matrices[i] = reinterpret_cast<float(*)[N]>(
+          usm_malloc<float>(M * N, sycl::usm::alloc::shared, queues[i]));
+      b_matrices[i] = reinterpret_cast<float(*)[P]>(
+          usm_malloc<float>(N * P, sycl::usm::alloc::shared, queues[i]));
+      c_matrices[i] = reinterpret_cast<float(*)[P]>(
+          usm_malloc<float>(M * P, sycl::usm::alloc::shared, queues[i]));
+
+      if (pack == PackMode::kAB) {
+        a_packed[i] =
+            usm_malloc<float>(M * N, sycl::usm::alloc::device, queues[i]);
+      }
+      if (pack != PackMode::kNone) {
+        b_packed[i] =
+            usm_malloc<float>(N * P, sycl::usm::alloc::device, queues[i]);
+      }
+      bool baseline = pack != PackMode::kNone || classify;
+      if (baseline) {
+        c_baseline[i] = reinterpret_cast<float(*)[P]>(
+            usm_malloc<float>(M * P, sycl::usm::alloc::device, queues[i]));
+      }
+
+      if (!a_matrices[i] || !b_matrices[i] || !c_matrices[i] ||
+          (pack == PackMode::kAB && !a_packed[i]) ||
+          (pack != PackMode::kNone && !b_packed[i]) ||
+          (baseline && !c_baseline[i])) {
         throw std::runtime_error("USM allocation failed for device " +
                                  std::to_string(i));
       }
 
-      initializeMatrixA(queues[i], a_matrices[i]);
-      initializeMatrixB(queues[i], b_matrices[i]);
+      if (files.empty()) {
+        initializeMatrixA(queues[i], a_matrices[i]);
+        initializeMatrixB(queues[i], b_matrices[i]);
+      } else {
+        files[0].read_into(queues[i], a_matrices[i]);
+        files[1].read_into(queues[i], b_matrices[i]);
+      }
     }
+    if (!files.empty()) bench.record("load", {elapsedMs(load_start)});
+    files.clear();
 
     std::cout << "Problem size: c(" << M << "x" << P << ") = a(" << M << "x"
               << N << ") * b(" << N << "x" << P << ")\n";
 
-    for (int iter = 0; iter < iterations; ++iter) {
-      if ((iter + 1) % 100 == 0) {  // Check if the iteration number is a multiple of 100
-        std::cout << "Iteration " << iter + 1 << " of " << iterations << std::endl;
+    bench.set_param("m", M);
+    bench.set_param("n", N);
+    bench.set_param("p", P);
+    bench.set_param("devices", num_gpu);
+    bench.set_param("usm_policy", to_string(policy));
+    bench.set_param("pack", to_string(pack));
+
+    // c(M x P) = a(M x N) * b(N x P) in the GEMM library's terms
+    GemmShape shape{M, P, N};
+    std::vector<GemmPlan> plans(num_gpu);
+    if (classify) {
+      for (int i = 0; i < num_gpu; ++i) {
+        plans[i] = plan_gemm(shape, gpu_devices[i]);
       }
+      std::cout << "Shape class: "
+                << to_string(classify_gemm(shape, gpu_devices[0]))
+                << ", kernel: " << to_string(plans[0]) << "\n";
+      bench.set_param("kernel", to_string(plans[0]));
+    }
 
+    // Hints for every device's matrices, timed until they have all taken
+    // effect; with no hints, c migrates on demand in the first iteration
+    auto hints_start = std::chrono::high_resolution_clock::now();
+    std::vector<sycl::event> hints;
+    for (int i = 0; i < num_gpu; ++i) {
+      std::vector<UsmRange> ranges = {
+          {a_matrices[i], M * N * sizeof(float), true},
+          {b_matrices[i], N * P * sizeof(float), true},
+          {c_matrices[i], M * P * sizeof(float), false}};
+      for (auto& e : apply_usm_policy(queues[i], policy, ranges)) {
+        hints.push_back(e);
+      }
+    }
+    for (auto& e : hints) e.wait();
+    bench.record("migrate", {elapsedMs(hints_start)});
+
+    // Launch shape per device; the default plain range leaves it to the
+    // runtime
+    std::vector<LaunchConfig> shapes(num_gpu);
+    if (tune) {
+      std::string problem = "m=" + std::to_string(M) + ",n=" +
+                            std::to_string(N) + ",p=" + std::to_string(P);
       for (int i = 0; i < num_gpu; ++i) {
-        matmul(queues[i], a_matrices[i], b_matrices[i], c_matrices[i]);
+        Autotuner tuner(queues[i]);
+        tuner.set_retune(retune);
+        tuner.set_log(&std::cout);
+        shapes[i] = tuner.tune("matmul_xgpu/matmul", problem,
+                               [&](const LaunchConfig& shape) {
+          auto start = std::chrono::high_resolution_clock::now();
+          queues[i]
+              .submit(matmulCommand(a_matrices[i], b_matrices[i],
+                                    c_matrices[i], shape))
+              .wait_and_throw();
+          return std::chrono::duration<double, std::milli>(
+                     std::chrono::high_resolution_clock::now() - start)
+              .count();
+        });
+        std::cout << "Device " << i << " launch shape: " << to_string(shapes[i])
+                  << (tuner.last_from_db()
+                          ? " (from the tuning database)"
+                          : " (tuned over " +
+                                std::to_string(tuner.last_candidates()) +
+                                " candidates)")
+                  << "\n";
       }
+      bench.set_param("shape", to_string(shapes[0]));
+    }
+
+    // The packing of one device, a before b
+    auto packCommands = [&](int i) {
+      std::vector<CommandGraph::CommandGroup> commands;
+      if (a_packed[i]) {
+        commands.push_back(packACommand(a_matrices[i], a_packed[i]));
+      }
+      if (b_packed[i]) {
+        commands.push_back(packBCommand(b_matrices[i], b_packed[i]));
+      }
+      return commands;
+    };
+
+    // Packed once, the panels are reused by every iteration. A first,
+    // untimed packing compiles the pack kernels, so pack_ms is the packing
+    // alone, as it would be for every further weight matrix.
+    double pack_ms = 0.0;
+    if (pack != PackMode::kNone && !repack) {
+      for (int i = 0; i < num_gpu; ++i) {
+        submitInOrder(queues[i], packCommands(i));
+      }
+      for (auto& q : queues) q.wait_and_throw();
+      auto pack_start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < num_gpu; ++i) {
+        submitInOrder(queues[i], packCommands(i));
+      }
+      for (auto& q : queues) q.wait_and_throw();
+      pack_ms = bench.record("pack", {elapsedMs(pack_start)}).median;
+    }
+
+    // One iteration's commands per device, in order: the kernel, after the
+    // packing it reads with --repack. The launch shape applies to the
+    // generic kernel only.
+    std::vector<std::vector<CommandGraph::CommandGroup>> iteration(num_gpu);
+    for (int i = 0; i < num_gpu; ++i) {
+      if (classify) {
+        iteration[i].push_back(
+            gemm_command(plans[i], shape, &a_matrices[i][0][0],
+                         &b_matrices[i][0][0], &c_matrices[i][0][0]));
+        continue;
+      }
+      if (pack == PackMode::kNone) {
+        iteration[i].push_back(matmulCommand(a_matrices[i], b_matrices[i],
+                                             c_matrices[i], shapes[i]));
+        continue;
+      }
+      if (repack) iteration[i] = packCommands(i);
+      iteration[i].push_back(matmulPackedCommand(
+          a_matrices[i], a_packed[i], b_packed[i], c_matrices[i]));
+    }
+
+    // Every iteration runs the same commands on the same matrices, so with
+    // --submission graph they are recorded once per queue and replayed
+    std::vector<std::unique_ptr<CommandGraph>> graphs;
+    if (submission != Submission::kEager) {
+      for (int i = 0; i < num_gpu; ++i) {
+        graphs.push_back(std::make_unique<CommandGraph>(
+            queues[i], submission == Submission::kEmulated));
+        for (auto& command : iteration[i]) graphs[i]->add(command);
+        graphs[i]->finalize();
+      }
+    }
+    // The generic kernel into c_baseline, for the comparisons after the
+    // timed loop; submitted the same way as the iterations it is compared
+    // with, so a graph's launch savings are not credited to the kernel
+    std::vector<std::unique_ptr<CommandGraph>> baseline_graphs;
+    if (!graphs.empty() && c_baseline[0]) {
+      for (int i = 0; i < num_gpu; ++i) {
+        baseline_graphs.push_back(std::make_unique<CommandGraph>(
+            queues[i], submission == Submission::kEmulated));
+        baseline_graphs[i]->add(matmulCommand(a_matrices[i], b_matrices[i],
+                                              c_baseline[i], shapes[i]));
+        baseline_graphs[i]->finalize();
+      }
+    }
+    auto runBaseline = [&]() {
+      for (int i = 0; i < num_gpu; ++i) {
+        if (baseline_graphs.empty()) {
+          queues[i].submit(matmulCommand(a_matrices[i], b_matrices[i],
+                                         c_baseline[i], shapes[i]));
+        } else {
+          baseline_graphs[i]->replay();
+        }
+      }
+      for (auto& q : queues) q.wait_and_throw();
+    };
+
+    const char* submission_name =
+        graphs.empty() ? to_string(submission) : graphs[0]->mode_name();
+    std::cout << "Submission: " << submission_name << "\n";
+    bench.set_param("submission", submission_name);
+
+    // Host time to get one iteration onto the queues, next to the full
+    // iteration time
+    std::vector<double> submit_ms;
+    Stats stats = bench.run_measured("matmul", [&]() {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < num_gpu; ++i) {
+        if (graphs.empty()) {
+          submitInOrder(queues[i], iteration[i]);
+        } else {
+          graphs[i]->replay();
+        }
+      }
+      auto submitted = std::chrono::high_resolution_clock::now();
 
       // Wait for all queues to finish
       for (auto& q : queues) {
         q.wait_and_throw();
       }
+      auto end = std::chrono::high_resolution_clock::now();
+      submit_ms.push_back(
+          std::chrono::duration<double, std::milli>(submitted - start).count());
+      return std::chrono::duration<double, std::milli>(end - start).count();
+    });
+    RooflinePoint point = roofline(matmulCost() * num_gpu, stats.median, peaks,
+                                   Precision::kFloat);
+    print_roofline(std::cout, "matmul", point);
+    annotate_roofline(bench, point);
+
+    submit_ms.erase(submit_ms.begin(),
+                    submit_ms.begin() + bench.options().warmup);
+    bench.record("submit", submit_ms);
+
+    // What packing buys: the unpacked kernel on the same matrices, against
+    // the packed iterations with the one-time packing spread over them. It
+    // writes to c_baseline: c keeps the packed result for verification.
+    if (pack != PackMode::kNone) {
+      Stats unpacked = bench.run("matmul_unpacked", runBaseline);
+      int reps = bench.options().repetitions;
+      double amortised = stats.median + pack_ms / reps;
+      double saved = unpacked.median - stats.median;
+      std::cout << "Packing " << to_string(pack)
+                << (repack ? " every iteration" : " once") << ": pack "
+                << pack_ms << " ms, matmul " << stats.median << " ms vs "
+                << unpacked.median << " ms unpacked; " << amortised
+                << " ms per iteration amortised over " << reps;
+      if (!repack && saved > 0.0) {
+        std::cout << ", paid back after "
+                  << static_cast<int>(std::ceil(pack_ms / saved))
+                  << " iteration(s)";
+      }
+      std::cout << "\n";
+      bench.annotate("speedup", unpacked.median / amortised);
+    }
+
+    // The classified kernel against the generic one on the same matrices;
+    // into c_baseline as well, so c keeps the classified kernel's result
+    if (classify) {
+      Stats generic = bench.run("matmul_generic", runBaseline);
+      std::cout << "Kernel " << to_string(plans[0]) << ": " << stats.median
+                << " ms vs " << generic.median << " ms generic ("
+                << generic.median / stats.median << "x)\n";
+      bench.annotate("speedup", generic.median / stats.median);
     }
 
-  } catch (sycl::exception const& e) {
+  } catch (std::exception const& e) {
     std::cout << "An exception is caught while multiplying matrices: "
               << e.what() << "\n";
 
     // Cleanup
     for (int i = 0; i < num_gpu; ++i) {
-      sycl::free(a_matrices[i], queues[i]);
-      sycl::free(b_matrices[i], queues[i]);
-      sycl::free(c_matrices[i], queues[i]);
+      usm_free(a_matrices[i], queues[i]);
+      usm_free(b_matrices[i], queues[i]);
+      usm_free(c_matrices[i], queues[i]);
+      usm_free(a_packed[i], queues[i]);
+      usm_free(b_packed[i], queues[i]);
+      usm_free(c_baseline[i], queues[i]);
     }
 
     return -1;
@@ -133,10 +481,19 @@ int main(int argc, char* argv[]) {
   std::cout << "Matrix multiplication time: " << duration.count() / 1000000.0
             << " seconds" << std::endl;
 
+  if (prefetch_back) {
+    auto migrate_start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_gpu; ++i) {
+      prefetch_to_host({{c_matrices[i], M * P * sizeof(float), false}});
+    }
+    bench.record("migrate_back", {elapsedMs(migrate_start)});
+  }
+
   auto verify_start = std::chrono::high_resolution_clock::now();
   int result = 0;
   for (int i = 0; i < num_gpu; ++i) {
-    result = verifyResult(c_matrices[i], full_verify);
+    result = verifyResult(a_matrices[i], b_matrices[i], c_matrices[i],
+                          full_verify);
     if (result != 0) {
       std::cout << "Verification failed on device " << i << "\n";
       return result;
@@ -148,41 +505,197 @@ int main(int argc, char* argv[]) {
 
   std::cout << "Verification time: " << verify_duration.count() / 1000000.0
             << " seconds" << std::endl;
+  bench.record("verify", {verify_duration.count() / 1000.0});
+
+  if (!output.empty()) {
+    auto store_start = std::chrono::high_resolution_clock::now();
+    try {
+      save_matrix(output, queues[0], &c_matrices[0][0][0], M, P);
+    } catch (std::exception const& e) {
+      std::cout << "Cannot write the result: " << e.what() << "\n";
+      return -1;
+    }
+    bench.record("store", {elapsedMs(store_start)});
+    std::cout << "Result written to " << output << "\n";
+  }
 
   // Free USM memory
   for (int i = 0; i < num_gpu; ++i) {
-    sycl::free(a_matrices[i], queues[i]);
-    sycl::free(b_matrices[i], queues[i]);
-    sycl::free(c_matrices[i], queues[i]);
+    usm_free(a_matrices[i], queues[i]);
+    usm_free(b_matrices[i], queues[i]);
+    usm_free(c_matrices[i], queues[i]);
+    usm_free(a_packed[i], queues[i]);
+    usm_free(b_packed[i], queues[i]);
+    usm_free(c_baseline[i], queues[i]);
   }
+  print_usm_pool_stats(std::cout);
 
   std::cout << "Total execution time: "
             << (duration + verify_duration).count() / 1000000.0 << " seconds"
             << std::endl;
+
+  bench.report();
   
   return 0;
 }
 
-void matmul(sycl::queue& q, float (*a)[N], float (*b)[P], float (*c)[P]) {
-  q.parallel_for(sycl::range(M, P), [=](sycl::id<2> index) {
-     int row = index[0];
-     int col = index[1];
-     float sum = 0.0f;
+// One multiplication: a multiply and an add per term of every dot product,
+// and a, b and c each moved once.
+KernelCost matmulCost() {
+  KernelCost cost;
+  cost.flops = 2.0 * M * N * P;
+  cost.bytes = sizeof(float) * (double(M) * N + double(N) * P + double(M) * P);
+  return cost;
+}
+
+// nd_range version: work-groups of shape.local_size work-items along a row,
+// each computing shape.items_per_work_item columns strided by the number of
+// work-items per row, so neighbouring work-items still read neighbouring
+// columns of b.
+CommandGraph::CommandGroup matmulTunedCommand(float (*a)[N], float (*b)[P],
+                                              float (*c)[P],
+                                              const LaunchConfig& shape) {
+  size_t items = shape.items_per_work_item;
+  size_t local = shape.local_size;
+  if (items == 0 || P % items != 0 || (P / items) % local != 0) {
+    throw std::invalid_argument("Launch shape does not divide the matrix");
+  }
+  size_t cols = P / items;
+  size_t sub_group = shape.sub_group_size;
+
+  return [=](sycl::handler& h) {
+    sycl::nd_range<2> range({M, cols}, {1, local});
+    auto body = [=](sycl::nd_item<2> item) {
+      int row = item.get_global_id(0);
+      for (size_t j = 0; j < items; j++) {
+        int col = item.get_global_id(1) + j * cols;
+        float sum = 0.0f;
+
+        for (int i = 0; i < N; i++) {
+          sum += a[row][i] * b[i][col];
+        }
+
+        c[row][col] = sum;
+      }
+    };
+    with_sub_group_size(sub_group, [&](auto size) {
+      constexpr size_t kSubGroup = decltype(size)::value;
+      if constexpr (kSubGroup == 0) {
+        h.parallel_for(range, body);
+      } else {
+        h.parallel_for(range, [=](sycl::nd_item<2> item)
+                                  [[sycl::reqd_sub_group_size(kSubGroup)]] {
+                                    body(item);
+                                  });
+      }
+    });
+  };
+}
 
-     for (int i = 0; i < N; i++) {
-       sum += a[row][i] * b[i][col];
-     }
+CommandGraph::CommandGroup matmulCommand(float (*a)[N], float (*b)[P],
+                                         float (*c)[P],
+                                         const LaunchConfig& shape) {
+  if (shape.local_size != 0) return matmulTunedCommand(a, b, c, shape);
 
-     c[row][col] = sum;
-   }).wait();
+  return [=](sycl::handler& h) {
+    h.parallel_for(sycl::range(M, P), [=](sycl::id<2> index) {
+      int row = index[0];
+      int col = index[1];
+      float sum = 0.0f;
+
+      for (int i = 0; i < N; i++) {
+        sum += a[row][i] * b[i][col];
+      }
+
+      c[row][col] = sum;
+    });
+  };
+}
+
+// Panel-major copies for matmulPackedCommand. b becomes P / PACK_COLS
+// panels of N x PACK_COLS and a M / PACK_ROWS panels of N x PACK_ROWS, a's
+// rows interleaved along N, so a work-item walking N reads consecutive
+// addresses in both instead of striding by P through b.
+CommandGraph::CommandGroup packACommand(float (*a)[N], float* a_packed) {
+  return [=](sycl::handler& h) {
+    h.parallel_for(sycl::range(M, N), [=](sycl::id<2> index) {
+      int row = index[0];
+      int i = index[1];
+      a_packed[(row / PACK_ROWS * N + i) * PACK_ROWS + row % PACK_ROWS] =
+          a[row][i];
+    });
+  };
+}
+
+CommandGraph::CommandGroup packBCommand(float (*b)[P], float* b_packed) {
+  return [=](sycl::handler& h) {
+    h.parallel_for(sycl::range(N, P), [=](sycl::id<2> index) {
+      int i = index[0];
+      int col = index[1];
+      b_packed[(col / PACK_COLS * N + i) * PACK_COLS + col % PACK_COLS] =
+          b[i][col];
+    });
+  };
+}
+
+// Packed version: every work-item computes a PACK_ROWS x PACK_COLS block
+// of c from one panel of b and one panel of a, or PACK_ROWS rows of a
+// itself when a_packed is null.
+CommandGraph::CommandGroup matmulPackedCommand(float (*a)[N],
+                                               const float* a_packed,
+                                               const float* b_packed,
+                                               float (*c)[P]) {
+  return [=](sycl::handler& h) {
+    sycl::range blocks(M / PACK_ROWS, P / PACK_COLS);
+    h.parallel_for(blocks, [=](sycl::id<2> index) {
+      int row = index[0] * PACK_ROWS;
+      int col = index[1] * PACK_COLS;
+      const float* a_panel = a_packed ? a_packed + size_t(row) * N : nullptr;
+      const float* b_panel = b_packed + size_t(col) * N;
+      float sum[PACK_ROWS][PACK_COLS] = {};
+
+      for (int i = 0; i < N; i++) {
+        for (int r = 0; r < PACK_ROWS; r++) {
+          float a_ri = a_panel ? a_panel[i * PACK_ROWS + r] : a[row + r][i];
+          for (int j = 0; j < PACK_COLS; j++) {
+            sum[r][j] += a_ri * b_panel[i * PACK_COLS + j];
+          }
+        }
+      }
+
+      for (int r = 0; r < PACK_ROWS; r++) {
+        for (int j = 0; j < PACK_COLS; j++) {
+          c[row + r][col + j] = sum[r][j];
+        }
+      }
+    });
+  };
+}
+
+// Submits commands to q one after another, whatever the queue's ordering;
+// returns the event of the last.
+sycl::event submitInOrder(
+    sycl::queue& q, const std::vector<CommandGraph::CommandGroup>& commands) {
+  sycl::event last;
+  for (const auto& command : commands) {
+    last = q.submit([&](sycl::handler& h) {
+      h.depends_on(last);
+      command(h);
+    });
+  }
+  return last;
 }
 
 bool valueSame(float a, float b) {
   // return std::fabs(a - b) < std::numeric_limits<float>::epsilon() * 100;
-  return std::fabs(a - b) / std::max(std::fabs(a), std::fabs(b)) < 1e-4;
+  // Relative, with an absolute floor so that zeros (and inputs from a file,
+  // which can hold any values) compare equal instead of giving 0 / 0
+  return std::fabs(a - b) <=
+         1e-6f + 1e-4f * std::max(std::fabs(a), std::fabs(b));
 }
 
-int verifyResult(float (*c_back)[P], bool full_verify) {
+int verifyResult(float (*a)[N], float (*b)[P], float (*c_back)[P],
+                 bool full_verify) {
   std::random_device rd;
   std::mt19937 gen(rd());
   std::uniform_int_distribution<> dis_m(0, M - 1);
@@ -197,7 +710,7 @@ int verifyResult(float (*c_back)[P], bool full_verify) {
 
     float expected = 0.0f;
     for (int k = 0; k < N; k++) {
-      expected += 1.0f * (k + 1.0f);  // a[i][k] * b[k][j]
+      expected += a[i][k] * b[k][j];
     }
 
     if (!valueSame(c_back[i][j], expected)) {
@@ -230,4 +743,10 @@ void initializeMatrixB(sycl::queue& q, float (*b)[P]) {
   q.parallel_for(sycl::range(N, P), [=](sycl::id<2> index) {
      b[index[0]][index[1]] = index[0] + 1.0f;
    }).wait();
-}
\ No newline at end of file
+}
+
+double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
@@ -1,9 +1,11 @@
 #include <chrono>
-#include <cstring>
 #include <iostream>
 #include <limits>
 #include <random>
 #include <sycl/sycl.hpp>
+
+#include "device_manager.h"
+#include "harness.h"
 #include <thread>
 #include <vector>
 
@@ -12,19 +14,6 @@ constexpr int N = 128;
 constexpr int P = 2048;
 constexpr int VERIFICATION_SAMPLES = 2000;  // Number of random samples to verify
 
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const& e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const& e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 void matmul(sycl::queue& q, float (*a)[N], float (*b)[P], float (*c)[P]);
 int verifyResult(float (*c_back)[P], bool full_verify = false);
 void initializeMatrixA(sycl::queue& q, float (*a)[N]);
@@ -32,39 +21,47 @@ void initializeMatrixB(sycl::queue& q, float (*b)[P]);
 
 int main(int argc, char* argv[]) {
   int num_gpu = 6;
-  int iterations = 50;
   bool full_verify = false;
-  
-  for (int i = 1; i < argc; ++i) {
-    if (std::strcmp(argv[i], "--full-verify") == 0) {
-      full_verify = true;
-    } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
-      iterations = std::stoi(argv[++i]);
-    } else {
-      num_gpu = std::stoi(argv[i]);
-    }
+  // All queues share one context per platform unless asked otherwise.
+  ContextScope context_scope = ContextScope::kPerPlatform;
+  HarnessOptions harness_options;
+  harness_options.repetitions = 50;
+
+  try {
+    Args args(argc, argv, harness_options);
+    full_verify = args.flag("full-verify");
+    harness_options = args.harness();
+    // --iterations is the older spelling of --reps
+    harness_options.repetitions =
+        args.get_int("iterations", harness_options.repetitions);
+    context_scope =
+        parse_context_scope(args.get("context", to_string(context_scope)));
+    num_gpu = args.positional_int(0, num_gpu);
+    args.finish();
+  } catch (std::exception const& e) {
+    std::cout << "Bad arguments: " << e.what() << "\n";
+    return -1;
   }
+  Harness bench("matmul_xgpu_t", harness_options);
 
   std::vector<float(*)[N]> a_matrices(num_gpu);
   std::vector<float(*)[P]> b_matrices(num_gpu);
   std::vector<float(*)[P]> c_matrices(num_gpu);
   std::vector<sycl::queue> queues;
-  std::vector<sycl::context> contexts;
 
   auto start_time = std::chrono::high_resolution_clock::now();
 
   try {
-    auto platforms = sycl::platform::get_platforms();
-    std::vector<sycl::device> gpu_devices;
-    for (auto& platform : platforms) {
-      if (platform.get_backend() != sycl::backend::ext_oneapi_level_zero) {
-        continue;  // Skip non-Level Zero backends
-      }
-      auto devices = platform.get_devices(sycl::info::device_type::gpu);
-      gpu_devices.insert(gpu_devices.end(), devices.begin(), devices.end());
-    }
+    // Level Zero root devices only, without splitting them into tiles.
+    DeviceManagerOptions options;
+    options.scope = context_scope;
+    options.partition = false;
+    options.level_zero_only = true;
+    DeviceManager manager(options);
+    const auto& gpu_devices = manager.devices();
 
     std::cout << "Number of GPU devices: " << gpu_devices.size() << "\n";
+    std::cout << "Context scope: " << to_string(context_scope) << "\n";
 
     if (gpu_devices.size() < num_gpu) {
       std::cout << "Not enough GPU devices available.\n";
@@ -73,8 +70,7 @@ int main(int argc, char* argv[]) {
 
     // Create queues for each GPU device
     for (int i = 0; i < num_gpu; ++i) {
-      contexts.emplace_back(gpu_devices[i]);
-      queues.emplace_back(contexts[i], gpu_devices[i], exception_handler);
+      queues.push_back(manager.make_queue(i, harness_exception_handler));
       std::cout << "Using device " << i << ": "
                 << gpu_devices[i].get_info<sycl::info::device::name>() << "\n";
     }
@@ -99,13 +95,14 @@ int main(int argc, char* argv[]) {
     std::cout << "Problem size: c(" << M << "x" << P << ") = a(" << M << "x"
               << N << ") * b(" << N << "x" << P << ")\n";
 
-    std::vector<std::thread> threads;
+    bench.set_param("m", M);
+    bench.set_param("n", N);
+    bench.set_param("p", P);
+    bench.set_param("devices", num_gpu);
 
-    for (int iter = 0; iter < iterations; ++iter) {
-      if ((iter + 1) % 100 == 0) {
-        std::cout << "Iteration " << iter + 1 << " of " << iterations << std::endl;
-      }
+    std::vector<std::thread> threads;
 
+    bench.run("matmul", [&]() {
       threads.clear();
       for (int i = 0; i < num_gpu; ++i) {
         threads.emplace_back([&, i]() {
@@ -118,7 +115,7 @@ int main(int argc, char* argv[]) {
       for (auto& thread : threads) {
         thread.join();
       }
-    }
+    });
 
   } catch (sycl::exception const& e) {
     std::cout << "An exception is caught while multiplying matrices: "
@@ -167,6 +164,8 @@ int main(int argc, char* argv[]) {
   std::cout << "Total execution time: "
             << (duration + verify_duration).count() / 1000000.0 << " seconds"
             << std::endl;
+
+  bench.report();
   
   return 0;
 }
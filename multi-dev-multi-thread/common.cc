@@ -1,15 +1,29 @@
 #include "common.h"
+#include "topology.h"
 #include <sys/syscall.h>
 #include <unistd.h>
 
-sycl::queue createQueue(const sycl::device& device) {
-    sycl::queue queue(device, sycl::property::queue::enable_profiling{});
-
+static void printQueueInfo(const sycl::queue& queue, const sycl::device& device) {
     std::cout << "Created queue on device: "
               << queue.get_device().get_info<sycl::info::device::name>() << "\n";
     std::cout << "Max compute units: " << device.get_info<sycl::info::device::max_compute_units>() << "\n";
     std::cout << "Max work-group size: " << device.get_info<sycl::info::device::max_work_group_size>() << "\n";
+    // Measured here, before any thread runs kernels, so the vecadd
+    // roofline lines find them cached
+    print_peaks(std::cout, device.get_info<sycl::info::device::name>(), measure_peaks(queue));
+}
 
+sycl::queue createQueue(const sycl::device& device) {
+    sycl::queue queue(device, sycl::property::queue::enable_profiling{});
+    printQueueInfo(queue, device);
+    return queue;
+}
+
+// Create the queue inside an existing context, so that queues on sibling
+// tiles share USM allocations and events instead of each getting its own.
+sycl::queue createQueue(const sycl::context& context, const sycl::device& device) {
+    sycl::queue queue(context, device, sycl::property::queue::enable_profiling{});
+    printQueueInfo(queue, device);
     return queue;
 }
 
@@ -17,50 +31,43 @@ std::vector<sycl::device> initgpu()
 {
     try
     {
-        // Get all devices of type GPU
-        auto platforms = sycl::platform::get_platforms();
-        std::vector<sycl::device> gpus;
-        std::vector<sycl::device> all_sub_devices;
-
-        for (const auto &platform : platforms)
-        {
-            auto devices = platform.get_devices(sycl::info::device_type::gpu);
-            gpus.insert(gpus.end(), devices.begin(), devices.end());
-        }
-
-        if (gpus.empty())
+        // Tiles of every GPU, or the GPU itself when it cannot be partitioned.
+        // The topology comes from the on-disk cache when the drivers are
+        // unchanged, so no sub-device walk happens at startup.
+        Topology topology = Topology::load();
+        TopologyFilter filter;
+        filter.type = "gpu";
+        std::vector<DeviceInfo> selected = topology.select(topology_filter_from_env(filter));
+
+        if (selected.empty())
         {
             std::cerr << "No GPU devices found.\n";
             std::terminate();
         }
 
-        // Create sub-devices for each GPU
-        for (const auto &gpu : gpus)
+        int last_root = -1;
+        for (const auto &info : selected)
         {
-            try
+            if (info.root == last_root)
+            {
+                continue;
+            }
+            last_root = info.root;
+
+            const RootInfo &root = topology.roots()[info.root];
+            if (root.tiles > 0)
             {
-                // Try to create sub-devices based on compute units
-                auto sub_devices = gpu.create_sub_devices<
-                    sycl::info::partition_property::partition_by_affinity_domain>(
-                    sycl::info::partition_affinity_domain::next_partitionable);
-                
-                all_sub_devices.insert(all_sub_devices.end(), sub_devices.begin(), sub_devices.end());
-                
-                std::cout << "Created " << sub_devices.size() << " sub-devices for GPU: " 
-                          << gpu.get_info<sycl::info::device::name>() << "\n";
+                std::cout << "Created " << root.tiles << " sub-devices for GPU: "
+                          << root.info.name << "\n";
             }
-            catch (sycl::exception &e)
+            else
             {
-                std::cout << "Failed to create sub-devices for GPU " 
-                          << gpu.get_info<sycl::info::device::name>() 
-                          << ": " << e.what() << "\n";
+                std::cout << "GPU " << root.info.name << " is not partitionable.\n";
                 std::cout << "Using the main device as a single sub-device.\n";
-                all_sub_devices.push_back(gpu);
             }
         }
 
-        // return gpus;
-        return all_sub_devices;
+        return topology.resolve(selected);
     }
     catch (sycl::exception const &e)
     {
@@ -69,6 +76,42 @@ std::vector<sycl::device> initgpu()
     }
 }
 
+// Work of one vecadd_command launch: per element 10000 rounds of two
+// divides and two adds in double. The compulsory traffic is c read and
+// written once plus the 10000 elements of a and b every work-item reads.
+KernelCost vecadd_cost(size_t N)
+{
+    KernelCost cost;
+    cost.flops = 4.0 * 10000 * N;
+    cost.bytes = 2.0 * N * sizeof(int) + 2.0 * 10000 * sizeof(int);
+    return cost;
+}
+
+// Prints where one launch of duration_us sits under the device's roofline.
+void print_vecadd_roofline(sycl::queue &queue, size_t N, pid_t tid, int iteration, const std::string &func_name, double duration_us)
+{
+    RooflinePoint point = roofline(vecadd_cost(N), duration_us / 1e3, measure_peaks(queue), Precision::kDouble);
+    std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name << " roofline: " << format_roofline(point) << "\n";
+}
+
+// The vecadd command group on the three buffers, for eager submission and for
+// recording into a CommandGraph; the buffers must outlive the returned function.
+CommandGraph::CommandGroup vecadd_command(sycl::buffer<int, 1> &buffer_a, sycl::buffer<int, 1> &buffer_b, sycl::buffer<int, 1> &buffer_c, size_t N)
+{
+    return [&buffer_a, &buffer_b, &buffer_c, N](sycl::handler &cgh) {
+        // use accessor to access the data in the buffers
+        sycl::accessor acc_a(buffer_a, cgh, sycl::read_only);
+        sycl::accessor acc_b(buffer_b, cgh, sycl::read_only);
+        sycl::accessor acc_c(buffer_c, cgh, sycl::write_only);
+
+        cgh.parallel_for(sycl::range<1>(N), [=](sycl::id<1> idx) {
+            for (int kk = 0; kk < 10000; kk++) {
+                acc_c[idx] = acc_c[idx] + acc_a[N - 1 - kk] / double(10000) + acc_b[kk] / double(10000);
+            }
+        });
+    };
+}
+
 void vecadd_kernel(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string &func_name)
 {
     sycl::buffer<int, 1> buffer_a(a.data(), sycl::range<1>(N));
@@ -79,27 +122,63 @@ void vecadd_kernel(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b,
 
     std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name <<" started.\n";
 
-    sycl::event event = queue.submit([&](sycl::handler &cgh) {
-        // use accessor to access the data in the buffers
-        sycl::accessor acc_a(buffer_a, cgh, sycl::read_only);
-        sycl::accessor acc_b(buffer_b, cgh, sycl::read_only);
-        sycl::accessor acc_c(buffer_c, cgh, sycl::write_only);
+    sycl::event event = queue.submit(vecadd_command(buffer_a, buffer_b, buffer_c, N));
+
+    event.wait();
+
+    auto start = event.get_profiling_info<sycl::info::event_profiling::command_start>();
+    auto end = event.get_profiling_info<sycl::info::event_profiling::command_end>();
+    double duration = (end - start) / 1e3;
 
+    std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name <<" executed in " << duration << " us. " << "Kernel start: " << start / 1e3 << " us, end: " << end / 1e3 << "\n";
+    print_vecadd_roofline(queue, N, tid, iteration, func_name, duration);
+}
+
+// vecadd_kernel on device USM instead of buffers, used when the USM pool is
+// on: the arrays come from the pool, so only the first call on a queue
+// allocates, and they are handed back tied to the events of their last use
+// instead of after a wait.
+void vecadd_kernel_usm(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string &func_name)
+{
+    size_t bytes = N * sizeof(int);
+    int *d_a = usm_malloc<int>(N, sycl::usm::alloc::device, queue);
+    int *d_b = usm_malloc<int>(N, sycl::usm::alloc::device, queue);
+    int *d_c = usm_malloc<int>(N, sycl::usm::alloc::device, queue);
+    if (d_a == nullptr || d_b == nullptr || d_c == nullptr)
+    {
+        throw std::runtime_error("USM allocation failed in " + func_name);
+    }
+
+    pid_t tid = syscall(SYS_gettid);
+
+    std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name <<" started.\n";
+
+    std::vector<sycl::event> copies = {
+        queue.memcpy(d_a, a.data(), bytes),
+        queue.memcpy(d_b, b.data(), bytes),
+        queue.memcpy(d_c, c.data(), bytes)};
+
+    sycl::event event = queue.submit([&](sycl::handler &cgh) {
+        cgh.depends_on(copies);
         cgh.parallel_for(sycl::range<1>(N), [=](sycl::id<1> idx) {
-            int x = 0;
             for (int kk = 0; kk < 10000; kk++) {
-                acc_c[idx] = acc_c[idx] + acc_a[N - kk] / double(10000) + acc_b[kk] / double(10000);
+                d_c[idx] = d_c[idx] + d_a[N - 1 - kk] / double(10000) + d_b[kk] / double(10000);
             }
         });
     });
+    usm_free(d_a, queue, event);
+    usm_free(d_b, queue, event);
 
-    event.wait();
+    sycl::event back = queue.memcpy(c.data(), d_c, bytes, event);
+    usm_free(d_c, queue, back);
+    back.wait();
 
     auto start = event.get_profiling_info<sycl::info::event_profiling::command_start>();
     auto end = event.get_profiling_info<sycl::info::event_profiling::command_end>();
     double duration = (end - start) / 1e3;
 
     std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name <<" executed in " << duration << " us. " << "Kernel start: " << start / 1e3 << " us, end: " << end / 1e3 << "\n";
+    print_vecadd_roofline(queue, N, tid, iteration, func_name, duration);
 }
 
 void vecadd_kernel2(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string &func_name)
@@ -120,7 +199,7 @@ void vecadd_kernel2(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b
 
         cgh.parallel_for(sycl::range<1>(N), [=](sycl::id<1> idx) {
             for (int kk = 0; kk < 10000; kk++) {
-                acc_c[idx] = acc_c[idx] + acc_a[N - kk] / double(10000) + acc_b[kk] / double(10000);
+                acc_c[idx] = acc_c[idx] + acc_a[N - 1 - kk] / double(10000) + acc_b[kk] / double(10000);
             }
         }); 
     });
@@ -132,4 +211,5 @@ void vecadd_kernel2(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b
     double duration = (end - start) / 1e3;
 
     std::cout << "Thread " << tid << ", iteration " << iteration << ", " << func_name <<" executed in " << duration << " us. " << "Kernel start: " << start / 1e3 << " us, end: " << end / 1e3 << "\n";
+    print_vecadd_roofline(queue, N, tid, iteration, func_name, duration);
 }
\ No newline at end of file
@@ -1,17 +1,27 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <sys/types.h>
 #include <sycl/sycl.hpp>
 #include <iostream>
 #include <vector>
+#include "cmdgraph.h"
+#include "roofline.h"
+#include "usm_pool.h"
 
 constexpr size_t LOOP_COUNT = 10;
 
 std::vector<sycl::device> initgpu();
 sycl::queue createQueue(const sycl::device& device);
+sycl::queue createQueue(const sycl::context& context, const sycl::device& device);
+KernelCost vecadd_cost(size_t N);
+void print_vecadd_roofline(sycl::queue &queue, size_t N, pid_t tid, int iteration, const std::string& func_name, double duration_us);
+CommandGraph::CommandGroup vecadd_command(sycl::buffer<int, 1> &buffer_a, sycl::buffer<int, 1> &buffer_b, sycl::buffer<int, 1> &buffer_c, size_t N);
 void vecadd_kernel(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string& func_name);
+void vecadd_kernel_usm(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string& func_name);
 void vecadd_kernel2(sycl::queue &queue, std::vector<int> &a, std::vector<int> &b, std::vector<int> &c, size_t N, int iteration, const std::string& func_name);
 void kernel_submission(sycl::queue queue, size_t X, const std::string& func_name);
 void kernel_submission2(sycl::queue queue, size_t X, const std::string& func_name);
+void kernel_submission_graph(sycl::queue queue, size_t X, const std::string& func_name, bool emulate, size_t iterations = LOOP_COUNT);
 
 #endif // COMMON_H
\ No newline at end of file
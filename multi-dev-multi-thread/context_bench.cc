@@ -0,0 +1,130 @@
+#include <sycl/sycl.hpp>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "device_manager.h"
+
+// Compare the per-queue-context setup that createQueue() used to produce with
+// shared contexts handed out by DeviceManager:
+//   - startup: device enumeration, context and queue creation
+//   - USM visibility: can queue j use a device allocation made on queue 0?
+//   - cross-queue dependency: latency of a kernel on queue j that depends on
+//     an event from queue 0
+
+constexpr size_t USM_ELEMENTS = 1 << 20;
+constexpr int DEPENDENCY_REPS = 20;
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+static double elapsedUs(bench_clock::time_point start, bench_clock::time_point end)
+{
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+static void runScope(ContextScope scope)
+{
+    std::cout << "=== Context scope: " << to_string(scope) << "\n";
+
+    auto startup_begin = bench_clock::now();
+    DeviceManagerOptions options;
+    options.scope = scope;
+    DeviceManager manager(options);
+    if (manager.size() == 0)
+    {
+        std::cout << "  No GPU devices found.\n";
+        return;
+    }
+
+    std::vector<sycl::queue> queues;
+    for (size_t i = 0; i < manager.size(); ++i)
+    {
+        queues.push_back(manager.make_queue(i, sycl::property::queue::in_order{}));
+    }
+    auto startup_end = bench_clock::now();
+
+    std::cout << "  Devices: " << manager.size()
+              << ", startup (enumerate + contexts + queues): "
+              << elapsedUs(startup_begin, startup_end) << " us\n";
+
+    // USM allocated against queue 0, then touched from every other queue.
+    int *data = sycl::malloc_device<int>(USM_ELEMENTS, queues[0]);
+    queues[0].fill(data, 1, USM_ELEMENTS).wait();
+
+    for (size_t j = 1; j < queues.size(); ++j)
+    {
+        bool visible = sycl::get_pointer_type(data, queues[j].get_context()) !=
+                       sycl::usm::alloc::unknown;
+        std::cout << "  USM from queue 0 on queue " << j << ": "
+                  << (visible ? "visible" : "not visible");
+        // Device allocations are only directly usable on tiles of the same
+        // root device; other roots need peer access.
+        if (visible && manager.root_of(j) == manager.root_of(0))
+        {
+            auto begin = bench_clock::now();
+            queues[j].parallel_for(sycl::range<1>(USM_ELEMENTS), [=](sycl::id<1> idx) {
+                data[idx] += 1;
+            }).wait();
+            std::cout << ", remote update " << elapsedUs(begin, bench_clock::now()) << " us";
+        }
+        std::cout << "\n";
+    }
+
+    // Chain a kernel on queue j behind a kernel on queue 0.
+    for (size_t j = 1; j < queues.size(); ++j)
+    {
+        double total_us = 0.0;
+        for (int rep = 0; rep < DEPENDENCY_REPS; ++rep)
+        {
+            auto begin = bench_clock::now();
+            sycl::event first = queues[0].single_task([=]() {});
+            sycl::event second = queues[j].submit([&](sycl::handler &cgh) {
+                cgh.depends_on(first);
+                cgh.single_task([=]() {});
+            });
+            second.wait();
+            total_us += elapsedUs(begin, bench_clock::now());
+        }
+        bool shared = queues[0].get_context() == queues[j].get_context();
+        std::cout << "  Cross-queue dependency 0 -> " << j
+                  << (shared ? " (shared context)" : " (separate contexts)")
+                  << ": " << total_us / DEPENDENCY_REPS << " us per chain\n";
+    }
+
+    sycl::free(data, queues[0]);
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<ContextScope> scopes = {ContextScope::kPerQueue,
+                                        ContextScope::kPerRootDevice,
+                                        ContextScope::kPerPlatform};
+
+    try
+    {
+        if (argc > 1)
+        {
+            scopes = {parse_context_scope(argv[1])};
+        }
+
+        // Load the runtime and plugins once, so the first scope measured
+        // does not also pay for driver initialisation.
+        sycl::platform::get_platforms();
+
+        for (auto scope : scopes)
+        {
+            runScope(scope);
+        }
+    }
+    catch (sycl::exception const &e)
+    {
+        std::cout << "SYCL exception caught in main: " << e.what() << std::endl;
+        return 1;
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception caught in main: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,4 +1,7 @@
 #include "common.h"
+#include <chrono>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 void kernel_submission(sycl::queue queue, size_t X, const std::string& func_name)
 {
@@ -8,7 +11,14 @@ void kernel_submission(sycl::queue queue, size_t X, const std::string& func_name
 
     for (size_t i = 0; i < LOOP_COUNT; ++i)
     {
-        vecadd_kernel(queue, a, b, c, X, i, func_name);
+        if (usm_pool_enabled())
+        {
+            vecadd_kernel_usm(queue, a, b, c, X, i, func_name);
+        }
+        else
+        {
+            vecadd_kernel(queue, a, b, c, X, i, func_name);
+        }
     }
 }
 
@@ -22,4 +32,67 @@ void kernel_submission2(sycl::queue queue, size_t X, const std::string& func_nam
     {
         vecadd_kernel2(queue, a, b, c, X, i, func_name);
     }
-}
\ No newline at end of file
+}
+
+// Same loop as kernel_submission, but the vecadd command group is recorded
+// once into a CommandGraph and replayed iterations times. The buffers live
+// across the whole loop, as the graph requires, so c is written back once at
+// the end instead of after every iteration. Start and end come from the
+// profiling info of the replay's event, device times as in vecadd_kernel,
+// so overlap.py compares the same clock whatever the submission mode. A
+// backend that cannot profile graph submissions gets host times (steady
+// clock) instead, printed as "Host start" so they are not taken for
+// device times.
+void kernel_submission_graph(sycl::queue queue, size_t X, const std::string& func_name, bool emulate, size_t iterations)
+{
+    std::vector<int> a(X, 2);
+    std::vector<int> b(X, 5);
+    std::vector<int> c(X, 0);
+
+    sycl::buffer<int, 1> buffer_a(a.data(), sycl::range<1>(X));
+    sycl::buffer<int, 1> buffer_b(b.data(), sycl::range<1>(X));
+    sycl::buffer<int, 1> buffer_c(c.data(), sycl::range<1>(X));
+
+    pid_t tid = syscall(SYS_gettid);
+
+    CommandGraph graph(queue, emulate);
+    graph.add(vecadd_command(buffer_a, buffer_b, buffer_c, X));
+    graph.finalize();
+
+    auto host_us = []()
+    {
+        return std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    };
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        std::cout << "Thread " << tid << ", iteration " << i << ", " << func_name << " started.\n";
+
+        double host_start = host_us();
+        sycl::event event = graph.replay();
+        double submitted = host_us();
+        event.wait();
+        double start = host_start;
+        double end = host_us();
+
+        const char *clock = "Host";
+        try
+        {
+            auto kernel_start = event.get_profiling_info<sycl::info::event_profiling::command_start>();
+            auto kernel_end = event.get_profiling_info<sycl::info::event_profiling::command_end>();
+            start = kernel_start / 1e3;
+            end = kernel_end / 1e3;
+            clock = "Kernel";
+        }
+        catch (sycl::exception const &)
+        {
+            // no profiling info for this submission: keep the host times
+        }
+
+        std::cout << "Thread " << tid << ", iteration " << i << ", " << func_name << " executed in " << end - start << " us. "
+                  << clock << " start: " << start << " us, end: " << end << " us, " << graph.mode_name()
+                  << " replay submitted in " << submitted - host_start << " us\n";
+        print_vecadd_roofline(queue, X, tid, i, func_name, end - start);
+    }
+}
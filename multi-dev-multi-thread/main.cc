@@ -1,44 +1,101 @@
 #include <sycl/sycl.hpp>
+#include <chrono>
 #include <iostream>
 #include <thread>
 #include <omp.h>
 #include "common.h"
+#include "device_manager.h"
+#include "harness.h"
 
 
-int main()
+int main(int argc, char* argv[])
 {
     try
     {
-        std::vector<sycl::device> devices = initgpu();
-        sycl::queue queue1 = createQueue(devices[0]);
-        sycl::queue queue2 = createQueue(devices[1]);
-        sycl::queue queue3 = createQueue(devices[2]);
-        sycl::queue queue4 = createQueue(devices[3]);
+        // One context per root device, so the queues on its tiles share USM
+        // and events; pass "per-queue" to get the old one-context-per-queue setup.
+        Args args(argc, argv);
+        // --submission graph records each thread's kernel once and replays it
+        Submission submission = parse_submission(args.get("submission", "eager"));
+        // --pool runs the eager loop on device USM from the caching pool
+        if (args.flag("pool")) set_usm_pool_enabled(true);
+        DeviceManagerOptions options;
+        options.scope = ContextScope::kPerRootDevice;
+        auto positional = args.positional();
+        if (!positional.empty()) options.scope = parse_context_scope(positional[0]);
+        args.finish();
+        Harness bench("multi_dev_multi_thread", args.harness());
 
-        #pragma omp parallel num_threads(4)
+        DeviceManager manager(options);
+        std::cout << "Context scope: " << to_string(manager.scope()) << "\n";
+
+        if (manager.size() < 4)
+        {
+            std::cerr << "Need 4 devices or sub-devices, found " << manager.size() << ".\n";
+            return 1;
+        }
+
+        sycl::queue queue1 = createQueue(manager.context_for(0), manager.devices()[0]);
+        sycl::queue queue2 = createQueue(manager.context_for(1), manager.devices()[1]);
+        sycl::queue queue3 = createQueue(manager.context_for(2), manager.devices()[2]);
+        sycl::queue queue4 = createQueue(manager.context_for(3), manager.devices()[3]);
+
+        bench.set_param("size", 10000000);
+        bench.set_param("context", to_string(manager.scope()));
+        bench.set_param("submission", to_string(submission));
+        bench.set_param("pool", usm_pool_enabled() ? "on" : "off");
+
+        auto submit = [submission](sycl::queue queue, const std::string& func_name)
+        {
+            if (submission == Submission::kEager)
+            {
+                kernel_submission(queue, 10000000, func_name); // queue, X, func_name
+            }
+            else
+            {
+                kernel_submission_graph(queue, 10000000, func_name, submission == Submission::kEmulated);
+            }
+        };
+
+        // Timed once and recorded rather than through bench.run: every pass
+        // prints a full set of trace lines, and overlap.py would mix the
+        // passes together
+        auto start = std::chrono::steady_clock::now();
         {
-            #pragma omp sections nowait
+            #pragma omp parallel num_threads(4)
             {
-                #pragma omp section
-                kernel_submission(queue1, 10000000, "kernel1"); // queue, X, func_name
+                #pragma omp sections nowait
+                {
+                    #pragma omp section
+                    submit(queue1, "kernel1");
 
-                #pragma omp section
-                kernel_submission(queue2, 10000000, "kernel2");
+                    #pragma omp section
+                    submit(queue2, "kernel2");
 
-                #pragma omp section
-                kernel_submission(queue3, 10000000, "kernel3");
+                    #pragma omp section
+                    submit(queue3, "kernel3");
 
-                #pragma omp section
-                kernel_submission(queue4, 10000000, "kernel4");
+                    #pragma omp section
+                    submit(queue4, "kernel4");
+                }
             }
         }
+        bench.record("kernel_submission_x4", {std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count()});
 
         std::cout << "All threads have finished execution.\n";
+        print_usm_pool_stats(std::cout);
+        bench.report();
     }
     catch (sycl::exception const &e)
     {
         std::cout << "SYCL exception caught in main: " << e.what() << std::endl;
     }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception caught in main: " << e.what() << std::endl;
+        return 1;
+    }
 
     return 0;
 }
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <mpi.h>
 #include "common.h"
+#include "harness.h"
 
 int main(int argc, char* argv[])
 {
@@ -9,9 +10,16 @@ int main(int argc, char* argv[])
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int status = 0;
 
     try
     {
+        // --submission graph records each rank's kernel once and replays it,
+        // rank 0 for as many iterations as its eager loop runs
+        Args args(argc, argv);
+        Submission submission = parse_submission(args.get("submission", "eager"));
+        args.finish();
+
         // Each rank queries its available devices
         std::vector<sycl::device> devices = sycl::device::get_devices(sycl::info::device_type::gpu);
 
@@ -27,10 +35,14 @@ int main(int argc, char* argv[])
                   << queue.get_device().get_info<sycl::info::device::name>() << std::endl;
 
         // Perform kernel execution on the rank-specific device
-        if (rank == 0) {
-            kernel_submission2(queue, 10000000, "kernel" + std::to_string(rank));
+        std::string func_name = "kernel" + std::to_string(rank);
+        if (submission != Submission::kEager) {
+            kernel_submission_graph(queue, 10000000, func_name, submission == Submission::kEmulated,
+                                    rank == 0 ? 90 : LOOP_COUNT);
+        } else if (rank == 0) {
+            kernel_submission2(queue, 10000000, func_name);
         } else {
-            kernel_submission(queue, 10000000, "kernel" + std::to_string(rank));
+            kernel_submission(queue, 10000000, func_name);
         }
 
         MPI_Barrier(MPI_COMM_WORLD);
@@ -43,7 +55,12 @@ int main(int argc, char* argv[])
     {
         std::cout << "SYCL exception caught in main: " << e.what() << std::endl;
     }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception caught in main: " << e.what() << std::endl;
+        status = 1;
+    }
 
     MPI_Finalize();
-    return 0;
+    return status;
 }
@@ -0,0 +1,244 @@
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <tuple>
+#include <vector>
+
+#include "harness.h"
+
+using namespace sycl;
+
+// Per-launch cost of tiny kernels, where the runtime rather than the device
+// sets the pace. Every combination of
+//   queue   in_order, out_of_order
+//   kernel  single_task, parallel_for (range), parallel_for (nd_range)
+//   memory  none (empty kernel), USM pointer, buffer accessor
+//   wait    queue::wait, event::wait
+// is launched --launches times and measured four ways:
+//   submit           host time spent in submit()
+//   submit_to_start  command_submit -> command_start on a profiling queue
+//   roundtrip        submit + wait of one launch
+//   burst            --launches back-to-back submits and one wait, per launch;
+//                    the ceiling for pipelines of many small kernels
+// Buffer launches write the same buffer, so the runtime chains them even on
+// an out-of-order queue; that dependency tracking is part of what they cost.
+
+constexpr size_t ITEMS = 256;
+constexpr size_t WG_SIZE = 64;
+
+enum class KernelKind { kSingleTask, kParallelFor, kNdRange };
+enum class Memory { kNone, kUsm, kBuffer };
+
+template <KernelKind K, Memory M>
+class TinyKernel;
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+double ElapsedMs(bench_clock::time_point start, bench_clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <KernelKind K, Memory M, typename Body>
+void Launch(handler& h, Body body) {
+  if constexpr (K == KernelKind::kSingleTask) {
+    h.single_task<TinyKernel<K, M>>([=]() { body(0); });
+  } else if constexpr (K == KernelKind::kParallelFor) {
+    h.parallel_for<TinyKernel<K, M>>(range<1>(ITEMS),
+                                     [=](id<1> i) { body(i[0]); });
+  } else {
+    h.parallel_for<TinyKernel<K, M>>(
+        nd_range<1>(ITEMS, WG_SIZE),
+        [=](nd_item<1> item) { body(item.get_global_id(0)); });
+  }
+}
+
+template <KernelKind K, Memory M>
+event Submit(queue& q, int* usm, buffer<int, 1>& buf) {
+  return q.submit([&](handler& h) {
+    if constexpr (M == Memory::kNone) {
+      Launch<K, M>(h, [](size_t) {});
+    } else if constexpr (M == Memory::kUsm) {
+      Launch<K, M>(h, [=](size_t i) { usm[i] = static_cast<int>(i); });
+    } else {
+      accessor acc(buf, h, write_only);
+      Launch<K, M>(h, [=](size_t i) { acc[i] = static_cast<int>(i); });
+    }
+  });
+}
+
+using SubmitFn = event (*)(queue&, int*, buffer<int, 1>&);
+
+template <KernelKind K>
+SubmitFn SelectSubmit(Memory m) {
+  switch (m) {
+    case Memory::kNone:
+      return &Submit<K, Memory::kNone>;
+    case Memory::kUsm:
+      return &Submit<K, Memory::kUsm>;
+    default:
+      return &Submit<K, Memory::kBuffer>;
+  }
+}
+
+SubmitFn SelectSubmit(KernelKind k, Memory m) {
+  switch (k) {
+    case KernelKind::kSingleTask:
+      return SelectSubmit<KernelKind::kSingleTask>(m);
+    case KernelKind::kParallelFor:
+      return SelectSubmit<KernelKind::kParallelFor>(m);
+    default:
+      return SelectSubmit<KernelKind::kNdRange>(m);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  try {
+    // Launch overhead lives in the tail, so keep every sample by default.
+    HarnessOptions defaults;
+    defaults.outlier = 0.0;
+    Args args(argc, argv, defaults);
+    int launches = static_cast<int>(args.get_int("launches", 1000));
+    args.finish();
+
+    device dev(default_selector_v);
+    context ctx(dev);
+    std::cout << "Running on device: " << dev.get_info<info::device::name>()
+              << "\n";
+    std::cout << "Launches per configuration: " << launches << "\n";
+
+    int* usm = malloc_device<int>(ITEMS, dev, ctx);
+    buffer<int, 1> buf{range<1>(ITEMS)};
+
+    Harness bench("launch_latency", args.harness());
+    bench.set_param("device", dev.get_info<info::device::name>());
+    bench.set_param("launches", launches);
+    int warmup = args.harness().warmup;
+
+    const std::vector<std::pair<const char*, bool>> orders = {
+        {"in_order", true}, {"out_of_order", false}};
+    const std::vector<std::pair<const char*, KernelKind>> kernels = {
+        {"single_task", KernelKind::kSingleTask},
+        {"parallel_for", KernelKind::kParallelFor},
+        {"nd_range", KernelKind::kNdRange}};
+    const std::vector<std::pair<const char*, Memory>> memories = {
+        {"none", Memory::kNone}, {"usm", Memory::kUsm},
+        {"buffer", Memory::kBuffer}};
+    const std::vector<std::pair<const char*, bool>> waits = {
+        {"queue", true}, {"event", false}};
+
+    // Medians in us per configuration, for the summary table
+    using Row = std::tuple<double, double, double, double>;
+    std::map<std::string, Row> table;
+
+    for (const auto& [order_name, in_order] : orders) {
+      property_list plain_props = in_order
+                                      ? property_list{property::queue::in_order{}}
+                                      : property_list{};
+      property_list profiled_props =
+          in_order ? property_list{property::queue::in_order{},
+                                   property::queue::enable_profiling{}}
+                   : property_list{property::queue::enable_profiling{}};
+      queue plain(ctx, dev, harness_exception_handler, plain_props);
+      queue profiled(ctx, dev, harness_exception_handler, profiled_props);
+
+      for (const auto& [kernel_name, kind] : kernels) {
+        for (const auto& [memory_name, memory] : memories) {
+          SubmitFn submit = SelectSubmit(kind, memory);
+          for (const auto& w : waits) {
+            // Plain copies, as structured bindings cannot be captured in C++17
+            const char* wait_name = w.first;
+            bool queue_wait = w.second;
+            bench.set_param("queue", order_name);
+            bench.set_param("kernel", kernel_name);
+            bench.set_param("memory", memory_name);
+            bench.set_param("wait", wait_name);
+
+            auto wait = [&](queue& q, event& e) {
+              if (queue_wait) {
+                q.wait();
+              } else {
+                e.wait();
+              }
+            };
+
+            for (int i = 0; i < warmup; i++) {
+              event e = submit(plain, usm, buf);
+              wait(plain, e);
+            }
+
+            std::vector<double> submit_ms, roundtrip_ms;
+            submit_ms.reserve(launches);
+            roundtrip_ms.reserve(launches);
+            for (int i = 0; i < launches; i++) {
+              auto t0 = bench_clock::now();
+              event e = submit(plain, usm, buf);
+              auto t1 = bench_clock::now();
+              wait(plain, e);
+              auto t2 = bench_clock::now();
+              submit_ms.push_back(ElapsedMs(t0, t1));
+              roundtrip_ms.push_back(ElapsedMs(t0, t2));
+            }
+
+            // Device-side queueing delay; profiling has a cost of its own,
+            // so it gets a separate queue and pass
+            std::vector<double> start_ms;
+            start_ms.reserve(launches);
+            for (int i = 0; i < warmup + launches; i++) {
+              event e = submit(profiled, usm, buf);
+              wait(profiled, e);
+              if (i < warmup) continue;
+              auto queued =
+                  e.get_profiling_info<info::event_profiling::command_submit>();
+              auto start =
+                  e.get_profiling_info<info::event_profiling::command_start>();
+              start_ms.push_back((start - queued) / 1e6);
+            }
+
+            Stats submit_s = bench.record("submit", submit_ms);
+            Stats start_s = bench.record("submit_to_start", start_ms);
+            Stats roundtrip_s = bench.record("roundtrip", roundtrip_ms);
+
+            std::vector<event> events(launches);
+            Stats burst_s = bench.run_measured("burst", [&]() {
+              auto t0 = bench_clock::now();
+              for (int i = 0; i < launches; i++) {
+                events[i] = submit(plain, usm, buf);
+              }
+              if (queue_wait) {
+                plain.wait();
+              } else {
+                event::wait(events);
+              }
+              return ElapsedMs(t0, bench_clock::now()) / launches;
+            });
+
+            std::string config = std::string(order_name) + "," + kernel_name +
+                                 "," + memory_name + "," + wait_name;
+            table[config] = {submit_s.median * 1e3, start_s.median * 1e3,
+                             roundtrip_s.median * 1e3, burst_s.median * 1e3};
+          }
+        }
+      }
+    }
+
+    free(usm, ctx);
+
+    std::cout << "\nqueue,kernel,memory,wait,submit_us,submit_to_start_us,"
+                 "roundtrip_us,burst_us_per_launch\n";
+    for (const auto& [config, row] : table) {
+      std::cout << config << "," << std::get<0>(row) << ","
+                << std::get<1>(row) << "," << std::get<2>(row) << ","
+                << std::get<3>(row) << "\n";
+    }
+    std::cout << "\n";
+
+    bench.report();
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+
+  return 0;
+}
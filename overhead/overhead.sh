@@ -1,6 +1,15 @@
 #!/bin/bash
 
-# Compile the latest program
+# Instrumentation overhead, measured two ways:
+#   1. overhead_bench launches a fixed set of kernels without instrumentation,
+#      with the multi-dev-multi-thread trace lines and with profiling queues, and
+#      again under hpcrun and/or unitrace when they are installed; it
+#      reports per-kernel, per-launch overhead distributions.
+#   2. End-to-end wall time of matmul_xgpu with and without hpcrun, as
+#      before, for demo.ipynb.
+
+# Compile the latest programs
+make -C . all
 make -C ../matmul matmul_xgpu
 
 GPU_COUNT=1
@@ -11,12 +20,49 @@ TARGET_FILE_2="time_overhead_${GPU_COUNT}gpu.txt"
 PROGRAM_1="../matmul/matmul_xgpu $GPU_COUNT --iterations $KERNEL_LAUNCH_ITERATIONS"
 PROGRAM_2="hpcrun -e gpu=level0,pc ../matmul/matmul_xgpu $GPU_COUNT --iterations $KERNEL_LAUNCH_ITERATIONS"
 
+# 1. In-binary study; each JSON file can be ingested with ../benchstore.py
+echo "== overhead_bench: none, trace, profiling"
+./overhead_bench --launches $KERNEL_LAUNCH_ITERATIONS --format json --report overhead_inproc.json
+
+if command -v hpcrun > /dev/null; then
+    echo "== overhead_bench under hpcrun"
+    hpcrun -e gpu=level0 ./overhead_bench --launches $KERNEL_LAUNCH_ITERATIONS --tool hpcrun \
+        --format json --report overhead_hpcrun.json
+fi
+if command -v unitrace > /dev/null; then
+    echo "== overhead_bench under unitrace"
+    unitrace --chrome-kernel-logging ./overhead_bench --launches $KERNEL_LAUNCH_ITERATIONS --tool unitrace \
+        --format json --report overhead_unitrace.json
+fi
+
+# Launch latency of empty and tiny kernels, without a profiler
+echo "== launch_latency"
+./launch_latency --launches $KERNEL_LAUNCH_ITERATIONS --format json --report launch_latency.json
+
+# Median and p95 per-launch cost of each external tool against the in-process baseline
+for TOOL_FILE in overhead_hpcrun.json overhead_unitrace.json; do
+    [ -f $TOOL_FILE ] || continue
+    python3 - overhead_inproc.json $TOOL_FILE <<'PYEOF'
+import json, sys
+base = {r["benchmark"]: r for r in json.load(open(sys.argv[1]))["results"]
+        if r["params"].get("mode") == "none"}
+for r in json.load(open(sys.argv[2]))["results"]:
+    b = base.get(r["benchmark"])
+    if b:
+        print(f'{r["benchmark"]},{r["params"]["tool"]}: median +{(r["median_ms"] - b["median_ms"]) * 1e3:.2f} us '
+              f'({(r["median_ms"] - b["median_ms"]) / b["median_ms"] * 100:+.1f}%), '
+              f'p95 +{(r["p95_ms"] - b["p95_ms"]) * 1e3:.2f} us per launch')
+PYEOF
+done
+
+# 2. End-to-end wall time with and without hpcrun
 # Clear content of the target files
 > $TARGET_FILE_1
 > $TARGET_FILE_2
 
-# Run the baseline program
-for i in {1..$ITERATIONS}
+# Run the baseline program; brace expansion happens before variable
+# expansion, so {1..$ITERATIONS} would run once -- use seq
+for i in $(seq 1 $ITERATIONS)
 do
     echo "Run $i:" >> $TARGET_FILE_1
     { time $PROGRAM_1 > /dev/null ; } 2>> $TARGET_FILE_1
@@ -24,9 +70,11 @@ do
 done
 
 # Run the overhead program
-for i in {1..$ITERATIONS}
-do
-    echo "Run $i:" >> $TARGET_FILE_2
-    { time $PROGRAM_2 > /dev/null ; } 2>> $TARGET_FILE_2
-    echo "" >> $TARGET_FILE_2
-done
+if command -v hpcrun > /dev/null; then
+    for i in $(seq 1 $ITERATIONS)
+    do
+        echo "Run $i:" >> $TARGET_FILE_2
+        { time $PROGRAM_2 > /dev/null ; } 2>> $TARGET_FILE_2
+        echo "" >> $TARGET_FILE_2
+    done
+fi
@@ -0,0 +1,218 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+#include "harness.h"
+
+using namespace sycl;
+
+// Cost of instrumentation on a fixed workload. Every kernel is launched
+// --launches times in each mode, and each launch (submit, wait and whatever
+// the mode records) is one sample:
+//   none       plain in-order queue; the baseline
+//   trace      what the multi-dev-multi-thread samples do for the traces
+//              overlap.py reads: a profiling queue, a "started" line before
+//              every launch and an "executed in" line with the device start
+//              and end after it, streamed to --trace-file as they go
+//   profiling  queue with enable_profiling; device start/end are read back
+//              after every launch, without the trace lines
+//   external   plain queue, run under an external tool; overhead.sh starts
+//              the binary under hpcrun or unitrace with --tool <name>
+// The overhead of a mode is its per-launch distribution against the
+// baseline's, reported per kernel at the median and the p95.
+
+constexpr size_t VEC_SIZE = 1 << 20;
+constexpr int MAT_SIZE = 256;
+
+class EmptyKernel;
+class VecAddKernel;
+class MatmulKernel;
+
+using bench_clock = std::chrono::high_resolution_clock;
+
+enum class Mode { kNone, kTrace, kProfiling, kExternal };
+
+Mode ParseMode(const std::string& name) {
+  if (name == "none") return Mode::kNone;
+  if (name == "trace") return Mode::kTrace;
+  if (name == "profiling") return Mode::kProfiling;
+  throw std::invalid_argument("Unknown mode: " + name);
+}
+
+// One sample per launch, in ms. device_ms gets the kernel's device time in
+// profiling mode; trace mode writes the sample's lines to trace, in the
+// format and at the points of vecadd_kernel in
+// multi-dev-multi-thread/common.cc.
+template <typename Launch>
+std::vector<double> RunLaunches(queue& q, Mode mode, const char* kernel,
+                                int warmup, int launches, std::ostream& trace,
+                                std::vector<double>& device_ms,
+                                Launch launch) {
+  for (int i = 0; i < warmup; i++) launch(q).wait();
+
+  pid_t tid = syscall(SYS_gettid);
+  std::vector<double> samples;
+  samples.reserve(launches);
+  for (int i = 0; i < launches; i++) {
+    auto start = bench_clock::now();
+    if (mode == Mode::kTrace) {
+      trace << "Thread " << tid << ", iteration " << i << ", " << kernel
+            << " started.\n";
+    }
+    event e = launch(q);
+    e.wait();
+    if (mode == Mode::kTrace || mode == Mode::kProfiling) {
+      auto begin = e.get_profiling_info<info::event_profiling::command_start>();
+      auto end = e.get_profiling_info<info::event_profiling::command_end>();
+      if (mode == Mode::kTrace) {
+        trace << "Thread " << tid << ", iteration " << i << ", " << kernel
+              << " executed in " << (end - begin) / 1e3
+              << " us. Kernel start: " << begin / 1e3
+              << " us, end: " << end / 1e3 << "\n";
+      } else {
+        device_ms.push_back((end - begin) / 1e6);
+      }
+    }
+    samples.push_back(
+        std::chrono::duration<double, std::milli>(bench_clock::now() - start)
+            .count());
+  }
+  return samples;
+}
+
+int main(int argc, char* argv[]) {
+  try {
+    // Overheads live in the tail, so keep every sample by default.
+    HarnessOptions defaults;
+    defaults.outlier = 0.0;
+    Args args(argc, argv, defaults);
+    int launches = static_cast<int>(args.get_int("launches", 1000));
+    std::string modes_arg = args.get("modes", "none,trace,profiling");
+    std::string tool = args.get("tool", "");
+    std::string trace_file = args.get("trace-file", "overhead_trace.txt");
+    args.finish();
+
+    std::vector<std::string> mode_names;
+    if (!tool.empty()) {
+      mode_names = {"external"};  // everything runs under the tool
+    } else {
+      std::stringstream ss(modes_arg);
+      std::string name;
+      while (std::getline(ss, name, ',')) {
+        ParseMode(name);
+        mode_names.push_back(name);
+      }
+    }
+
+    queue plain(default_selector_v, harness_exception_handler,
+                property::queue::in_order{});
+    queue profiled(plain.get_context(), plain.get_device(),
+                   harness_exception_handler,
+                   property_list{property::queue::in_order{},
+                                 property::queue::enable_profiling{}});
+
+    std::string device = plain.get_device().get_info<info::device::name>();
+    std::cout << "Running on device: " << device << "\n";
+    std::cout << "Launches per kernel and mode: " << launches << "\n";
+
+    float* a = malloc_device<float>(VEC_SIZE, plain);
+    float* b = malloc_device<float>(VEC_SIZE, plain);
+    float* c = malloc_device<float>(VEC_SIZE, plain);
+    plain.fill(a, 1.0f, VEC_SIZE);
+    plain.fill(b, 2.0f, VEC_SIZE);
+    plain.fill(c, 0.0f, VEC_SIZE).wait();
+
+    Harness bench("overhead_bench", args.harness());
+    bench.set_param("device", device);
+    bench.set_param("launches", launches);
+    if (!tool.empty()) bench.set_param("tool", tool);
+
+    bool tracing = std::find(mode_names.begin(), mode_names.end(),
+                             "trace") != mode_names.end();
+    std::ofstream trace;
+    if (tracing) trace.open(trace_file);
+    std::map<std::string, std::map<std::string, Stats>> stats;  // kernel, mode
+    int warmup = args.harness().warmup;
+
+    for (const auto& mode_name : mode_names) {
+      Mode mode = mode_name == "external" ? Mode::kExternal
+                                          : ParseMode(mode_name);
+      queue& q =
+          mode == Mode::kProfiling || mode == Mode::kTrace ? profiled : plain;
+      bench.set_param("mode", mode_name);
+
+      auto measure = [&](const char* kernel, auto launch) {
+        std::vector<double> device_ms;
+        auto samples = RunLaunches(q, mode, kernel, warmup, launches, trace,
+                                   device_ms, launch);
+        stats[kernel][mode_name] = bench.record(kernel, samples);
+        if (!device_ms.empty()) {
+          bench.record(std::string(kernel) + "/device", device_ms);
+        }
+      };
+
+      measure("empty", [](queue& q) {
+        return q.single_task<EmptyKernel>([]() {});
+      });
+      measure("vecadd", [=](queue& q) {
+        return q.parallel_for<VecAddKernel>(
+            range<1>(VEC_SIZE), [=](id<1> i) { c[i] = a[i] + b[i]; });
+      });
+      measure("matmul", [=](queue& q) {
+        return q.parallel_for<MatmulKernel>(
+            range<2>(MAT_SIZE, MAT_SIZE), [=](id<2> index) {
+              int row = index[0];
+              int col = index[1];
+              float sum = 0.0f;
+              for (int k = 0; k < MAT_SIZE; k++) {
+                sum += a[row * MAT_SIZE + k] * b[k * MAT_SIZE + col];
+              }
+              c[row * MAT_SIZE + col] = sum;
+            });
+      });
+    }
+
+    free(a, plain);
+    free(b, plain);
+    free(c, plain);
+
+    if (tracing) std::cout << "Trace written to " << trace_file << "\n";
+
+    // Per-launch overhead against the baseline, per kernel
+    std::cout << "\nkernel,mode,median_us,p95_us,median_overhead_us,"
+                 "median_overhead_pct,p95_overhead_us\n";
+    for (const auto& [kernel, by_mode] : stats) {
+      auto base = by_mode.find("none");
+      for (const auto& [mode, s] : by_mode) {
+        std::cout << kernel << "," << mode << "," << s.median * 1e3 << ","
+                  << s.p95 * 1e3;
+        if (base != by_mode.end() && mode != "none") {
+          const Stats& b = base->second;
+          std::cout << "," << (s.median - b.median) * 1e3 << ","
+                    << (s.median - b.median) / b.median * 100 << ","
+                    << (s.p95 - b.p95) * 1e3;
+        } else {
+          std::cout << ",,,";
+        }
+        std::cout << "\n";
+      }
+    }
+    std::cout << "\n";
+
+    bench.report();
+  } catch (std::exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <sycl/sycl.hpp>
+#include <vector>
+
+using namespace sycl;
+
+// Time the first launch of each kernel against its steady-state launch.
+// Built with -fsycl-device-code-split=per_kernel, so each kernel has its own
+// device image and the first launch pays only for that kernel's compilation:
+//   JIT build, empty cache      -> first launch includes SPIR-V compilation
+//   JIT build, persistent cache -> first launch loads the cached binary
+//   AOT build                   -> first launch loads the embedded binary
+// startup.sh runs the three configurations and collects the CSV lines.
+
+constexpr size_t VEC_SIZE = 1 << 20;
+constexpr int MAT_SIZE = 256;
+constexpr int ACC_LOOP = 2000;
+constexpr int STEADY_REPS = 10;
+
+class VecAddKernel;
+class MatmulKernel;
+class AccumulateKernel;
+
+static auto exception_handler = [](sycl::exception_list e_list) {
+  for (std::exception_ptr const& e : e_list) {
+    try {
+      std::rethrow_exception(e);
+    } catch (std::exception const& e) {
+#if _DEBUG
+      std::cout << "Failure" << std::endl;
+#endif
+      std::terminate();
+    }
+  }
+};
+
+// Returns the host-side time of submit + wait in microseconds.
+template <typename Launch>
+double TimeLaunch(queue& q, Launch launch) {
+  auto start = std::chrono::high_resolution_clock::now();
+  launch(q).wait();
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+template <typename Launch>
+void Measure(queue& q, const std::string& mode, const std::string& name,
+             Launch launch) {
+  double first_us = TimeLaunch(q, launch);
+
+  std::vector<double> steady;
+  for (int i = 0; i < STEADY_REPS; i++) steady.push_back(TimeLaunch(q, launch));
+  std::sort(steady.begin(), steady.end());
+  double steady_us = steady[steady.size() / 2];
+
+  std::cout << "startup," << mode << "," << name << "," << first_us << ","
+            << steady_us << "," << first_us - steady_us << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "jit";
+
+  try {
+    auto queue_start = std::chrono::high_resolution_clock::now();
+    queue q(default_selector_v, exception_handler);
+    auto queue_end = std::chrono::high_resolution_clock::now();
+
+    std::cout << "Running on device: "
+              << q.get_device().get_info<info::device::name>() << "\n";
+    std::cout << "Queue creation: "
+              << std::chrono::duration<double, std::micro>(queue_end -
+                                                           queue_start)
+                     .count()
+              << " us\n";
+
+    float* a = malloc_device<float>(VEC_SIZE, q);
+    float* b = malloc_device<float>(VEC_SIZE, q);
+    float* c = malloc_device<float>(VEC_SIZE, q);
+    q.fill(a, 1.0f, VEC_SIZE);
+    q.fill(b, 2.0f, VEC_SIZE);
+    q.fill(c, 0.0f, VEC_SIZE).wait();
+
+    std::cout << "# mode,kernel,first_launch_us,steady_launch_us,"
+                 "startup_overhead_us\n";
+
+    Measure(q, mode, "vecadd", [=](queue& q) {
+      return q.parallel_for<VecAddKernel>(
+          range<1>(VEC_SIZE), [=](id<1> i) { c[i] = a[i] + b[i]; });
+    });
+
+    Measure(q, mode, "matmul", [=](queue& q) {
+      return q.parallel_for<MatmulKernel>(
+          range<2>(MAT_SIZE, MAT_SIZE), [=](id<2> index) {
+            int row = index[0];
+            int col = index[1];
+            float sum = 0.0f;
+            for (int k = 0; k < MAT_SIZE; k++) {
+              sum += a[row * MAT_SIZE + k] * b[k * MAT_SIZE + col];
+            }
+            c[row * MAT_SIZE + col] = sum;
+          });
+    });
+
+    // Same access pattern as the multi-dev-multi-thread and intel4-2m kernels
+    Measure(q, mode, "accumulate", [=](queue& q) {
+      return q.parallel_for<AccumulateKernel>(
+          range<1>(VEC_SIZE), [=](id<1> i) {
+            for (int kk = 0; kk < ACC_LOOP; kk++) {
+              c[i] = c[i] + a[VEC_SIZE - 1 - kk] / float(ACC_LOOP) +
+                     b[kk] / float(ACC_LOOP);
+            }
+          });
+    });
+
+    free(a, q);
+    free(b, q);
+    free(c, q);
+  } catch (exception const& e) {
+    std::cout << "An exception is caught: " << e.what() << "\n";
+    return -1;
+  }
+
+  return 0;
+}
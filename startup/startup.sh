@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Report first-launch cost per kernel for:
+#   jit-cold   JIT build, persistent caches disabled: the SYCL runtime's and
+#              the GPU driver's (NEO), which keeps its own compiled kernels
+#   jit-cache  JIT build, both caches already populated, in a fresh directory
+#   aot-cpu    AOT build for spir64_x86_64 (only meaningful on the CPU device)
+#   aot-gpu    AOT build for GPU_DEVICE, when jit_startup_aot_gpu was built
+# Pick the device with ONEAPI_DEVICE_SELECTOR, e.g. opencl:cpu or level_zero:gpu.
+
+make -C . all
+
+RESULT_FILE="startup_results.csv"
+CACHE_DIR=$(mktemp -d)
+
+echo "mode,kernel,first_launch_us,steady_launch_us,startup_overhead_us" > $RESULT_FILE
+
+run() {
+    local mode=$1
+    shift
+    echo "== $mode"
+    "$@" $mode | tee /dev/stderr | grep '^startup,' | cut -d, -f2- >> $RESULT_FILE
+}
+
+run jit-cold env SYCL_CACHE_PERSISTENT=0 NEO_CACHE_PERSISTENT=0 ./jit_startup
+
+# First run fills the caches, the second one is measured
+CACHE_ENV="SYCL_CACHE_PERSISTENT=1 SYCL_CACHE_DIR=$CACHE_DIR/sycl NEO_CACHE_PERSISTENT=1 NEO_CACHE_DIR=$CACHE_DIR/neo"
+mkdir -p $CACHE_DIR/sycl $CACHE_DIR/neo
+env $CACHE_ENV ./jit_startup warmup > /dev/null
+run jit-cache env $CACHE_ENV ./jit_startup
+
+run aot-cpu env SYCL_CACHE_PERSISTENT=0 ./jit_startup_aot_cpu
+
+if [ -x ./jit_startup_aot_gpu ]; then
+    run aot-gpu env SYCL_CACHE_PERSISTENT=0 ./jit_startup_aot_gpu
+fi
+
+rm -rf $CACHE_DIR
+
+echo ""
+echo "Per-kernel startup overhead (us), first launch minus steady-state launch:"
+column -s, -t $RESULT_FILE
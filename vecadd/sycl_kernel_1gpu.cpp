@@ -3,6 +3,13 @@
 #include <iostream>
 #include <string>
 #include <sycl/sycl.hpp>
+#include <vector>
+
+#include "harness.h"
+#include "matio.h"
+#include "roofline.h"
+#include "usm_policy.h"
+#include "usm_pool.h"
 
 using namespace sycl;
 
@@ -10,20 +17,6 @@ using namespace sycl;
 size_t array_size = 100000000;
 constexpr int ITERATIONS = 100;
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 //************************************
 // Vector add in SYCL on device: returns sum in 4th parameter "sum".
 //************************************
@@ -33,6 +26,26 @@ void VectorAdd(queue &q, const int *a, const int *b, int *sum, size_t size) {
   e.wait();
 }
 
+//************************************
+// Work of one VectorAdd: an integer add per element; a and b read, sum
+// written.
+//************************************
+KernelCost VectorAddCost(size_t size) {
+  KernelCost cost;
+  cost.flops = size;
+  cost.bytes = 3.0 * size * sizeof(int);
+  return cost;
+}
+
+//************************************
+// Host milliseconds since start.
+//************************************
+double ElapsedMs(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
+
 //************************************
 // Initialize the array from 0 to array_size - 1
 //************************************
@@ -46,64 +59,135 @@ void InitializeArray(int *a, size_t size) {
 int main(int argc, char *argv[]) {
   auto total_start_time = std::chrono::high_resolution_clock::now();
 
-  if (argc > 1) array_size = std::stoi(argv[1]);
-
   auto selector = default_selector_v;
 
   try {
-    queue q(selector, exception_handler);
+    // [size] plus the harness options; one repetition is one kernel launch.
+    // --pool allocates through the caching USM pool. --usm-policy picks the
+    // hints for the shared arrays (none, prefetch, read-mostly, preferred)
+    // and --prefetch-back migrates the result to the host before verifying.
+    // --input a,b reads the two int32 vectors from matrix files instead of
+    // generating them, the size coming from the files; --output writes the
+    // sum to one.
+    HarnessOptions defaults;
+    defaults.repetitions = ITERATIONS;
+    Args args(argc, argv, defaults);
+    if (args.flag("pool")) set_usm_pool_enabled(true);
+    UsmPolicy policy = parse_usm_policy(args.get("usm-policy", "none"));
+    bool prefetch_back = args.flag("prefetch-back");
+    std::string input = args.get("input", "");
+    std::string output = args.get("output", "");
+    array_size = args.positional_int(0, array_size);
+    args.finish();
+    Harness bench("vecadd_1gpu", args.harness());
+
+    queue q(selector, harness_exception_handler);
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: "
               << q.get_device().get_info<info::device::name>() << "\n";
+    DevicePeaks peaks = measure_peaks(q);
+    print_peaks(std::cout, "0", peaks);
+
+    std::vector<MatrixFile> inputs;
+    if (!input.empty()) {
+      for (const auto &path : parse_matrix_paths(input, 2)) {
+        inputs.push_back(MatrixFile::open(path));
+      }
+      array_size = inputs[0].elements();
+      for (auto &file : inputs) file.expect<int>(1, array_size);
+    }
     std::cout << "Vector size: " << array_size << "\n";
 
     // Create arrays with "array_size" to store input and output data. Allocate
     // unified shared memory so that both CPU and device can access them.
-    int *a = malloc_shared<int>(array_size, q);
-    int *b = malloc_shared<int>(array_size, q);
-    int *sum_sequential = malloc_shared<int>(array_size, q);
-    int *sum_parallel = malloc_shared<int>(array_size, q);
+    int *a = usm_malloc<int>(array_size, usm::alloc::shared, q);
+    int *b = usm_malloc<int>(array_size, usm::alloc::shared, q);
+    int *sum_sequential = usm_malloc<int>(array_size, usm::alloc::shared, q);
+    int *sum_parallel = usm_malloc<int>(array_size, usm::alloc::shared, q);
 
     if ((a == nullptr) || (b == nullptr) || (sum_sequential == nullptr) ||
         (sum_parallel == nullptr)) {
-      if (a != nullptr) free(a, q);
-      if (b != nullptr) free(b, q);
-      if (sum_sequential != nullptr) free(sum_sequential, q);
-      if (sum_parallel != nullptr) free(sum_parallel, q);
+      usm_free(a, q);
+      usm_free(b, q);
+      usm_free(sum_sequential, q);
+      usm_free(sum_parallel, q);
 
       std::cout << "Shared memory allocation failure.\n";
       return -1;
     }
 
-    // Initialize input arrays with values from 0 to array_size - 1
-    InitializeArray(a, array_size);
-    InitializeArray(b, array_size);
+    // Initialize input arrays with values from 0 to array_size - 1, or
+    // copy them straight out of the mapped input files
+    auto start = std::chrono::high_resolution_clock::now();
+    if (inputs.empty()) {
+      InitializeArray(a, array_size);
+      InitializeArray(b, array_size);
+    } else {
+      inputs[0].read_into(q, a);
+      inputs[1].read_into(q, b);
+      bench.record("load", {ElapsedMs(start)});
+      inputs.clear();
+    }
 
     // Compute the sum of two arrays in sequential for validation.
     for (size_t i = 0; i < array_size; i++) sum_sequential[i] = a[i] + b[i];
 
     // Vector addition in SYCL.
-    auto kernel_start_time = std::chrono::high_resolution_clock::now();
-    for (int iter = 0; iter < ITERATIONS; iter++) {
-      VectorAdd(q, a, b, sum_parallel, array_size);
-
-      if (iter % 10 == 0) {
-        std::cout << "Completed iteration " << iter << std::endl;
-      }
+    bench.set_param("size", array_size);
+    bench.set_param("device", q.get_device().get_info<info::device::name>());
+    bench.set_param("usm_policy", to_string(policy));
+
+    // The arrays were last touched on the host. "migrate" is what the
+    // policy moves ahead of the kernel, "first_kernel" the first launch,
+    // which migrates whatever is left on demand; the repetitions after it
+    // run on resident pages.
+    size_t bytes = array_size * sizeof(int);
+    std::vector<UsmRange> ranges = {
+        {a, bytes, true}, {b, bytes, true}, {sum_parallel, bytes, false}};
+    start = std::chrono::high_resolution_clock::now();
+    for (auto &e : apply_usm_policy(q, policy, ranges)) e.wait();
+    Stats migrate = bench.record("migrate", {ElapsedMs(start)});
+    start = std::chrono::high_resolution_clock::now();
+    VectorAdd(q, a, b, sum_parallel, array_size);
+    Stats first = bench.record("first_kernel", {ElapsedMs(start)});
+
+    Stats stats = bench.run(
+        "vecadd", [&]() { VectorAdd(q, a, b, sum_parallel, array_size); });
+
+    RooflinePoint point = roofline(VectorAddCost(array_size), stats.median,
+                                   peaks, Precision::kInt);
+    print_roofline(std::cout, "vecadd", point);
+    annotate_roofline(bench, point);
+
+    double migrate_back_ms = 0.0;
+    if (prefetch_back) {
+      start = std::chrono::high_resolution_clock::now();
+      prefetch_to_host({{sum_parallel, bytes, false}});
+      migrate_back_ms = bench.record("migrate_back", {ElapsedMs(start)}).median;
     }
-    auto kernel_end_time = std::chrono::high_resolution_clock::now();
-    auto kernel_duration =
-        std::chrono::duration_cast<std::chrono::milliseconds>(
-            kernel_end_time - kernel_start_time);
 
     // Verify that the two arrays are equal.
+    start = std::chrono::high_resolution_clock::now();
     for (size_t i = 0; i < array_size; i++) {
       if (sum_parallel[i] != sum_sequential[i]) {
         std::cout << "Vector add failed on device.\n";
         return -1;
       }
     }
+    Stats verify = bench.record("verify", {ElapsedMs(start)});
+
+    if (!output.empty()) {
+      start = std::chrono::high_resolution_clock::now();
+      save_vector(output, q, sum_parallel, array_size);
+      bench.record("store", {ElapsedMs(start)});
+      std::cout << "Sum written to " << output << "\n";
+    }
+
+    std::cout << "USM policy " << to_string(policy) << ": migrate "
+              << migrate.median << " ms, first kernel " << first.median
+              << " ms, kernel " << stats.median << " ms, migrate back "
+              << migrate_back_ms << " ms, verify " << verify.median << " ms\n";
 
     int indices[]{0, 1, 2, (static_cast<int>(array_size) - 1)};
     constexpr size_t indices_size = sizeof(indices) / sizeof(int);
@@ -112,21 +196,23 @@ int main(int argc, char *argv[]) {
     for (int i = 0; i < indices_size; i++) {
       int j = indices[i];
       if (i == indices_size - 1) std::cout << "...\n";
-      std::cout << "[" << j << "]: " << j << " + " << j << " = "
+      std::cout << "[" << j << "]: " << a[j] << " + " << b[j] << " = "
                 << sum_sequential[j] << "\n";
     }
 
-    free(a, q);
-    free(b, q);
-    free(sum_sequential, q);
-    free(sum_parallel, q);
+    usm_free(a, q);
+    usm_free(b, q);
+    usm_free(sum_sequential, q);
+    usm_free(sum_parallel, q);
 
-    std::cout << "Kernel execution time for " << ITERATIONS
-              << " iterations: " << kernel_duration.count()
-              << " milliseconds\n";
+    print_usm_pool_stats(std::cout);
+    bench.report();
   } catch (exception const &e) {
     std::cout << "An exception is caught while adding two vectors.\n";
     std::terminate();
+  } catch (std::exception const &e) {
+    std::cout << "Error: " << e.what() << "\n";
+    return -1;
   }
 
   auto total_end_time = std::chrono::high_resolution_clock::now();
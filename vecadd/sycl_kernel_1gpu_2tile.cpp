@@ -5,37 +5,29 @@
 #include <sycl/sycl.hpp>
 #include <vector>
 
+#include "harness.h"
+#include "topology.h"
+#include "usm_policy.h"
+
 using namespace sycl;
 
 // Array size for this example.
 size_t array_size = 100000000;
 
-// Create an exception handler for asynchronous SYCL exceptions
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 //************************************
 // Vector add in SYCL on device: returns sum in 4th parameter "sum".
 //************************************
 void VectorAdd(queue &q1, queue &q2, const int *a, const int *b, int *sum,
                size_t size) {
+  // The second half takes the odd element out
   size_t half_size = size / 2;
   range<1> num_items_half{half_size};
+  range<1> num_items_rest{size - half_size};
 
   auto e1 =
       q1.parallel_for(num_items_half, [=](auto i) { sum[i] = a[i] + b[i]; });
 
-  auto e2 = q2.parallel_for(num_items_half, [=](auto i) {
+  auto e2 = q2.parallel_for(num_items_rest, [=](auto i) {
     size_t offset = half_size;
     sum[i + offset] = a[i + offset] + b[i + offset];
   });
@@ -44,6 +36,15 @@ void VectorAdd(queue &q1, queue &q2, const int *a, const int *b, int *sum,
   e2.wait();
 }
 
+//************************************
+// Host milliseconds since start.
+//************************************
+double ElapsedMs(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - start)
+      .count();
+}
+
 //************************************
 // Initialize the array from 0 to array_size - 1
 //************************************
@@ -57,45 +58,57 @@ void InitializeArray(int *a, size_t size) {
 int main(int argc, char *argv[]) {
   auto start_time = std::chrono::high_resolution_clock::now();
 
-  // Change array_size if it was passed as argument
-  if (argc > 1) array_size = std::stoi(argv[1]);
-
   try {
-    // Select GPU device
-    device gpu_device;
-    auto platforms = platform::get_platforms();
-    for (auto &platform : platforms) {
-      auto devices = platform.get_devices(info::device_type::gpu);
-      if (!devices.empty()) {
-        gpu_device = devices[0];
-        break;
-      }
-    }
-    if (gpu_device.get_info<info::device::name>().empty()) {
+    // Change array_size if it was passed as argument. --usm-policy picks
+    // the hints for the shared arrays (none, prefetch, read-mostly,
+    // preferred: each tile's half on that tile) and --prefetch-back
+    // migrates the result to the host before verifying.
+    Args args(argc, argv);
+    UsmPolicy policy = parse_usm_policy(args.get("usm-policy", "none"));
+    bool prefetch_back = args.flag("prefetch-back");
+    array_size = args.positional_int(0, array_size);
+    args.finish();
+    Harness bench("vecadd_1gpu_2tile", args.harness());
+
+    // Tiles of the GPUs from the cached topology, as narrowed down by
+    // $SYCL_SAMPLES_DEVICES (e.g. root=1 for the second GPU, or index=1:0
+    // for its tiles the other way round); the first two selected tiles of
+    // the first selected root device are used
+    Topology topology = Topology::load();
+    TopologyFilter filter;
+    filter.type = "gpu";
+    filter.tiles = true;
+    auto selected = topology.select(topology_filter_from_env(filter));
+    if (selected.empty()) {
       std::cout << "No GPU device found.\n";
       return 1;
     }
+    const DeviceInfo &root = topology.roots()[selected[0].root].info;
+    device gpu_device = topology.resolve(root);
+
+    std::cout << "Selected device: " << root.name << std::endl;
 
-    std::cout << "Selected device: "
-              << gpu_device.get_info<info::device::name>() << std::endl;
-
-    // Create sub-devices
-    std::vector<device> sub_devices;
-    try {
-      sub_devices = gpu_device.create_sub_devices<
-          info::partition_property::partition_by_affinity_domain>(
-          info::partition_affinity_domain::next_partitionable);
-    } catch (exception &e) {
-      std::cout << "Failed to create sub-devices: " << e.what() << std::endl;
+    std::vector<DeviceInfo> tiles;
+    for (const auto &info : selected) {
+      if (info.root == selected[0].root) tiles.push_back(info);
+    }
+    std::vector<device> sub_devices = topology.resolve(tiles);
+    if (topology.roots()[selected[0].root].tiles == 0) {
       std::cout << "Using the main device as a single sub-device.\n";
-      sub_devices.push_back(gpu_device);
     }
 
     std::cout << "Number of sub-devices: " << sub_devices.size() << std::endl;
+    if (sub_devices.size() < 2) {
+      std::cout << "At least 2 sub-devices are required.\n";
+      return 1;
+    }
 
-    // Create queues for each sub-device
-    queue q1(sub_devices[0], exception_handler);
-    queue q2(sub_devices[1], exception_handler);
+    // Create queues for each sub-device, in one context, so the arrays
+    // allocated against q1 are valid on q2 and either tile can be named
+    // as a preferred location
+    context tile_context({sub_devices[0], sub_devices[1]});
+    queue q1(tile_context, sub_devices[0], harness_exception_handler);
+    queue q2(tile_context, sub_devices[1], harness_exception_handler);
 
     // Print out the device information used for the kernel code.
     std::cout << "Running on device: "
@@ -129,15 +142,57 @@ int main(int argc, char *argv[]) {
     for (size_t i = 0; i < array_size; i++) sum_sequential[i] = a[i] + b[i];
 
     // Vector addition in SYCL using two sub-devices.
+    bench.set_param("size", array_size);
+    bench.set_param("device", root.name);
+    bench.set_param("usm_policy", to_string(policy));
+
+    // Each tile gets the hints for its own half of the arrays. "migrate"
+    // is what the policy moves ahead of the kernels, "first_kernel" the
+    // first launch, which migrates whatever is left on demand.
+    // The halves VectorAdd gives each tile, the second one with the odd
+    // element out
+    size_t half = array_size / 2;
+    size_t half_bytes = half * sizeof(int);
+    size_t rest_bytes = (array_size - half) * sizeof(int);
+    std::vector<UsmRange> ranges1 = {{a, half_bytes, true},
+                                     {b, half_bytes, true},
+                                     {sum_parallel, half_bytes, false}};
+    std::vector<UsmRange> ranges2 = {{a + half, rest_bytes, true},
+                                     {b + half, rest_bytes, true},
+                                     {sum_parallel + half, rest_bytes, false}};
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<event> hints = apply_usm_policy(q1, policy, ranges1);
+    for (auto &e : apply_usm_policy(q2, policy, ranges2)) hints.push_back(e);
+    for (auto &e : hints) e.wait();
+    Stats migrate = bench.record("migrate", {ElapsedMs(start)});
+    start = std::chrono::high_resolution_clock::now();
     VectorAdd(q1, q2, a, b, sum_parallel, array_size);
+    Stats first = bench.record("first_kernel", {ElapsedMs(start)});
+
+    Stats stats = bench.run(
+        "vecadd", [&]() { VectorAdd(q1, q2, a, b, sum_parallel, array_size); });
+
+    double migrate_back_ms = 0.0;
+    if (prefetch_back) {
+      start = std::chrono::high_resolution_clock::now();
+      prefetch_to_host({{sum_parallel, array_size * sizeof(int), false}});
+      migrate_back_ms = bench.record("migrate_back", {ElapsedMs(start)}).median;
+    }
 
     // Verify that the two arrays are equal.
+    start = std::chrono::high_resolution_clock::now();
     for (size_t i = 0; i < array_size; i++) {
       if (sum_parallel[i] != sum_sequential[i]) {
         std::cout << "Vector add failed on device.\n";
         return -1;
       }
     }
+    Stats verify = bench.record("verify", {ElapsedMs(start)});
+
+    std::cout << "USM policy " << to_string(policy) << ": migrate "
+              << migrate.median << " ms, first kernel " << first.median
+              << " ms, kernel " << stats.median << " ms, migrate back "
+              << migrate_back_ms << " ms, verify " << verify.median << " ms\n";
 
     int indices[]{0, 1, 2, (static_cast<int>(array_size) - 1)};
     constexpr size_t indices_size = sizeof(indices) / sizeof(int);
@@ -154,9 +209,14 @@ int main(int argc, char *argv[]) {
     free(b, q1);
     free(sum_sequential, q1);
     free(sum_parallel, q1);
+
+    bench.report();
   } catch (exception const &e) {
     std::cout << "An exception is caught while adding two vectors.\n";
     std::terminate();
+  } catch (std::exception const &e) {
+    std::cout << "Error: " << e.what() << "\n";
+    return -1;
   }
 
   auto end_time = std::chrono::high_resolution_clock::now();
@@ -5,23 +5,13 @@
 #include <sycl/sycl.hpp>
 #include <vector>
 
+#include "harness.h"
+#include "topology.h"
+
 using namespace sycl;
 
 size_t array_size = 100000000;
 
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const &e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const &e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 void VectorAdd(queue &q, const int *a, const int *b, int *sum, size_t size) {
   range<1> num_items{size};
   auto e = q.parallel_for(num_items, [=](auto i) { sum[i] = a[i] + b[i]; });
@@ -31,16 +21,19 @@ void VectorAdd(queue &q, const int *a, const int *b, int *sum, size_t size) {
 int main(int argc, char *argv[]) {
   auto start_time = std::chrono::high_resolution_clock::now();
 
-  if (argc > 1) array_size = std::stoi(argv[1]);
-
   try {
-    // Get all GPU devices
-    auto platforms = platform::get_platforms();
-    std::vector<device> gpu_devices;
-    for (auto &platform : platforms) {
-      auto devices = platform.get_devices(info::device_type::gpu);
-      gpu_devices.insert(gpu_devices.end(), devices.begin(), devices.end());
-    }
+    Args args(argc, argv);
+    array_size = args.positional_int(0, array_size);
+    args.finish();
+    Harness bench("vecadd_2gpu", args.harness());
+
+    // Get all GPU root devices from the cached topology
+    Topology topology = Topology::load();
+    TopologyFilter filter;
+    filter.type = "gpu";
+    filter.tiles = false;
+    std::vector<device> gpu_devices =
+        topology.resolve(topology.select(topology_filter_from_env(filter)));
 
     if (gpu_devices.size() < 2) {
       std::cout << "Not enough GPU devices available. At least 2 GPUs are "
@@ -50,8 +43,8 @@ int main(int argc, char *argv[]) {
 
     // Explicitly use device 0 and device 1
     std::vector<queue> queues;
-    queues.emplace_back(gpu_devices[0], exception_handler);
-    queues.emplace_back(gpu_devices[1], exception_handler);
+    queues.emplace_back(gpu_devices[0], harness_exception_handler);
+    queues.emplace_back(gpu_devices[1], harness_exception_handler);
 
     std::cout << "Using device 0: "
               << gpu_devices[0].get_info<info::device::name>() << "\n";
@@ -89,16 +82,20 @@ int main(int argc, char *argv[]) {
     }
 
     // Parallel computation on two devices
-    for (int i = 0; i < 2; ++i) {
-      size_t local_size = (i == 1) ? (array_size - sub_size) : sub_size;
-      VectorAdd(queues[i], a_list[i], b_list[i], sum_parallel_list[i],
-                local_size);
-    }
+    bench.set_param("size", array_size);
+    bench.set_param("devices", 2);
+    bench.run("vecadd", [&]() {
+      for (int i = 0; i < 2; ++i) {
+        size_t local_size = (i == 1) ? (array_size - sub_size) : sub_size;
+        VectorAdd(queues[i], a_list[i], b_list[i], sum_parallel_list[i],
+                  local_size);
+      }
 
-    // Wait for all queues to finish
-    for (auto &q : queues) {
-      q.wait_and_throw();
-    }
+      // Wait for all queues to finish
+      for (auto &q : queues) {
+        q.wait_and_throw();
+      }
+    });
 
     // Verify the results
     bool correct = true;
@@ -131,7 +128,9 @@ int main(int argc, char *argv[]) {
       free(sum_parallel_list[i], queues[i]);
     }
     free(sum_sequential, queues[0]);
-  } catch (exception const &e) {
+
+    bench.report();
+  } catch (std::exception const &e) {
     std::cout << "An exception is caught: " << e.what() << "\n";
     return -1;
   }
@@ -5,23 +5,13 @@
 #include <sycl/sycl.hpp>
 #include <vector>
 
+#include "harness.h"
+#include "topology.h"
+
 using namespace sycl;
 
 size_t array_size = 100000000;
 
-static auto exception_handler = [](sycl::exception_list e_list) {
-  for (std::exception_ptr const& e : e_list) {
-    try {
-      std::rethrow_exception(e);
-    } catch (std::exception const& e) {
-#if _DEBUG
-      std::cout << "Failure" << std::endl;
-#endif
-      std::terminate();
-    }
-  }
-};
-
 void VectorAdd(queue& q, const int* a, const int* b, int* sum, size_t size) {
   range<1> num_items{size};
   auto e = q.parallel_for(num_items, [=](auto i) { sum[i] = a[i] + b[i]; });
@@ -31,16 +21,18 @@ void VectorAdd(queue& q, const int* a, const int* b, int* sum, size_t size) {
 int main(int argc, char* argv[]) {
   auto start_time = std::chrono::high_resolution_clock::now();
 
-  if (argc > 1) array_size = std::stoi(argv[1]);
-
   try {
-    // Get all GPU devices
-    auto platforms = platform::get_platforms();
-    std::vector<device> gpu_devices;
-    for (auto& platform : platforms) {
-      auto devices = platform.get_devices(info::device_type::gpu);
-      gpu_devices.insert(gpu_devices.end(), devices.begin(), devices.end());
-    }
+    Args args(argc, argv);
+    array_size = args.positional_int(0, array_size);
+    args.finish();
+    Harness bench("vecadd_2gpu_2tile", args.harness());
+
+    // Get all GPU root devices from the cached topology
+    Topology topology = Topology::load();
+    TopologyFilter filter;
+    filter.type = "gpu";
+    filter.tiles = false;
+    auto gpu_devices = topology.select(topology_filter_from_env(filter));
 
     if (gpu_devices.size() < 2) {
       std::cout << "Not enough GPU devices available. At least 2 GPUs are "
@@ -49,24 +41,18 @@ int main(int argc, char* argv[]) {
     }
 
     // Use device 0 and device 1
-    std::vector<device> main_devices = {gpu_devices[0], gpu_devices[1]};
     std::vector<std::vector<device>> all_sub_devices;
 
     for (int i = 0; i < 2; ++i) {
-      std::cout << "Main device " << i << ": "
-                << main_devices[i].get_info<info::device::name>() << "\n";
-      std::vector<device> sub_devices;
-      try {
-        sub_devices =
-            main_devices[i]
-                .create_sub_devices<
-                    info::partition_property::partition_by_affinity_domain>(
-                    info::partition_affinity_domain::next_partitionable);
+      std::cout << "Main device " << i << ": " << gpu_devices[i].name << "\n";
+      TopologyFilter tiles;
+      tiles.root = gpu_devices[i].root;
+      std::vector<device> sub_devices =
+          topology.resolve(topology.select(tiles));
+      if (topology.roots()[gpu_devices[i].root].tiles > 0) {
         std::cout << "  Number of sub-devices: " << sub_devices.size() << "\n";
-      } catch (exception& e) {
-        std::cout << "  Failed to create sub-devices: " << e.what() << "\n";
+      } else {
         std::cout << "  Using the main device as a single sub-device.\n";
-        sub_devices.push_back(main_devices[i]);
       }
       all_sub_devices.push_back(sub_devices);
     }
@@ -78,7 +64,7 @@ int main(int argc, char* argv[]) {
     for (const auto& sub_devices : all_sub_devices) {
       std::vector<queue> device_queues;
       for (const auto& sub_dev : sub_devices) {
-        device_queues.emplace_back(sub_dev, exception_handler);
+        device_queues.emplace_back(sub_dev, harness_exception_handler);
       }
       all_queues.push_back(device_queues);
     }
@@ -126,24 +112,28 @@ int main(int argc, char* argv[]) {
     }
 
     // Compute in parallel on all sub-devices
-    for (int i = 0; i < 2; ++i) {
-      size_t sub_device_count = all_sub_devices[i].size();
-      size_t sub_size = main_sub_size / sub_device_count;
-      for (size_t j = 0; j < sub_device_count; ++j) {
-        size_t local_size = (j == sub_device_count - 1)
-                                ? (main_sub_size - j * sub_size)
-                                : sub_size;
-        VectorAdd(all_queues[i][j], a_list[i][j], b_list[i][j],
-                  sum_parallel_list[i][j], local_size);
+    bench.set_param("size", array_size);
+    bench.set_param("devices", 2);
+    bench.run("vecadd", [&]() {
+      for (int i = 0; i < 2; ++i) {
+        size_t sub_device_count = all_sub_devices[i].size();
+        size_t sub_size = main_sub_size / sub_device_count;
+        for (size_t j = 0; j < sub_device_count; ++j) {
+          size_t local_size = (j == sub_device_count - 1)
+                                  ? (main_sub_size - j * sub_size)
+                                  : sub_size;
+          VectorAdd(all_queues[i][j], a_list[i][j], b_list[i][j],
+                    sum_parallel_list[i][j], local_size);
+        }
       }
-    }
 
-    // Wait for all queues to complete
-    for (auto& device_queues : all_queues) {
-      for (auto& q : device_queues) {
-        q.wait_and_throw();
+      // Wait for all queues to complete
+      for (auto& device_queues : all_queues) {
+        for (auto& q : device_queues) {
+          q.wait_and_throw();
+        }
       }
-    }
+    });
 
     // Verification
     bool correct = true;
@@ -186,7 +176,9 @@ int main(int argc, char* argv[]) {
       }
     }
     free(sum_sequential, all_queues[0][0]);
-  } catch (exception const& e) {
+
+    bench.report();
+  } catch (std::exception const& e) {
     std::cout << "An exception is caught: " << e.what() << "\n";
     return -1;
   }